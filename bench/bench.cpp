@@ -0,0 +1,688 @@
+// Microbenchmarks for engine hot paths, no window or GL context needed.
+//
+// usage: shahter_bench [--filter <substring>] [--min-time <seconds>] [--thresholds <file>]
+//
+// With --thresholds the process exits with 1 if any benchmark is slower or
+// allocates more than its limit in the file.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+using namespace glm;
+
+#include "chunk.h"
+#include "entity.h"
+#include "farfield.h"
+#include "jobs.h"
+#include "memory.h"
+#include "net.h"
+#include "particle.h"
+#include "tick.h"
+#include "render.h"
+#include "server.h"
+#include "text.h"
+#include "trace.h"
+#include "translucent.h"
+#include "world.h"
+
+#define BENCH_SEED 0x5eed5eedu
+#define BENCH_DEFAULT_MIN_TIME 0.25
+#define BENCH_MAX_NAME 64
+// speedup limits are only checked with the main thread and this many
+// workers or more, fewer can't reach them
+#define BENCH_SPEEDUP_MIN_THREADS 4
+#define BENCH_ENTITIES 20000
+#define BENCH_PARTICLES 131072
+// 128 x 64 x 128 blocks, 8 tick regions
+#define BENCH_WORLD_X 8
+#define BENCH_WORLD_Y 4
+#define BENCH_WORLD_Z 8
+// sand blocks dropped per game tick
+#define BENCH_SAND_DROPS 16
+// ticks before a column is dropped into again, sand lands within about 100
+#define BENCH_SAND_TICKS 128
+// socketless clients walking around the server's world
+#define BENCH_CLIENTS 32
+#define BENCH_SERVER_ENTITIES 2000
+
+// job threads allocate inside the timed ops too
+static std::atomic<uint64_t> alloc_count(0);
+
+void *operator new(size_t size) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+// keeps results alive so the optimizer can't drop the work
+static volatile float sink;
+
+static uint32_t rng_state;
+
+static inline uint32_t rng_next() {
+    // xorshift32
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+// --- fixtures ----------------------------------------------------------------
+
+static BlockCoord bench_coords[BLOCK_COUNT];
+static Chunk chunk_random;
+static Chunk chunk_checker;
+static Chunk chunk_solid;
+static MeshVertices mesh_vertices;
+
+// water and glass scattered through a chunk, nearly every face shows
+static Chunk chunk_glass;
+static TranslucentMesh glass_mesh;
+static TranslucentOrder glass_order;
+static float glass_angle;
+// a lake, a surface the camera walks along
+static Chunk chunk_lake;
+static TranslucentMesh lake_mesh;
+static TranslucentOrder lake_order;
+static float lake_angle;
+
+static RenderQueue queue;
+static GlyphCache glyph_cache;
+static TextBatch text_batch;
+
+static std::vector<DrawItem> sort_items;
+
+static World floor_world;
+static Chunk *chunk_floor;
+static JobPool jobs;
+static EntityWorld entities;
+static EntityVector<float> entity_instances;
+
+static World tick_world;
+static TickEngine ticks;
+// columns dropped into, cycled through by bench_tick_step
+static int sand_columns[BENCH_SAND_TICKS * BENCH_SAND_DROPS][2];
+static uint32_t sand_steps;
+// the same terrain as tick_world before any ticks, nothing changes it
+static World still_world;
+
+static Server server;
+static NetBuffer snapshot;
+
+static ParticleSystem particles;
+// rain landing on chunk_floor, about 100k particles alive
+static Weather bench_rain = {
+    .rate = 80000.0f,
+    .radius = 8.0f,
+    .height = 24.0f,
+    .fall_speed = 20.0f,
+    .drift = 0.2f,
+    .life = 3.0f,
+    .rest = 0.0f,
+    .size = 0.08f,
+    .uv = glm::vec4(0.0f, 1.0f, 0.1f, 0.9f),
+};
+
+// One game tick with sand raining down on the terrain. The sand that
+// landed in a column is taken out before the column gets more, so the
+// work per tick stays the same however many ticks run.
+static uint64_t bench_tick_step() {
+    int top = BENCH_WORLD_Y * CHUNK_SIZE - 1;
+    const int (*columns)[2] = &sand_columns[(sand_steps % BENCH_SAND_TICKS) * BENCH_SAND_DROPS];
+    for (int i = 0; i < BENCH_SAND_DROPS; i++) {
+        int x = columns[i][0];
+        int z = columns[i][1];
+        for (int y = top; y > 0; y--) {
+            // still falling sand has air below
+            if (world_get_block(&tick_world, x, y, z) == BLOCK_SAND && world_get_block(&tick_world, x, y - 1, z) != BLOCK_AIR) {
+                tick_set_block(&ticks, x, y, z, BLOCK_AIR);
+            }
+        }
+        tick_set_block(&ticks, x, top, z, BLOCK_SAND);
+    }
+    sand_steps++;
+    tick_step(&ticks, &jobs);
+    return ticks.stats.scheduled_ticks + ticks.stats.random_ticks;
+}
+
+static uint32_t server_steps;
+
+// Every client walks its own way and turns now and then, so the views
+// keep moving and loading new chunks.
+static void steer_clients() {
+    for (size_t i = 0; i < server.clients.size(); i++) {
+        float angle = (float)i * 0.7f + (float)(server_steps / 64) * 2.0f;
+        NetBuffer &in = server.clients[i].conn.in;
+        size_t start = net_begin_message(in, NET_INPUT);
+        net_put_i8(in, (int8_t)(127.0f * cosf(angle)));
+        net_put_i8(in, (int8_t)(127.0f * sinf(angle)));
+        net_put_u8(in, 0);
+        net_end_message(in, start);
+    }
+    server_receive(&server);
+}
+
+// one game tick of the server with all its clients, returns bytes queued
+static uint64_t bench_server_step() {
+    if (server_steps++ % 64 == 0) {
+        steer_clients();
+    }
+    server_tick(&server);
+    server_send(&server);
+    server_flush(&server);
+    return server.stats.bytes;
+}
+
+static void setup() {
+    rng_state = BENCH_SEED;
+
+    bench_coords[BLOCK_FURNACE] = {
+        .front_x1 = 0.0f, .front_y1 = 1.0f, .front_x2 = 0.1f, .front_y2 = 0.9f,
+        .back_x1 = 0.1f, .back_y1 = 1.0f, .back_x2 = 0.2f, .back_y2 = 0.9f,
+        .top_x1 = 0.2f, .top_y1 = 1.0f, .top_x2 = 0.3f, .top_y2 = 0.9f,
+        .bottom_x1 = 0.3f, .bottom_y1 = 1.0f, .bottom_x2 = 0.4f, .bottom_y2 = 0.9f,
+        .left_x1 = 0.4f, .left_y1 = 1.0f, .left_x2 = 0.5f, .left_y2 = 0.9f,
+        .right_x1 = 0.5f, .right_y1 = 1.0f, .right_x2 = 0.6f, .right_y2 = 0.9f,
+    };
+
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                // roughly a third of the blocks filled
+                chunk_set_block(&chunk_random, x, y, z, rng_next() % 3 == 0 ? BLOCK_FURNACE : BLOCK_AIR);
+                chunk_set_block(&chunk_checker, x, y, z, (x + y + z) % 2 ? BLOCK_FURNACE : BLOCK_AIR);
+                chunk_set_block(&chunk_solid, x, y, z, BLOCK_FURNACE);
+                uint32_t r = rng_next() % 3;
+                chunk_set_block(&chunk_glass, x, y, z, r == 0 ? BLOCK_WATER : (r == 1 ? BLOCK_GLASS : BLOCK_AIR));
+                if (y < 8) {
+                    chunk_set_block(&chunk_lake, x, y, z, y < 2 ? BLOCK_DIRT : BLOCK_WATER);
+                }
+            }
+        }
+    }
+    mesh_vertices.clear();
+    mesh_chunk(&chunk_glass, bench_coords, mesh_vertices, &glass_mesh);
+    mesh_chunk(&chunk_lake, bench_coords, mesh_vertices, &lake_mesh);
+
+    // ground with a few pillars, entities settle on it and stay in the chunk
+    world_init(&floor_world, 1, 1, 1);
+    chunk_floor = world_chunk(&floor_world, 0, 0, 0);
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            chunk_set_block(chunk_floor, x, 0, z, BLOCK_FURNACE);
+            if (rng_next() % 8 == 0) {
+                chunk_set_block(chunk_floor, x, 1, z, BLOCK_FURNACE);
+                chunk_set_block(chunk_floor, x, 2, z, BLOCK_FURNACE);
+            }
+        }
+    }
+    jobs_init(&jobs);
+    for (int i = 0; i < BENCH_ENTITIES; i++) {
+        float half = 0.1f + (float)(rng_next() % 200) / 1000.0f;
+        vec3 position(
+            1.0f + (float)(rng_next() % 1300) / 100.0f,
+            4.0f + (float)(rng_next() % 1000) / 100.0f,
+            1.0f + (float)(rng_next() % 1300) / 100.0f
+        );
+        EntityId id = entity_create(&entities, position, vec3(half), ENTITY_MESH_BLOCK);
+        entities.vel_x[entity_index(&entities, id)] = (float)(rng_next() % 200) / 100.0f - 1.0f;
+    }
+
+    // rolling grass over dirt, the air chunks above are skipped by random ticks
+    world_init(&tick_world, BENCH_WORLD_X, BENCH_WORLD_Y, BENCH_WORLD_Z);
+    world_init(&still_world, BENCH_WORLD_X, BENCH_WORLD_Y, BENCH_WORLD_Z);
+    for (int x = 0; x < BENCH_WORLD_X * CHUNK_SIZE; x++) {
+        for (int z = 0; z < BENCH_WORLD_Z * CHUNK_SIZE; z++) {
+            int top = 16 + (int)(4.0f * sinf(x * 0.1f) + 4.0f * cosf(z * 0.13f));
+            for (int y = 0; y < top; y++) {
+                world_set_block(&tick_world, x, y, z, BLOCK_DIRT);
+                world_set_block(&still_world, x, y, z, BLOCK_DIRT);
+            }
+            world_set_block(&tick_world, x, top, z, BLOCK_GRASS);
+            world_set_block(&still_world, x, top, z, BLOCK_GRASS);
+        }
+    }
+    for (int i = 0; i < BENCH_SAND_TICKS * BENCH_SAND_DROPS; i++) {
+        sand_columns[i][0] = (int)(rng_next() % (BENCH_WORLD_X * CHUNK_SIZE));
+        sand_columns[i][1] = (int)(rng_next() % (BENCH_WORLD_Z * CHUNK_SIZE));
+    }
+    tick_init(&ticks, &tick_world, BENCH_SEED);
+    // until the falling sand and the queues stop growing
+    for (int i = 0; i < 200; i++) {
+        bench_tick_step();
+    }
+
+    ServerConfig server_config = {
+        .port = 0,
+        .size_x = 16,
+        .size_y = 4,
+        .size_z = 16,
+        .seed = BENCH_SEED,
+        .entities = BENCH_SERVER_ENTITIES,
+    };
+    server_init(&server, &server_config, &jobs);
+    for (int i = 0; i < BENCH_CLIENTS; i++) {
+        server_add_client(&server, -1);
+        NetBuffer &in = server.clients.back().conn.in;
+        size_t start = net_begin_message(in, NET_HELLO);
+        net_put_u32(in, NET_PROTOCOL_VERSION);
+        net_end_message(in, start);
+    }
+    server_receive(&server);
+    // until every buffer has grown to what it needs
+    for (int i = 0; i < 400; i++) {
+        bench_server_step();
+    }
+
+    particle_init(&particles, BENCH_PARTICLES, BENCH_SEED);
+    particle_set_world(&particles, &floor_world, ivec3(0));
+    for (int i = 0; i < 120; i++) {
+        particle_emit_weather(&particles, &bench_rain, vec3(7.5f, 0.0f, 7.5f), 1.0f / 60.0f);
+        particle_update(&particles, 1.0f / 60.0f);
+    }
+
+    // synthetic FiraCode-like metrics, cells are reserved but never uploaded
+    glyph_cache_init(&glyph_cache);
+    for (uint32_t c = 32; c < 0x460; c++) {
+        // ASCII and Cyrillic
+        if (c == 128) {
+            c = 0x400;
+        }
+        GlyphMetrics metrics = {
+            .size = c == ' ' ? glm::ivec2(0, 0) : glm::ivec2(36, 45),
+            .bearing = glm::ivec2(-6, 37),
+            .advance = 24.0f,
+        };
+        glyph_cache_insert(&glyph_cache, 0, c, metrics, NULL);
+    }
+    text_batch.glyphs = &glyph_cache;
+    text_batch.program = 1;
+    text_batch.vao = 1;
+
+    for (int i = 0; i < 4096; i++) {
+        DrawItem item = {};
+        item.pass = (RenderPass)(rng_next() % PASS_COUNT);
+        item.program = rng_next() % 4 + 1;
+        item.texture = rng_next() % 256 + 1;
+        item.vao = rng_next() % 64 + 1;
+        item.depth = (float)(rng_next() % 10000) / 10000.0f;
+        sort_items.push_back(item);
+    }
+}
+
+// --- benchmarks, each runs one op and returns the number of items processed ---
+
+static uint64_t mesh_chunk_op(const Chunk *chunk) {
+    mesh_vertices.clear();
+    mesh_chunk(chunk, bench_coords, mesh_vertices);
+    sink = mesh_vertices.empty() ? 0.0f : mesh_vertices[0];
+    return mesh_vertices.size() / CHUNK_VERTEX_SIZE;
+}
+
+static uint64_t bench_mesh_chunk_random() {
+    return mesh_chunk_op(&chunk_random);
+}
+
+static uint64_t bench_mesh_chunk_checker() {
+    return mesh_chunk_op(&chunk_checker);
+}
+
+static uint64_t bench_mesh_chunk_solid() {
+    return mesh_chunk_op(&chunk_solid);
+}
+
+static uint64_t bench_block_face_uvs() {
+    float acc = 0.0f;
+    for (int i = 0; i < 1024; i++) {
+        float uvs[4][2];
+        block_face_uvs(&bench_coords[BLOCK_FURNACE], i % FACE_COUNT, uvs);
+        acc += uvs[i & 3][0];
+    }
+    sink = acc;
+    return 1024;
+}
+
+static uint64_t bench_text_layout() {
+    render_queue_clear(&queue);
+    text_batch.vertices.clear();
+    render_text(&queue, &text_batch, "Shahter v0.0.1", 25.0f, 25.0f, 36.0f, glm::vec3(0.3f, 0.3f, 0.8f));
+    render_text(&queue, &text_batch, "fps: 144", 1670.0f, 1010.0f, 36.0f, glm::vec3(1.0f, 1.0f, 1.0f));
+    render_text(&queue, &text_batch, "ms: 6.94", 1670.0f, 974.0f, 36.0f, glm::vec3(1.0f, 1.0f, 1.0f));
+    render_text(&queue, &text_batch, "res: 100%", 1670.0f, 938.0f, 36.0f, glm::vec3(1.0f, 1.0f, 1.0f));
+    render_text(&queue, &text_batch, "Шахтёр: память", 25.0f, 1010.0f, 22.0f, glm::vec3(1.0f, 1.0f, 1.0f));
+    sink = text_batch.vertices[0];
+    // glyphs laid out
+    return text_batch.vertices.size() / (6 * TEXT_VERTEX_SIZE);
+}
+
+static uint64_t bench_frame_matrices() {
+    vec3 camera_pos(1.0f, 2.0f, 3.0f);
+    vec3 camera_front(0.0f, 0.0f, -1.0f);
+    vec3 camera_up(0.0f, 1.0f, 0.0f);
+
+    mat4 view = lookAt(camera_pos, camera_pos + camera_front, camera_up);
+    mat4 projection = perspective(radians(85.0f), 1920.0f / 1080.0f, 0.1f, 100.0f);
+    mat4 block_model = scale(mat4(1.0f), vec3(0.5f, 0.5f, 0.5f));
+    mat4 skybox_view = mat4(mat3(view));
+    mat4 text_projection = ortho(0.0f, 1920.0f, 0.0f, 1080.0f);
+
+    sink = view[3][0] + projection[0][0] + block_model[0][0] + skybox_view[1][1] + text_projection[0][0];
+    return 1;
+}
+
+static uint64_t bench_render_queue_sort() {
+    render_queue_clear(&queue);
+    for (const DrawItem &item : sort_items) {
+        render_queue_submit(&queue, item);
+    }
+    render_queue_sort(&queue);
+    sink = (float)queue.order[0];
+    return sort_items.size();
+}
+
+static uint64_t bench_entity_update_serial() {
+    entity_update(&entities, NULL, &floor_world, 1.0f / 60.0f);
+    sink = entities.pos_y[0];
+    return entity_count(&entities);
+}
+
+static uint64_t bench_entity_update_jobs() {
+    entity_update(&entities, &jobs, &floor_world, 1.0f / 60.0f);
+    sink = entities.pos_y[0];
+    return entity_count(&entities);
+}
+
+static uint64_t bench_entity_instances() {
+    uint32_t n = entity_build_instances(&entities, ENTITY_MESH_BLOCK, entity_instances);
+    sink = entity_instances[0];
+    return n;
+}
+
+// one 60 Hz step of steady rain, emission included
+static uint64_t particle_step(ParticleKernel kernel) {
+    particles.kernel = kernel;
+    particle_emit_weather(&particles, &bench_rain, vec3(7.5f, 0.0f, 7.5f), 1.0f / 60.0f);
+    particle_update(&particles, 1.0f / 60.0f);
+    sink = particles.fields[PARTICLE_POS_Y][0];
+    return particles.count;
+}
+
+static uint64_t bench_particle_update() {
+    return particle_step(particle_best_kernel());
+}
+
+// where the camera is after a one block step on a circle around the chunk
+static glm::vec3 orbit_step(float *angle, float radius, float height) {
+    *angle += 1.0f / radius;
+    return glm::vec3(7.5f + radius * cosf(*angle), height, 7.5f + radius * sinf(*angle));
+}
+
+// re-sorts after the camera crossed into the next block
+static uint64_t bench_translucent_sort_glass() {
+    translucent_sort(&glass_order, &glass_mesh, orbit_step(&glass_angle, 24.0f, 20.0f));
+    return glass_mesh.splits.size();
+}
+
+static uint64_t bench_translucent_sort_lake() {
+    translucent_sort(&lake_order, &lake_mesh, orbit_step(&lake_angle, 24.0f, 12.0f));
+    return lake_mesh.splits.size();
+}
+
+static uint64_t bench_particle_update_scalar() {
+    return particle_step(PARTICLE_KERNEL_SCALAR);
+}
+
+// a chunk through the ground, about what an edited far chunk costs
+static const uint8_t bench_colors[BLOCK_COUNT][3] = {
+    { 0, 0, 0 },
+    { 110, 110, 110 },
+    { 220, 210, 160 },
+    { 130, 95, 65 },
+    { 120, 170, 80 },
+    { 140, 180, 245 },
+    { 105, 155, 215 },
+};
+static uint8_t far_cells[FAR_CHUNK_BYTES];
+
+static uint64_t bench_far_field_chunk() {
+    far_field_build_chunk(&still_world, bench_colors, 3, 1, 3, far_cells);
+    return FAR_CHUNK_CELLS * FAR_CHUNK_CELLS * FAR_CHUNK_CELLS;
+}
+
+static uint64_t bench_net_compress_chunk() {
+    snapshot.clear();
+    net_compress_chunk(world_chunk(&still_world, 3, 1, 3), snapshot);
+    return snapshot.size();
+}
+
+// cost of one enabled zone, nothing to measure when compiled out
+static uint64_t bench_trace_scope() {
+    TRACE_SCOPE("bench_trace_scope");
+    return 1;
+}
+
+struct Bench {
+    const char *name;
+    uint64_t (*fn)();
+};
+
+static const Bench BENCHES[] = {
+    { "mesh_chunk_random", bench_mesh_chunk_random },
+    { "mesh_chunk_checker", bench_mesh_chunk_checker },
+    { "mesh_chunk_solid", bench_mesh_chunk_solid },
+    { "translucent_sort_glass", bench_translucent_sort_glass },
+    { "translucent_sort_lake", bench_translucent_sort_lake },
+    { "block_face_uvs", bench_block_face_uvs },
+    { "text_layout", bench_text_layout },
+    { "frame_matrices", bench_frame_matrices },
+    { "render_queue_sort", bench_render_queue_sort },
+    { "entity_update_serial", bench_entity_update_serial },
+    { "entity_update_jobs", bench_entity_update_jobs },
+    { "entity_instances", bench_entity_instances },
+    { "tick_step", bench_tick_step },
+    { "server_step", bench_server_step },
+    { "net_compress_chunk", bench_net_compress_chunk },
+    { "far_field_chunk", bench_far_field_chunk },
+    { "particle_update", bench_particle_update },
+    { "particle_update_scalar", bench_particle_update_scalar },
+    { "trace_scope", bench_trace_scope },
+};
+
+// --- runner --------------------------------------------------------------------
+
+struct Threshold {
+    char name[BENCH_MAX_NAME];
+    double max_ns_per_op;
+    double max_allocs_per_op;
+};
+
+// `name` has to run at least `min` times faster than `baseline`.
+struct Speedup {
+    char name[BENCH_MAX_NAME];
+    char baseline[BENCH_MAX_NAME];
+    double min;
+};
+
+// Lines of "<name> <max ns/op> <max allocs/op>" or
+// "speedup <name> <baseline> <min>", # starts a comment.
+static bool load_thresholds(const char *path, std::vector<Threshold> &thresholds, std::vector<Speedup> &speedups) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: Failed to open thresholds file %s\n", path);
+        return false;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        Speedup sp;
+        if (sscanf(line, "speedup %63s %63s %lf", sp.name, sp.baseline, &sp.min) == 3) {
+            speedups.push_back(sp);
+            continue;
+        }
+        Threshold t;
+        if (sscanf(line, "%63s %lf %lf", t.name, &t.max_ns_per_op, &t.max_allocs_per_op) == 3) {
+            thresholds.push_back(t);
+        }
+    }
+    fclose(f);
+
+    return true;
+}
+
+static double now_ns() {
+    using namespace std::chrono;
+    return (double)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv) {
+    const char *filter = NULL;
+    const char *thresholds_path = NULL;
+    double min_time = BENCH_DEFAULT_MIN_TIME;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--thresholds") == 0 && i + 1 < argc) {
+            thresholds_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--filter <substring>] [--min-time <seconds>] [--thresholds <file>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<Threshold> thresholds;
+    std::vector<Speedup> speedups;
+    if (thresholds_path && !load_thresholds(thresholds_path, thresholds, speedups)) {
+        return 2;
+    }
+
+    setup();
+
+    int failed = 0;
+    printf("%-24s %14s %16s %14s\n", "benchmark", "ns/op", "items/s", "allocs/op");
+
+    // 0 for the ones filtered out
+    double results[sizeof(BENCHES) / sizeof(BENCHES[0])] = {};
+    for (size_t bi = 0; bi < sizeof(BENCHES) / sizeof(BENCHES[0]); bi++) {
+        const Bench &b = BENCHES[bi];
+        if (filter && strstr(b.name, filter) == NULL) {
+            continue;
+        }
+
+        // warm up caches and let vectors reach their steady capacity
+        for (int i = 0; i < 3; i++) {
+            b.fn();
+        }
+
+        uint64_t ops = 0;
+        uint64_t items = 0;
+        // tagged containers bypass operator new
+        uint64_t allocs_before = alloc_count.load(std::memory_order_relaxed) + mem_alloc_count();
+        double start = now_ns();
+        double elapsed = 0.0;
+        uint64_t batch = 1;
+        while (elapsed < min_time * 1e9) {
+            for (uint64_t i = 0; i < batch; i++) {
+                items += b.fn();
+            }
+            ops += batch;
+            batch *= 2;
+            elapsed = now_ns() - start;
+        }
+        uint64_t allocs = alloc_count.load(std::memory_order_relaxed) + mem_alloc_count() - allocs_before;
+
+        double ns_per_op = elapsed / (double)ops;
+        results[bi] = ns_per_op;
+        double items_per_sec = (double)items / (elapsed / 1e9);
+        double allocs_per_op = (double)allocs / (double)ops;
+        printf("%-24s %14.1f %16.0f %14.2f", b.name, ns_per_op, items_per_sec, allocs_per_op);
+
+        for (const Threshold &t : thresholds) {
+            if (strcmp(t.name, b.name) != 0) {
+                continue;
+            }
+            if (ns_per_op > t.max_ns_per_op || allocs_per_op > t.max_allocs_per_op) {
+                printf("  FAIL (limit %.1f ns/op, %.2f allocs/op)", t.max_ns_per_op, t.max_allocs_per_op);
+                failed++;
+            }
+        }
+        printf("\n");
+    }
+
+    int threads = (int)jobs.workers.size() + 1;
+    for (const Speedup &sp : speedups) {
+        double name_ns = 0.0;
+        double baseline_ns = 0.0;
+        for (size_t bi = 0; bi < sizeof(BENCHES) / sizeof(BENCHES[0]); bi++) {
+            if (strcmp(BENCHES[bi].name, sp.name) == 0) {
+                name_ns = results[bi];
+            }
+            if (strcmp(BENCHES[bi].name, sp.baseline) == 0) {
+                baseline_ns = results[bi];
+            }
+        }
+        if (name_ns == 0.0 || baseline_ns == 0.0) {
+            continue;
+        }
+        double speedup = baseline_ns / name_ns;
+        printf("%-24s %13.2fx over %s", sp.name, speedup, sp.baseline);
+        if (threads < BENCH_SPEEDUP_MIN_THREADS) {
+            printf("  (not checked, %d threads)", threads);
+        } else if (speedup < sp.min) {
+            printf("  FAIL (limit %.2fx)", sp.min);
+            failed++;
+        }
+        printf("\n");
+    }
+
+    // joinable threads can't outlive main
+    jobs_destroy(&jobs);
+
+    if (failed) {
+        fprintf(stderr, "%d benchmark(s) over threshold\n", failed);
+        return 1;
+    }
+
+    return 0;
+}
@@ -2,10 +2,12 @@
 out vec4 FragColor;
 
 in vec2 TexCoord;
+in float Occlusion;
 
 uniform sampler2D texture1;
 
 void main()
 {
-	FragColor = texture(texture1, TexCoord);
+	vec4 color = texture(texture1, TexCoord);
+	FragColor = vec4(color.rgb * Occlusion, color.a);
 }
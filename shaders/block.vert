@@ -1,15 +1,21 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in float aOcclusion;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 out vec2 TexCoord;
+out float Occlusion;
+
+// brightness of the 4 voxel AO levels, 0 is the darkest corner
+const float ao_curve[4] = float[4](0.45, 0.65, 0.85, 1.0);
 
 void main()
 {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
     TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+    Occlusion = ao_curve[int(aOcclusion)];
 }
@@ -0,0 +1,26 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in float aOcclusion;
+// per instance, in chunk space
+layout (location = 3) in vec3 aCenter;
+layout (location = 4) in vec3 aHalfExtents;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec2 TexCoord;
+out float Occlusion;
+
+// brightness of the 4 voxel AO levels, 0 is the darkest corner
+const float ao_curve[4] = float[4](0.45, 0.65, 0.85, 1.0);
+
+void main()
+{
+    // the mesh is a unit cube around the origin
+    vec3 position = aCenter + aPos * aHalfExtents * 2.0;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+    TexCoord = aTexCoord;
+    Occlusion = ao_curve[int(aOcclusion)];
+}
@@ -0,0 +1,143 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 Ndc;
+
+// level 0: average color and solid fraction of 4x4x4 block cells,
+// level 2: one texel per chunk, alpha set for the chunks to look into
+uniform sampler3D cells;
+uniform mat4 view_projection;
+uniform mat4 inverse_view_projection;
+uniform vec3 camera;
+uniform float block_size;    // world units per block
+uniform ivec3 chunk_count;
+uniform float max_distance;  // in blocks
+
+const float CELL = 4.0;
+const float CHUNK = 16.0;
+// cells and chunks together, caps the cost of grazing rays
+const int MAX_STEPS = 256;
+
+// the ray in block space, block (x, y, z) covers [x, x + 1) and so on
+vec3 origin;
+vec3 dir;
+vec3 inv_dir;
+ivec3 dir_step;
+
+// Walks the cells of `chunk` from t to t_end, true at the first solid one.
+// `axis` is the one last crossed, the hit face faces back along it.
+bool march_cells(ivec3 chunk, float t, float t_end, inout int axis, inout int steps, out vec4 color, out float hit_t)
+{
+    ivec3 lo = chunk * 4;
+    ivec3 hi = lo + 3;
+    ivec3 cell = clamp(ivec3(floor((origin + dir * t) / CELL)), lo, hi);
+    vec3 next = ((vec3(cell) + vec3(greaterThan(dir_step, ivec3(0)))) * CELL - origin) * inv_dir;
+    vec3 delta = abs(inv_dir) * CELL;
+
+    color = vec4(0.0);
+    hit_t = t;
+    for (; steps < MAX_STEPS; steps++) {
+        vec4 c = texelFetch(cells, cell, 0);
+        if (c.a >= 0.5) {
+            color = c;
+            hit_t = t;
+            return true;
+        }
+        if (next.x < next.y && next.x < next.z) {
+            axis = 0;
+            t = next.x;
+            cell.x += dir_step.x;
+            next.x += delta.x;
+        } else if (next.y < next.z) {
+            axis = 1;
+            t = next.y;
+            cell.y += dir_step.y;
+            next.y += delta.y;
+        } else {
+            axis = 2;
+            t = next.z;
+            cell.z += dir_step.z;
+            next.z += delta.z;
+        }
+        if (t >= t_end || any(lessThan(cell, lo)) || any(greaterThan(cell, hi))) {
+            return false;
+        }
+    }
+    return false;
+}
+
+void main()
+{
+    vec4 far_point = inverse_view_projection * vec4(Ndc, 1.0, 1.0);
+    dir = normalize(far_point.xyz / far_point.w - camera);
+    origin = camera / block_size + 0.5;
+
+    // the DDA divides by every component, keep them away from zero
+    vec3 signs = vec3(greaterThanEqual(dir, vec3(0.0))) * 2.0 - 1.0;
+    dir = signs * max(abs(dir), vec3(1e-6));
+    inv_dir = 1.0 / dir;
+    dir_step = ivec3(signs);
+
+    // clip the ray to the world box
+    vec3 t1 = -origin * inv_dir;
+    vec3 t2 = (vec3(chunk_count) * CHUNK - origin) * inv_dir;
+    vec3 t_min = min(t1, t2);
+    vec3 t_max = max(t1, t2);
+    float t = max(max(t_min.x, t_min.y), max(t_min.z, 0.0));
+    float t_end = min(min(t_max.x, t_max.y), min(t_max.z, max_distance));
+    if (t >= t_end) {
+        discard;
+    }
+    int axis = t_min.y >= t_min.x && t_min.y >= t_min.z ? 1 : (t_min.x >= t_min.z ? 0 : 2);
+
+    // chunk by chunk, only the marked ones are looked into
+    ivec3 chunk = clamp(ivec3(floor((origin + dir * t) / CHUNK)), ivec3(0), chunk_count - 1);
+    vec3 next = ((vec3(chunk) + vec3(greaterThan(dir_step, ivec3(0)))) * CHUNK - origin) * inv_dir;
+    vec3 delta = abs(inv_dir) * CHUNK;
+    int steps = 0;
+    vec4 color = vec4(0.0);
+    float hit_t = t;
+    bool hit = false;
+    while (steps < MAX_STEPS) {
+        float t_exit = min(min(next.x, next.y), min(next.z, t_end));
+        if (texelFetch(cells, chunk, 2).a > 0.5 && march_cells(chunk, t, t_exit, axis, steps, color, hit_t)) {
+            hit = true;
+            break;
+        }
+        steps++;
+        if (next.x < next.y && next.x < next.z) {
+            axis = 0;
+            t = next.x;
+            chunk.x += dir_step.x;
+            next.x += delta.x;
+        } else if (next.y < next.z) {
+            axis = 1;
+            t = next.y;
+            chunk.y += dir_step.y;
+            next.y += delta.y;
+        } else {
+            axis = 2;
+            t = next.z;
+            chunk.z += dir_step.z;
+            next.z += delta.z;
+        }
+        if (t >= t_end || any(lessThan(chunk, ivec3(0))) || any(greaterThanEqual(chunk, chunk_count))) {
+            break;
+        }
+    }
+    if (!hit) {
+        discard;
+    }
+
+    // flat light per face, tops brightest like the meshes' open corners
+    float light = axis == 0 ? 0.8 : 0.7;
+    if (axis == 1) {
+        light = dir_step.y < 0 ? 1.0 : 0.5;
+    }
+
+    // depth of the hit, so near geometry and the skybox sort against it
+    vec3 position = (origin + dir * hit_t - 0.5) * block_size;
+    vec4 clip = view_projection * vec4(position, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+    FragColor = vec4(color.rgb * light, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+
+// One triangle over the whole screen, no vertex buffer needed.
+out vec2 Ndc;
+
+void main()
+{
+    Ndc = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    gl_Position = vec4(Ndc, 1.0, 1.0);
+}
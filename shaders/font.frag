@@ -1,12 +1,16 @@
 #version 330 core
 in vec2 TexCoords;
+in vec3 TextColor;
 out vec4 color;
 
+// signed distance field, 0.5 is the glyph outline
 uniform sampler2D text;
-uniform vec3 textColor;
 
 void main()
 {
-    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
-    color = vec4(textColor, 1.0) * sampled;
+    float dist = texture(text, TexCoords).r;
+    // antialias over about one screen pixel at any text size
+    float width = max(fwidth(dist) * 0.7, 1e-4);
+    float alpha = smoothstep(0.5 - width, 0.5 + width, dist);
+    color = vec4(TextColor, alpha);
 }
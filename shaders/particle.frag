@@ -0,0 +1,16 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D texture1;
+
+void main()
+{
+	vec4 color = texture(texture1, TexCoord);
+	// cut out, particles are drawn in the opaque pass without sorting
+	if (color.a < 0.5) {
+		discard;
+	}
+	FragColor = vec4(color.rgb, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+// per instance, one stream per particle field
+layout (location = 1) in float aX;
+layout (location = 2) in float aY;
+layout (location = 3) in float aZ;
+layout (location = 4) in float aSize;
+layout (location = 5) in float aU1;
+layout (location = 6) in float aV1;
+layout (location = 7) in float aU2;
+layout (location = 8) in float aV2;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec2 TexCoord;
+
+void main()
+{
+    // camera right and up are the first two rows of the view rotation
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    vec3 position = vec3(aX, aY, aZ) + (right * aCorner.x + up * aCorner.y) * aSize;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+    TexCoord = mix(vec2(aU1, aV1), vec2(aU2, aV2), aCorner + 0.5);
+}
@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "capture.h"
+#include "memory.h"
+#include "render.h"
+#include "trace.h"
+
+// how long a readback is waited for before giving up on it
+#define CAPTURE_STOP_TIMEOUT_NS 1000000000ull
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static bool write_png_chunk(FILE *f, const char *type, const uint8_t *data, size_t size) {
+    uint8_t header[8];
+    put_be32(header, (uint32_t)size);
+    memcpy(header + 4, type, 4);
+    uLong crc = crc32(0, header + 4, 4);
+    // a NULL buffer would reset the crc instead
+    if (size > 0) {
+        crc = crc32(crc, data, (uInt)size);
+    }
+    uint8_t footer[4];
+    put_be32(footer, (uint32_t)crc);
+    return fwrite(header, 1, 8, f) == 8
+        && fwrite(data, 1, size, f) == size
+        && fwrite(footer, 1, 4, f) == 4;
+}
+
+// Flips the image upright and makes it opaque, the framebuffer alpha is
+// whatever blending left there. With `filter` every row gets the PNG "up"
+// filter byte in front, differences to the row above compress far better.
+static void prepare_rows(Capture *capture, const CaptureImage *image, bool filter) {
+    size_t stride = (size_t)image->width * 4;
+    size_t row_size = stride + (filter ? 1 : 0);
+    capture->rows.resize(row_size * (size_t)image->height);
+
+    for (int y = 0; y < image->height; y++) {
+        const uint8_t *src = image->pixels + (size_t)(image->height - 1 - y) * stride;
+        uint8_t *dst = capture->rows.data() + (size_t)y * row_size;
+        if (!filter) {
+            for (size_t i = 0; i < stride; i += 4) {
+                dst[i + 0] = src[i + 0];
+                dst[i + 1] = src[i + 1];
+                dst[i + 2] = src[i + 2];
+                dst[i + 3] = 255;
+            }
+            continue;
+        }
+        *dst++ = 2;  // up
+        const uint8_t *above = y > 0 ? image->pixels + (size_t)(image->height - y) * stride : NULL;
+        for (size_t i = 0; i < stride; i += 4) {
+            dst[i + 0] = (uint8_t)(src[i + 0] - (above ? above[i + 0] : 0));
+            dst[i + 1] = (uint8_t)(src[i + 1] - (above ? above[i + 1] : 0));
+            dst[i + 2] = (uint8_t)(src[i + 2] - (above ? above[i + 2] : 0));
+            dst[i + 3] = y > 0 ? 0 : 255;
+        }
+    }
+}
+
+static bool write_png(Capture *capture, const CaptureImage *image) {
+    TRACE_SCOPE("capture_write_png");
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/frame_%06llu.png", capture->directory.c_str(), (unsigned long long)image->frame);
+
+    prepare_rows(capture, image, true);
+    uLongf size = compressBound(capture->rows.size());
+    capture->compressed.resize(size);
+    // speed over size, the worker has to keep up with recording
+    if (compress2(capture->compressed.data(), &size, capture->rows.data(), capture->rows.size(), Z_BEST_SPEED) != Z_OK) {
+        fprintf(stderr, "Failed to compress capture frame %llu\n", (unsigned long long)image->frame);
+        return false;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    uint8_t ihdr[13];
+    put_be32(ihdr, (uint32_t)image->width);
+    put_be32(ihdr + 4, (uint32_t)image->height);
+    ihdr[8] = 8;   // bits per channel
+    ihdr[9] = 6;   // RGBA
+    ihdr[10] = 0;  // deflate
+    ihdr[11] = 0;  // adaptive filtering
+    ihdr[12] = 0;  // not interlaced
+    bool ok = fwrite(SIGNATURE, 1, 8, f) == 8
+        && write_png_chunk(f, "IHDR", ihdr, sizeof(ihdr))
+        && write_png_chunk(f, "IDAT", capture->compressed.data(), size)
+        && write_png_chunk(f, "IEND", NULL, 0);
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+static bool write_raw(Capture *capture, const CaptureImage *image) {
+    TRACE_SCOPE("capture_write_raw");
+
+    // a new file whenever the size changes, so every file plays as one video
+    if (capture->raw_file == NULL || capture->raw_width != image->width || capture->raw_height != image->height) {
+        if (capture->raw_file != NULL) {
+            fclose(capture->raw_file);
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/capture_%dx%d.rgba", capture->directory.c_str(), image->width, image->height);
+        capture->raw_file = fopen(path, "ab");
+        if (capture->raw_file == NULL) {
+            fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+            return false;
+        }
+        capture->raw_width = image->width;
+        capture->raw_height = image->height;
+    }
+
+    prepare_rows(capture, image, false);
+    if (fwrite(capture->rows.data(), 1, capture->rows.size(), capture->raw_file) != capture->rows.size()) {
+        fprintf(stderr, "Failed to write capture frame %llu\n", (unsigned long long)image->frame);
+        return false;
+    }
+    return true;
+}
+
+static void worker_main(Capture *capture) {
+    TRACE_THREAD_NAME("capture_writer");
+
+    std::unique_lock<std::mutex> lock(capture->mutex);
+    for (;;) {
+        capture->wake.wait(lock, [capture] { return capture->quit || !capture->queue.empty(); });
+        // everything queued is written before quitting
+        if (capture->queue.empty()) {
+            break;
+        }
+        CaptureImage image = capture->queue.front();
+        capture->queue.pop_front();
+        capture->room.notify_one();
+
+        lock.unlock();
+        bool ok = image.format == CAPTURE_PNG ? write_png(capture, &image) : write_raw(capture, &image);
+        lock.lock();
+
+        capture->free_images.push_back(image);
+        if (ok) {
+            capture->written++;
+        }
+    }
+}
+
+bool capture_start(Capture *capture, const char *directory) {
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create capture directory %s: %s\n", directory, strerror(errno));
+        return false;
+    }
+    capture->directory = directory;
+    for (CaptureSlot &slot : capture->slots) {
+        glGenBuffers(1, &slot.pbo);
+        slot.capacity = 0;
+        slot.fence = NULL;
+    }
+    capture->next_slot = 0;
+    capture->captured = 0;
+    capture->dropped = 0;
+    capture->keep_all = false;
+    capture->written = 0;
+    capture->quit = false;
+    capture->raw_file = NULL;
+    capture->raw_width = 0;
+    capture->raw_height = 0;
+    capture->worker = std::thread(worker_main, capture);
+    return true;
+}
+
+// Copies a signaled slot out of its buffer and queues it for the worker.
+static void collect(Capture *capture, CaptureSlot *slot) {
+    TRACE_SCOPE("capture_collect");
+
+    glDeleteSync(slot->fence);
+    slot->fence = NULL;
+
+    CaptureImage image = {};
+    {
+        std::unique_lock<std::mutex> lock(capture->mutex);
+        if (capture->keep_all) {
+            capture->room.wait(lock, [capture] { return capture->queue.size() < CAPTURE_MAX_QUEUED; });
+        }
+        if (capture->queue.size() >= CAPTURE_MAX_QUEUED) {
+            capture->dropped++;
+            return;
+        }
+        if (!capture->free_images.empty()) {
+            image = capture->free_images.back();
+            capture->free_images.pop_back();
+        }
+    }
+
+    size_t size = (size_t)slot->width * (size_t)slot->height * 4;
+    if (image.capacity < size) {
+        uint8_t *pixels = (uint8_t *)mem_realloc(MEM_RENDER, image.pixels, size);
+        if (pixels == NULL) {
+            fprintf(stderr, "Failed to allocate capture frame\n");
+            std::lock_guard<std::mutex> lock(capture->mutex);
+            capture->free_images.push_back(image);
+            capture->dropped++;
+            return;
+        }
+        image.pixels = pixels;
+        image.capacity = size;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)size, GL_MAP_READ_BIT);
+    bool ok = mapped != NULL;
+    if (ok) {
+        memcpy(image.pixels, mapped, size);
+        ok = glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    image.width = slot->width;
+    image.height = slot->height;
+    image.frame = slot->frame;
+    image.format = slot->format;
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        if (ok) {
+            capture->queue.push_back(image);
+        } else {
+            fprintf(stderr, "Failed to map capture frame %llu\n", (unsigned long long)slot->frame);
+            capture->free_images.push_back(image);
+            capture->dropped++;
+        }
+    }
+    capture->wake.notify_one();
+}
+
+void capture_poll(Capture *capture) {
+    // oldest first, so frames reach the worker in order
+    for (int i = 0; i < CAPTURE_RING; i++) {
+        CaptureSlot *slot = &capture->slots[(capture->next_slot + i) % CAPTURE_RING];
+        if (slot->fence == NULL) {
+            continue;
+        }
+        GLenum status = glClientWaitSync(slot->fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        collect(capture, slot);
+    }
+}
+
+void capture_frame(Capture *capture, uint64_t frame, int width, int height, CaptureFormat format) {
+    TRACE_SCOPE("capture_frame");
+
+    capture_poll(capture);
+
+    CaptureSlot *slot = &capture->slots[capture->next_slot];
+    if (slot->fence != NULL && capture->keep_all) {
+        glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, CAPTURE_STOP_TIMEOUT_NS);
+        capture_poll(capture);
+    }
+    if (slot->fence != NULL) {
+        // the GPU is CAPTURE_RING frames behind, waiting would stall us
+        capture->dropped++;
+        return;
+    }
+
+    size_t size = (size_t)width * (size_t)height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    if (slot->capacity < size) {
+        gpu_buffer_data(MEM_RENDER, slot->pbo, GL_PIXEL_PACK_BUFFER, (GLsizeiptr)size, NULL, GL_STREAM_READ);
+        slot->capacity = size;
+    }
+    // RGBA rows are always 4 byte aligned, the default pack alignment
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->width = width;
+    slot->height = height;
+    slot->frame = frame;
+    slot->format = format;
+
+    capture->next_slot = (capture->next_slot + 1) % CAPTURE_RING;
+    capture->captured++;
+}
+
+void capture_stop(Capture *capture) {
+    if (!capture->worker.joinable()) {
+        return;
+    }
+    for (int i = 0; i < CAPTURE_RING; i++) {
+        CaptureSlot *slot = &capture->slots[(capture->next_slot + i) % CAPTURE_RING];
+        if (slot->fence == NULL) {
+            continue;
+        }
+        GLenum status = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, CAPTURE_STOP_TIMEOUT_NS);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            collect(capture, slot);
+        } else {
+            glDeleteSync(slot->fence);
+            slot->fence = NULL;
+            capture->dropped++;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        capture->quit = true;
+    }
+    capture->wake.notify_one();
+    capture->worker.join();
+
+    for (CaptureImage &image : capture->free_images) {
+        mem_free(MEM_RENDER, image.pixels);
+    }
+    capture->free_images.clear();
+    for (CaptureSlot &slot : capture->slots) {
+        gpu_delete_buffers(1, &slot.pbo);
+        slot.pbo = 0;
+    }
+    if (capture->raw_file != NULL) {
+        fclose(capture->raw_file);
+        capture->raw_file = NULL;
+    }
+}
+
+uint64_t capture_written(Capture *capture) {
+    std::lock_guard<std::mutex> lock(capture->mutex);
+    return capture->written;
+}
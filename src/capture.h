@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Framebuffer capture without stalling the GPU. glReadPixels goes into a
+// ring of pixel pack buffers and returns at once, each buffer is mapped
+// only after its fence signaled, a frame or two later. A worker thread
+// writes the pixels out, so encoding never shows up in the frame time.
+//
+// Frames are dropped rather than waited for: when the ring slot is still
+// being read back, or when the worker has CAPTURE_MAX_QUEUED frames it
+// hasn't written yet. Replays set keep_all and wait for the worker instead,
+// reference images with holes are no use.
+
+#define CAPTURE_RING 3
+#define CAPTURE_MAX_QUEUED 4
+
+enum CaptureFormat : uint8_t {
+    CAPTURE_PNG = 0,  // <directory>/frame_<frame>.png
+    CAPTURE_RAW,      // appended to <directory>/capture_<w>x<h>.rgba, top row first
+};
+
+// Pixels handed to the worker, RGBA with the bottom row first like GL.
+struct CaptureImage {
+    uint8_t *pixels;
+    size_t capacity;
+    int width;
+    int height;
+    uint64_t frame;
+    CaptureFormat format;
+};
+
+struct CaptureSlot {
+    GLuint pbo;
+    size_t capacity;
+    GLsync fence;  // NULL when the slot is free
+    int width;
+    int height;
+    uint64_t frame;
+    CaptureFormat format;
+};
+
+struct Capture {
+    std::string directory;
+    CaptureSlot slots[CAPTURE_RING];
+    uint32_t next_slot;  // also the oldest one in use
+    uint64_t captured;   // readbacks started
+    uint64_t dropped;
+    bool keep_all;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable room;  // the worker took a frame
+    std::deque<CaptureImage> queue;
+    std::vector<CaptureImage> free_images;
+    bool quit;
+    uint64_t written;
+
+    // worker only
+    FILE *raw_file;
+    int raw_width;
+    int raw_height;
+    std::vector<uint8_t> rows;
+    std::vector<uint8_t> compressed;
+};
+
+// Creates `directory` if needed and starts the worker. Needs the GL context.
+bool capture_start(Capture *capture, const char *directory);
+// Waits for the readbacks in flight and everything queued to be written.
+void capture_stop(Capture *capture);
+
+// Starts reading the color buffer of the bound read framebuffer, call it
+// after the frame is drawn and before swapping. `frame` names PNG files.
+void capture_frame(Capture *capture, uint64_t frame, int width, int height, CaptureFormat format);
+// Hands finished readbacks to the worker, never waits. capture_frame calls
+// it too, call it on frames that aren't captured so the last ones get out.
+void capture_poll(Capture *capture);
+
+uint64_t capture_written(Capture *capture);
@@ -0,0 +1,302 @@
+#include <string.h>
+
+#include "chunk.h"
+#include "trace.h"
+
+struct FaceDef {
+    int normal[3];
+    // corner offsets from the block center in half units, counter-clockwise
+    // when looking at the face from outside
+    int corners[4][3];
+    // 0 picks x1/y1 of the atlas rectangle, 1 picks x2/y2
+    int uv[4][2];
+};
+
+static const FaceDef FACES[FACE_COUNT] = {
+    // front
+    {
+        { 0, 0, 1 },
+        { { -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 }, { -1, 1, 1 } },
+        { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 0 } },
+    },
+    // back
+    {
+        { 0, 0, -1 },
+        { { -1, -1, -1 }, { -1, 1, -1 }, { 1, 1, -1 }, { 1, -1, -1 } },
+        { { 1, 1 }, { 1, 0 }, { 0, 0 }, { 0, 1 } },
+    },
+    // top
+    {
+        { 0, 1, 0 },
+        { { -1, 1, -1 }, { -1, 1, 1 }, { 1, 1, 1 }, { 1, 1, -1 } },
+        { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } },
+    },
+    // bottom
+    {
+        { 0, -1, 0 },
+        { { -1, -1, -1 }, { 1, -1, -1 }, { 1, -1, 1 }, { -1, -1, 1 } },
+        { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 0 } },
+    },
+    // left
+    {
+        { -1, 0, 0 },
+        { { -1, -1, -1 }, { -1, -1, 1 }, { -1, 1, 1 }, { -1, 1, -1 } },
+        { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 0 } },
+    },
+    // right
+    {
+        { 1, 0, 0 },
+        { { 1, -1, 1 }, { 1, -1, -1 }, { 1, 1, -1 }, { 1, 1, 1 } },
+        { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 0 } },
+    },
+};
+
+const uint32_t QUAD_SPLIT[2][6] = {
+    { 0, 1, 2, 2, 3, 0 },
+    { 1, 2, 3, 3, 0, 1 },
+};
+
+#define CHUNK_POOL_BLOCK 64
+
+static Pool chunk_pool;
+static bool chunk_pool_ready = false;
+
+Chunk *chunk_create() {
+    if (!chunk_pool_ready) {
+        pool_init(&chunk_pool, MEM_WORLD, sizeof(Chunk), CHUNK_POOL_BLOCK);
+        chunk_pool_ready = true;
+    }
+
+    Chunk *chunk = (Chunk *)pool_alloc(&chunk_pool);
+    if (chunk) {
+        memset(chunk->blocks, BLOCK_AIR, sizeof(chunk->blocks));
+        memset(chunk->counts, 0, sizeof(chunk->counts));
+    }
+    return chunk;
+}
+
+void chunk_destroy(Chunk *chunk) {
+    pool_free(&chunk_pool, chunk);
+}
+
+uint8_t chunk_get_block(const Chunk *chunk, int x, int y, int z) {
+    if (
+        x < 0 || x >= CHUNK_SIZE
+        || y < 0 || y >= CHUNK_SIZE
+        || z < 0 || z >= CHUNK_SIZE
+    ) {
+        return BLOCK_AIR;
+    }
+    return chunk->blocks[x][y][z];
+}
+
+void chunk_set_block(Chunk *chunk, int x, int y, int z, uint8_t block) {
+    uint8_t old = chunk->blocks[x][y][z];
+    if (old != BLOCK_AIR) {
+        chunk->counts[old]--;
+    }
+    if (block != BLOCK_AIR) {
+        chunk->counts[block]++;
+    }
+    chunk->blocks[x][y][z] = block;
+}
+
+// The blocks of a chunk and a one block border from its neighbours, so
+// the mesher needs no bounds checks. Block (x, y, z) is at [x + 1][y + 1][z + 1].
+#define PADDED_SIZE (CHUNK_SIZE + 2)
+typedef uint8_t PaddedBlocks[PADDED_SIZE][PADDED_SIZE][PADDED_SIZE];
+
+static void fill_padded(const ChunkNeighbours *around, PaddedBlocks &padded) {
+    for (int px = 0; px < PADDED_SIZE; px++) {
+        int x = px - 1;
+        int cx = x < 0 ? 0 : (x < CHUNK_SIZE ? 1 : 2);
+        int lx = x & (CHUNK_SIZE - 1);
+        for (int py = 0; py < PADDED_SIZE; py++) {
+            int y = py - 1;
+            int cy = y < 0 ? 0 : (y < CHUNK_SIZE ? 1 : 2);
+            int ly = y & (CHUNK_SIZE - 1);
+            uint8_t *row = padded[px][py];
+
+            const Chunk *middle = around->chunks[cx][cy][1];
+            if (middle) {
+                memcpy(row + 1, middle->blocks[lx][ly], CHUNK_SIZE);
+            } else {
+                memset(row + 1, BLOCK_AIR, CHUNK_SIZE);
+            }
+            const Chunk *back = around->chunks[cx][cy][0];
+            const Chunk *front = around->chunks[cx][cy][2];
+            row[0] = back ? back->blocks[lx][ly][CHUNK_SIZE - 1] : (uint8_t)BLOCK_AIR;
+            row[PADDED_SIZE - 1] = front ? front->blocks[lx][ly][0] : (uint8_t)BLOCK_AIR;
+        }
+    }
+}
+
+// Hides faces and darkens corners, translucent blocks do neither.
+static inline int is_opaque(const PaddedBlocks &padded, int x, int y, int z) {
+    uint8_t block = padded[x + 1][y + 1][z + 1];
+    return block != BLOCK_AIR && !block_is_translucent(block);
+}
+
+void block_face_uvs(const BlockCoord *c, int face, float uvs[4][2]) {
+    float rect[4];
+    switch (face) {
+    case FACE_FRONT:
+        rect[0] = c->front_x1; rect[1] = c->front_y1; rect[2] = c->front_x2; rect[3] = c->front_y2;
+        break;
+    case FACE_BACK:
+        rect[0] = c->back_x1; rect[1] = c->back_y1; rect[2] = c->back_x2; rect[3] = c->back_y2;
+        break;
+    case FACE_TOP:
+        rect[0] = c->top_x1; rect[1] = c->top_y1; rect[2] = c->top_x2; rect[3] = c->top_y2;
+        break;
+    case FACE_BOTTOM:
+        rect[0] = c->bottom_x1; rect[1] = c->bottom_y1; rect[2] = c->bottom_x2; rect[3] = c->bottom_y2;
+        break;
+    case FACE_LEFT:
+        rect[0] = c->left_x1; rect[1] = c->left_y1; rect[2] = c->left_x2; rect[3] = c->left_y2;
+        break;
+    default:
+        rect[0] = c->right_x1; rect[1] = c->right_y1; rect[2] = c->right_x2; rect[3] = c->right_y2;
+        break;
+    }
+
+    const FaceDef &f = FACES[face];
+    for (int i = 0; i < 4; i++) {
+        uvs[i][0] = rect[f.uv[i][0] * 2];
+        uvs[i][1] = rect[f.uv[i][1] * 2 + 1];
+    }
+}
+
+// Classic voxel AO: 0 is fully occluded, 3 is not occluded at all.
+// Two solid sides hide the corner block, so it doesn't matter then.
+static inline int vertex_ao(int side1, int side2, int corner) {
+    if (side1 && side2) {
+        return 0;
+    }
+    return 3 - (side1 + side2 + corner);
+}
+
+// Looks at the three blocks touching the corner in the layer the face looks into.
+static int corner_ao(const PaddedBlocks &padded, int x, int y, int z, const FaceDef &f, int corner) {
+    const int *c = f.corners[corner];
+
+    // layer in front of the face
+    int nx = x + f.normal[0];
+    int ny = y + f.normal[1];
+    int nz = z + f.normal[2];
+
+    // split the in-plane direction towards the corner into its two axes
+    int s1[3] = { 0, 0, 0 };
+    int s2[3] = { 0, 0, 0 };
+    if (f.normal[0] != 0) {
+        s1[1] = c[1];
+        s2[2] = c[2];
+    } else if (f.normal[1] != 0) {
+        s1[0] = c[0];
+        s2[2] = c[2];
+    } else {
+        s1[0] = c[0];
+        s2[1] = c[1];
+    }
+
+    int side1 = is_opaque(padded, nx + s1[0], ny + s1[1], nz + s1[2]);
+    int side2 = is_opaque(padded, nx + s2[0], ny + s2[1], nz + s2[2]);
+    int diag = is_opaque(
+        padded,
+        nx + s1[0] + s2[0],
+        ny + s1[1] + s2[1],
+        nz + s1[2] + s2[2]
+    );
+
+    return vertex_ao(side1, side2, diag);
+}
+
+static inline void push_vertex(
+    MeshVertices &vertices,
+    int x, int y, int z,
+    const FaceDef &f,
+    const float uvs[4][2],
+    int corner,
+    int ao
+) {
+    const int *c = f.corners[corner];
+    vertices.push_back((float)x + 0.5f * (float)c[0]);
+    vertices.push_back((float)y + 0.5f * (float)c[1]);
+    vertices.push_back((float)z + 0.5f * (float)c[2]);
+    vertices.push_back(uvs[corner][0]);
+    vertices.push_back(uvs[corner][1]);
+    vertices.push_back((float)ao);
+}
+
+void mesh_chunk(const Chunk *chunk, const BlockCoord *coords, MeshVertices &vertices, TranslucentMesh *translucent) {
+    ChunkNeighbours around = {};
+    around.chunks[1][1][1] = chunk;
+    mesh_chunk_neighbours(&around, coords, vertices, translucent);
+}
+
+void mesh_chunk_neighbours(
+    const ChunkNeighbours *around,
+    const BlockCoord *coords,
+    MeshVertices &vertices,
+    TranslucentMesh *out
+) {
+    TRACE_SCOPE("mesh_chunk");
+
+    const Chunk *chunk = around->chunks[1][1][1];
+    PaddedBlocks padded;
+    fill_padded(around, padded);
+
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                uint8_t block = chunk->blocks[x][y][z];
+                if (block == BLOCK_AIR) {
+                    continue;
+                }
+                bool translucent = block_is_translucent(block);
+                if (translucent && !out) {
+                    continue;
+                }
+
+                for (int face = 0; face < FACE_COUNT; face++) {
+                    const FaceDef &f = FACES[face];
+                    int nx = x + f.normal[0];
+                    int ny = y + f.normal[1];
+                    int nz = z + f.normal[2];
+                    // water next to water has no surface between them, in
+                    // the next chunk too
+                    if (is_opaque(padded, nx, ny, nz) || (translucent && padded[nx + 1][ny + 1][nz + 1] == block)) {
+                        continue;
+                    }
+
+                    float uvs[4][2];
+                    block_face_uvs(&coords[block], face, uvs);
+
+                    int ao[4];
+                    for (int i = 0; i < 4; i++) {
+                        ao[i] = corner_ao(padded, x, y, z, f, i);
+                    }
+
+                    // Split the quad along the brighter diagonal, otherwise
+                    // interpolation smears a dark corner across the whole face.
+                    int diagonal = ao[0] + ao[2] < ao[1] + ao[3] ? 1 : 0;
+                    if (translucent) {
+                        // indexed, only the order of the quads changes later
+                        for (int i = 0; i < 4; i++) {
+                            push_vertex(out->vertices, x, y, z, f, uvs, i, ao[i]);
+                        }
+                        out->centers.push_back((float)x + 0.5f * (float)f.normal[0]);
+                        out->centers.push_back((float)y + 0.5f * (float)f.normal[1]);
+                        out->centers.push_back((float)z + 0.5f * (float)f.normal[2]);
+                        out->splits.push_back((uint8_t)diagonal);
+                        continue;
+                    }
+                    const uint32_t *order = QUAD_SPLIT[diagonal];
+                    for (int i = 0; i < 6; i++) {
+                        push_vertex(vertices, x, y, z, f, uvs, order[i], ao[order[i]]);
+                    }
+                }
+            }
+        }
+    }
+}
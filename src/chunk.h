@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "memory.h"
+
+#define CHUNK_SIZE 16
+
+// floats per mesh vertex: position (3), texture coords (2), ambient occlusion (1)
+#define CHUNK_VERTEX_SIZE 6
+
+typedef std::vector<float, TagAllocator<float, MEM_MESHES>> MeshVertices;
+
+enum Face {
+    FACE_FRONT = 0, // +z
+    FACE_BACK,      // -z
+    FACE_TOP,       // +y
+    FACE_BOTTOM,    // -y
+    FACE_LEFT,      // -x
+    FACE_RIGHT,     // +x
+
+    FACE_COUNT
+};
+
+enum Block : uint8_t {
+    BLOCK_AIR = 0,
+    BLOCK_FURNACE,
+    BLOCK_SAND,     // falls, see tick.h
+    BLOCK_DIRT,
+    BLOCK_GRASS,    // spreads to dirt, turns to dirt when covered
+    BLOCK_WATER,    // translucent, still
+    BLOCK_GLASS,    // translucent
+
+    BLOCK_COUNT
+};
+
+// Blocks seen through, drawn after everything else, back to front.
+static inline bool block_is_translucent(uint8_t block) {
+    return block == BLOCK_WATER || block == BLOCK_GLASS;
+}
+
+// Atlas rectangle of every face of a block, in normalized texture coords.
+struct BlockCoord {
+    float front_x1;
+    float front_y1;
+    float front_x2;
+    float front_y2;
+
+    float back_x1;
+    float back_y1;
+    float back_x2;
+    float back_y2;
+
+    float top_x1;
+    float top_y1;
+    float top_x2;
+    float top_y2;
+
+    float bottom_x1;
+    float bottom_y1;
+    float bottom_x2;
+    float bottom_y2;
+
+    float left_x1;
+    float left_y1;
+    float left_x2;
+    float left_y2;
+
+    float right_x1;
+    float right_y1;
+    float right_x2;
+    float right_y2;
+};
+
+struct Chunk {
+    uint8_t blocks[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE]; // [x][y][z]
+    // blocks of every type in the chunk, air isn't counted. Kept up to date
+    // by chunk_set_block, so write blocks through it.
+    uint16_t counts[BLOCK_COUNT];
+};
+
+// Chunks come from a pool charged to MEM_WORLD, new ones are all air.
+// Not thread safe.
+Chunk *chunk_create();
+void chunk_destroy(Chunk *chunk);
+
+// Returns BLOCK_AIR for coordinates outside of the chunk.
+uint8_t chunk_get_block(const Chunk *chunk, int x, int y, int z);
+void chunk_set_block(Chunk *chunk, int x, int y, int z, uint8_t block);
+
+// Atlas coords of the 4 corners of a block face, in the order the mesher
+// emits them (counter-clockwise seen from outside).
+void block_face_uvs(const BlockCoord *coords, int face, float uvs[4][2]);
+
+// The two triangles of a quad from its 4 corners, split along one diagonal
+// or the other. Opaque faces are emitted in this order and translucent ones
+// indexed with it.
+extern const uint32_t QUAD_SPLIT[2][6];
+
+// Faces of translucent blocks, kept apart so they can be sorted. Quad q has
+// vertices 4q to 4q + 3 in `vertices`, its center at 3q in `centers` and
+// the diagonal it is split along in `splits` (see translucent.h).
+struct TranslucentMesh {
+    MeshVertices vertices;
+    MeshVertices centers;
+    std::vector<uint8_t, TagAllocator<uint8_t, MEM_MESHES>> splits;
+};
+
+// A chunk at [1][1][1] and the 26 around it, [x][y][z] like the blocks.
+// NULL ones read as air.
+struct ChunkNeighbours {
+    const Chunk *chunks[3][3][3];
+};
+
+// Appends two triangles per visible block face to `vertices`.
+// Block (x, y, z) is a unit cube centered at (x, y, z) in chunk space.
+// `coords` is indexed by block type. Faces of translucent blocks go to
+// `translucent`, or nowhere when it is NULL. Everything around the chunk
+// is air.
+void mesh_chunk(const Chunk *chunk, const BlockCoord *coords, MeshVertices &vertices, TranslucentMesh *translucent = NULL);
+// The same for the middle chunk of `around`, faces and corner shading at
+// its border look into the neighbours.
+void mesh_chunk_neighbours(
+    const ChunkNeighbours *around,
+    const BlockCoord *coords,
+    MeshVertices &vertices,
+    TranslucentMesh *translucent = NULL
+);
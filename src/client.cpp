@@ -0,0 +1,291 @@
+#include <stdio.h>
+
+#include "client.h"
+#include "trace.h"
+
+#define CHUNK_VOLUME (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+
+static int chunk_index(const NetClient *client, int cx, int cy, int cz) {
+    return (cx * client->size_y + cy) * client->size_z + cz;
+}
+
+static void free_chunks(NetClient *client) {
+    for (uint8_t *&blocks : client->chunks) {
+        mem_free(MEM_NET, blocks);
+        blocks = NULL;
+    }
+    client->chunk_count = 0;
+}
+
+bool client_connect(NetClient *client, const char *host, int port) {
+    int fd = net_connect(host, port);
+    if (fd < 0) {
+        return false;
+    }
+    net_connection_init(&client->conn, fd);
+    client->joined = false;
+    client->bye = false;
+    client->player = ENTITY_NONE;
+    client->size_x = 0;
+    client->size_y = 0;
+    client->size_z = 0;
+    client->tick = 0;
+    client->ticks = 0;
+    client->chunks.clear();
+    client->chunk_count = 0;
+    client->entities.clear();
+    client->entity_count = 0;
+
+    size_t start = net_begin_message(client->conn.out, NET_HELLO);
+    net_put_u32(client->conn.out, NET_PROTOCOL_VERSION);
+    net_end_message(client->conn.out, start);
+    client_flush(client);
+    return true;
+}
+
+void client_destroy(NetClient *client) {
+    free_chunks(client);
+    net_connection_close(&client->conn);
+    client->chunks = NetVector<uint8_t *>();
+    client->entities = NetVector<ReplicaEntity>();
+}
+
+// False for positions outside the world the server announced.
+static bool read_chunk_position(NetClient *client, NetReader *r, int *index) {
+    int cx = net_get_u16(r);
+    int cy = net_get_u16(r);
+    int cz = net_get_u16(r);
+    if (!r->ok || cx >= client->size_x || cy >= client->size_y || cz >= client->size_z) {
+        return false;
+    }
+    *index = chunk_index(client, cx, cy, cz);
+    return true;
+}
+
+static bool read_welcome(NetClient *client, NetReader *r) {
+    EntityId player = net_get_u32(r);
+    int size_x = net_get_u16(r);
+    int size_y = net_get_u16(r);
+    int size_z = net_get_u16(r);
+    uint32_t tick = net_get_u32(r);
+    if (!r->ok) {
+        return false;
+    }
+    // a respawn keeps the world, anything else starts over
+    if (size_x != client->size_x || size_y != client->size_y || size_z != client->size_z) {
+        free_chunks(client);
+        client->size_x = size_x;
+        client->size_y = size_y;
+        client->size_z = size_z;
+        client->chunks.assign((size_t)size_x * size_y * size_z, NULL);
+    }
+    client->player = player;
+    client->tick = tick;
+    client->joined = true;
+    return true;
+}
+
+static bool read_chunk(NetClient *client, NetReader *r) {
+    int index;
+    if (!read_chunk_position(client, r, &index)) {
+        return false;
+    }
+    if (client->chunks[index] == NULL) {
+        client->chunks[index] = (uint8_t *)mem_malloc(MEM_NET, CHUNK_VOLUME);
+        if (client->chunks[index] == NULL) {
+            fprintf(stderr, "Failed to allocate chunk\n");
+            return false;
+        }
+        client->chunk_count++;
+    }
+    size_t size = (size_t)(r->end - r->p);
+    return net_decompress_chunk(net_get_bytes(r, size), size, client->chunks[index]);
+}
+
+static bool read_unload(NetClient *client, NetReader *r) {
+    int index;
+    if (!read_chunk_position(client, r, &index)) {
+        return false;
+    }
+    if (client->chunks[index] != NULL) {
+        mem_free(MEM_NET, client->chunks[index]);
+        client->chunks[index] = NULL;
+        client->chunk_count--;
+    }
+    return true;
+}
+
+static ReplicaEntity *find_entity(NetClient *client, EntityId id) {
+    uint32_t slot = id & ENTITY_SLOT_MASK;
+    if (slot >= client->entities.size() || client->entities[slot].id != id) {
+        return NULL;
+    }
+    return &client->entities[slot];
+}
+
+static bool read_tick(NetClient *client, NetReader *r) {
+    client->tick = net_get_u32(r);
+    client->ticks++;
+
+    uint32_t changes = net_get_u32(r);
+    for (uint32_t i = 0; i < changes && r->ok; i++) {
+        int x, y, z;
+        net_unpack_block(net_get_u32(r), &x, &y, &z);
+        uint8_t block = net_get_u8(r);
+        int cx = x / CHUNK_SIZE;
+        int cy = y / CHUNK_SIZE;
+        int cz = z / CHUNK_SIZE;
+        if (cx >= client->size_x || cy >= client->size_y || cz >= client->size_z) {
+            return false;
+        }
+        uint8_t *blocks = client->chunks[chunk_index(client, cx, cy, cz)];
+        // the server only sends changes inside loaded chunks
+        if (blocks == NULL) {
+            return false;
+        }
+        int lx = x % CHUNK_SIZE;
+        int ly = y % CHUNK_SIZE;
+        int lz = z % CHUNK_SIZE;
+        blocks[(lx * CHUNK_SIZE + ly) * CHUNK_SIZE + lz] = block;
+    }
+
+    uint16_t removed = net_get_u16(r);
+    for (uint16_t i = 0; i < removed && r->ok; i++) {
+        ReplicaEntity *e = find_entity(client, net_get_u32(r));
+        if (e == NULL) {
+            return false;
+        }
+        e->id = ENTITY_NONE;
+        client->entity_count--;
+    }
+
+    uint16_t added = net_get_u16(r);
+    for (uint16_t i = 0; i < added && r->ok; i++) {
+        ReplicaEntity e;
+        e.id = net_get_u32(r);
+        e.x = net_get_i16(r);
+        e.y = net_get_i16(r);
+        e.z = net_get_i16(r);
+        e.mesh = net_get_u8(r);
+        e.half_x = net_get_u8(r);
+        e.half_y = net_get_u8(r);
+        e.half_z = net_get_u8(r);
+        uint32_t slot = e.id & ENTITY_SLOT_MASK;
+        if (slot >= client->entities.size()) {
+            client->entities.resize(slot + 1, { ENTITY_NONE, 0, 0, 0, 0, 0, 0, 0 });
+        }
+        // added again after a long jump
+        if (client->entities[slot].id != e.id) {
+            client->entity_count++;
+        }
+        client->entities[slot] = e;
+    }
+
+    uint16_t moved = net_get_u16(r);
+    for (uint16_t i = 0; i < moved && r->ok; i++) {
+        ReplicaEntity *e = find_entity(client, net_get_u32(r));
+        int8_t dx = net_get_i8(r);
+        int8_t dy = net_get_i8(r);
+        int8_t dz = net_get_i8(r);
+        if (e == NULL) {
+            return false;
+        }
+        e->x = (int16_t)(e->x + dx);
+        e->y = (int16_t)(e->y + dy);
+        e->z = (int16_t)(e->z + dz);
+    }
+    return r->ok;
+}
+
+static bool handle_message(NetClient *client, NetMessage type, NetReader *r) {
+    if (type == NET_WELCOME) {
+        return read_welcome(client, r);
+    }
+    if (!client->joined) {
+        return false;
+    }
+    switch (type) {
+    case NET_CHUNK:
+        return read_chunk(client, r);
+    case NET_UNLOAD:
+        return read_unload(client, r);
+    case NET_TICK:
+        return read_tick(client, r);
+    case NET_BYE:
+        client->bye = true;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool client_poll(NetClient *client) {
+    TRACE_SCOPE("client_poll");
+
+    NetConnection *conn = &client->conn;
+    net_receive(conn);
+
+    size_t offset = 0;
+    while (!client->bye) {
+        NetMessage type;
+        NetReader payload;
+        int64_t size = net_next_message(conn->in.data() + offset, conn->in.size() - offset, &type, &payload);
+        if (size == 0) {
+            break;
+        }
+        if (size < 0 || !handle_message(client, type, &payload)) {
+            fprintf(stderr, "Failed to read message %d from the server\n", size < 0 ? -1 : (int)type);
+            conn->closed = true;
+            return false;
+        }
+        offset += (size_t)size;
+    }
+    conn->in.erase(conn->in.begin(), conn->in.begin() + (ptrdiff_t)offset);
+
+    // the server closes right after saying bye, that's not an error
+    return client->bye || !conn->closed;
+}
+
+void client_send_input(NetClient *client, int move_x, int move_z, uint8_t buttons) {
+    NetBuffer &out = client->conn.out;
+    size_t start = net_begin_message(out, NET_INPUT);
+    net_put_i8(out, (int8_t)move_x);
+    net_put_i8(out, (int8_t)move_z);
+    net_put_u8(out, buttons);
+    net_end_message(out, start);
+}
+
+void client_send_set_block(NetClient *client, int x, int y, int z, uint8_t block) {
+    NetBuffer &out = client->conn.out;
+    size_t start = net_begin_message(out, NET_SET_BLOCK);
+    net_put_u32(out, net_pack_block(x, y, z));
+    net_put_u8(out, block);
+    net_end_message(out, start);
+}
+
+void client_flush(NetClient *client) {
+    net_flush(&client->conn);
+}
+
+uint8_t client_get_block(const NetClient *client, int x, int y, int z) {
+    if (
+        x < 0 || x >= client->size_x * CHUNK_SIZE
+        || y < 0 || y >= client->size_y * CHUNK_SIZE
+        || z < 0 || z >= client->size_z * CHUNK_SIZE
+    ) {
+        return BLOCK_AIR;
+    }
+    const uint8_t *blocks = client->chunks[chunk_index(client, x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE)];
+    if (blocks == NULL) {
+        return BLOCK_AIR;
+    }
+    return blocks[((x % CHUNK_SIZE) * CHUNK_SIZE + y % CHUNK_SIZE) * CHUNK_SIZE + z % CHUNK_SIZE];
+}
+
+const ReplicaEntity *client_entity(const NetClient *client, EntityId id) {
+    uint32_t slot = id & ENTITY_SLOT_MASK;
+    if (slot >= client->entities.size() || client->entities[slot].id != id) {
+        return NULL;
+    }
+    return &client->entities[slot];
+}
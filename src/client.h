@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "entity.h"
+#include "net.h"
+
+// Client end of the protocol in net.h: keeps a copy of the chunks and
+// entities the server streams to it. No GL, the scripted bots use it.
+
+struct ReplicaEntity {
+    EntityId id;     // ENTITY_NONE for empty slots
+    int16_t x;       // fixed point, see net_quantize
+    int16_t y;
+    int16_t z;
+    uint8_t mesh;
+    uint8_t half_x;
+    uint8_t half_y;
+    uint8_t half_z;
+};
+
+struct NetClient {
+    NetConnection conn;
+    bool joined;     // welcome received
+    bool bye;        // the server said goodbye
+    EntityId player;
+    int size_x;      // world size in chunks
+    int size_y;
+    int size_z;
+    uint32_t tick;   // last tick received
+    uint32_t ticks;  // ticks received in total
+
+    // CHUNK_SIZE^3 blocks per loaded chunk, NULL for the others
+    NetVector<uint8_t *> chunks;
+    uint32_t chunk_count;
+    NetVector<ReplicaEntity> entities;  // by slot
+    uint32_t entity_count;
+};
+
+// Connects and says hello. False if the server can't be reached.
+bool client_connect(NetClient *client, const char *host, int port);
+void client_destroy(NetClient *client);
+
+// Applies everything the server sent so far. False once the connection
+// is gone or the server sent something that doesn't parse.
+bool client_poll(NetClient *client);
+
+void client_send_input(NetClient *client, int move_x, int move_z, uint8_t buttons);
+void client_send_set_block(NetClient *client, int x, int y, int z, uint8_t block);
+// Writes what was queued by the client_send_* functions.
+void client_flush(NetClient *client);
+
+// BLOCK_AIR for chunks that aren't loaded.
+uint8_t client_get_block(const NetClient *client, int x, int y, int z);
+// NULL if the entity isn't known.
+const ReplicaEntity *client_entity(const NetClient *client, EntityId id);
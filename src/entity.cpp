@@ -0,0 +1,262 @@
+#include <math.h>
+
+#include "entity.h"
+#include "trace.h"
+
+// gap kept between a box and the block it was pushed out of, so it doesn't
+// count as overlapping on the next move
+#define ENTITY_SKIN 1e-4f
+// horizontal velocity lost per second while standing on a block
+#define ENTITY_GROUND_DRAG 8.0f
+
+#define ENTITY_GENERATION_MASK ((1u << (32 - ENTITY_SLOT_BITS)) - 1)
+
+EntityId entity_create(EntityWorld *world, glm::vec3 position, glm::vec3 half_extents, EntityMesh mesh) {
+    uint32_t slot;
+    if (!world->free_slots.empty()) {
+        slot = world->free_slots.back();
+        world->free_slots.pop_back();
+    } else {
+        slot = (uint32_t)world->slot_index.size();
+        // the last slot is left out so ENTITY_NONE is never a valid handle
+        if (slot >= ENTITY_SLOT_MASK) {
+            return ENTITY_NONE;
+        }
+        world->slot_index.push_back(0);
+        world->slot_generation.push_back(0);
+    }
+
+    EntityId id = slot | ((uint32_t)world->slot_generation[slot] << ENTITY_SLOT_BITS);
+    world->slot_index[slot] = (uint32_t)world->ids.size();
+    world->ids.push_back(id);
+
+    world->pos_x.push_back(position.x);
+    world->pos_y.push_back(position.y);
+    world->pos_z.push_back(position.z);
+    world->vel_x.push_back(0.0f);
+    world->vel_y.push_back(0.0f);
+    world->vel_z.push_back(0.0f);
+    world->half_x.push_back(half_extents.x);
+    world->half_y.push_back(half_extents.y);
+    world->half_z.push_back(half_extents.z);
+    world->mesh.push_back(mesh);
+    world->flags.push_back(0);
+
+    return id;
+}
+
+template <class T>
+static inline void move_last(EntityVector<T> &components, uint32_t index) {
+    components[index] = components.back();
+    components.pop_back();
+}
+
+void entity_destroy(EntityWorld *world, EntityId id) {
+    int64_t found = entity_index(world, id);
+    if (found < 0) {
+        return;
+    }
+    uint32_t index = (uint32_t)found;
+
+    move_last(world->pos_x, index);
+    move_last(world->pos_y, index);
+    move_last(world->pos_z, index);
+    move_last(world->vel_x, index);
+    move_last(world->vel_y, index);
+    move_last(world->vel_z, index);
+    move_last(world->half_x, index);
+    move_last(world->half_y, index);
+    move_last(world->half_z, index);
+    move_last(world->mesh, index);
+    move_last(world->flags, index);
+    move_last(world->ids, index);
+    if (index < world->ids.size()) {
+        world->slot_index[world->ids[index] & ENTITY_SLOT_MASK] = index;
+    }
+
+    uint32_t slot = id & ENTITY_SLOT_MASK;
+    world->slot_generation[slot] = (uint16_t)((world->slot_generation[slot] + 1) & ENTITY_GENERATION_MASK);
+    world->free_slots.push_back(slot);
+}
+
+int64_t entity_index(const EntityWorld *world, EntityId id) {
+    uint32_t slot = id & ENTITY_SLOT_MASK;
+    if (slot >= world->slot_index.size() || world->slot_generation[slot] != id >> ENTITY_SLOT_BITS) {
+        return -1;
+    }
+    return world->slot_index[slot];
+}
+
+uint32_t entity_count(const EntityWorld *world) {
+    return (uint32_t)world->ids.size();
+}
+
+// Moves `p` by `d` along `axis` and pushes the box back out of the first
+// solid block it ran into. Only the blocks under the box are looked at, a
+// box outside the world never touches the voxels. Returns true on a hit.
+static bool move_axis(const World *world, float p[3], const float h[3], int axis, float d) {
+    if (d == 0.0f) {
+        return false;
+    }
+    p[axis] += d;
+
+    // block i covers [i - 0.5, i + 0.5]
+    int size[3] = { world->size_x * CHUNK_SIZE, world->size_y * CHUNK_SIZE, world->size_z * CHUNK_SIZE };
+    int lo[3];
+    int hi[3];
+    for (int a = 0; a < 3; a++) {
+        lo[a] = (int)floorf(p[a] - h[a] + 0.5f);
+        hi[a] = (int)ceilf(p[a] + h[a] + 0.5f) - 1;
+        if (lo[a] < 0) {
+            lo[a] = 0;
+        }
+        if (hi[a] > size[a] - 1) {
+            hi[a] = size[a] - 1;
+        }
+        if (lo[a] > hi[a]) {
+            return false;
+        }
+    }
+
+    // walk the layers in the direction of motion, the first solid one stops us
+    int u = (axis + 1) % 3;
+    int w = (axis + 2) % 3;
+    int step = d > 0.0f ? 1 : -1;
+    int end = d > 0.0f ? hi[axis] + 1 : lo[axis] - 1;
+    for (int c = d > 0.0f ? lo[axis] : hi[axis]; c != end; c += step) {
+        for (int i = lo[u]; i <= hi[u]; i++) {
+            for (int j = lo[w]; j <= hi[w]; j++) {
+                int v[3];
+                v[axis] = c;
+                v[u] = i;
+                v[w] = j;
+                if (world_get_block(world, v[0], v[1], v[2]) != BLOCK_AIR) {
+                    if (d > 0.0f) {
+                        p[axis] = (float)c - 0.5f - h[axis] - ENTITY_SKIN;
+                    } else {
+                        p[axis] = (float)c + 0.5f + h[axis] + ENTITY_SKIN;
+                    }
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+struct UpdateJob {
+    EntityWorld *entities;
+    const World *world;
+    float dt;
+};
+
+static void update_entities(void *ctx, uint32_t first, uint32_t last) {
+    TRACE_SCOPE("entity_update_batch");
+
+    const UpdateJob *job = (const UpdateJob *)ctx;
+    EntityWorld *world = job->entities;
+    const World *blocks = job->world;
+    float dt = job->dt;
+
+    float drag = 1.0f - ENTITY_GROUND_DRAG * dt;
+    if (drag < 0.0f) {
+        drag = 0.0f;
+    }
+
+    float *pos_x = world->pos_x.data();
+    float *pos_y = world->pos_y.data();
+    float *pos_z = world->pos_z.data();
+    float *vel_x = world->vel_x.data();
+    float *vel_y = world->vel_y.data();
+    float *vel_z = world->vel_z.data();
+    const float *half_x = world->half_x.data();
+    const float *half_y = world->half_y.data();
+    const float *half_z = world->half_z.data();
+    uint8_t *flags = world->flags.data();
+
+    for (uint32_t i = first; i < last; i++) {
+        float vx = vel_x[i];
+        float vy = vel_y[i] - ENTITY_GRAVITY * dt;
+        float vz = vel_z[i];
+        if (vy < -ENTITY_TERMINAL_VELOCITY) {
+            vy = -ENTITY_TERMINAL_VELOCITY;
+        }
+        uint8_t f = flags[i];
+        if (f & ENTITY_ON_GROUND) {
+            vx *= drag;
+            vz *= drag;
+        }
+        f &= ~ENTITY_ON_GROUND;
+
+        float p[3] = { pos_x[i], pos_y[i], pos_z[i] };
+        float h[3] = { half_x[i], half_y[i], half_z[i] };
+
+        // vertical first, so a box landing on a ledge slides along its top
+        if (move_axis(blocks, p, h, 1, vy * dt)) {
+            if (vy < 0.0f) {
+                f |= ENTITY_ON_GROUND;
+            }
+            vy = 0.0f;
+        }
+        if (move_axis(blocks, p, h, 0, vx * dt)) {
+            vx = 0.0f;
+        }
+        if (move_axis(blocks, p, h, 2, vz * dt)) {
+            vz = 0.0f;
+        }
+        if (p[1] < ENTITY_KILL_Y) {
+            f |= ENTITY_DEAD;
+        }
+
+        pos_x[i] = p[0];
+        pos_y[i] = p[1];
+        pos_z[i] = p[2];
+        vel_x[i] = vx;
+        vel_y[i] = vy;
+        vel_z[i] = vz;
+        flags[i] = f;
+    }
+}
+
+uint32_t entity_update(EntityWorld *world, JobPool *jobs, const World *blocks, float dt) {
+    TRACE_SCOPE("entity_update");
+
+    // every entity only touches its own components, no locking needed
+    UpdateJob job = { world, blocks, dt };
+    jobs_parallel_for(jobs, entity_count(world), ENTITY_UPDATE_BATCH, update_entities, &job);
+
+    // backwards, so the entity swapped into a freed index was already checked
+    uint32_t removed = 0;
+    for (uint32_t i = entity_count(world); i-- > 0;) {
+        if (world->flags[i] & ENTITY_DEAD) {
+            entity_destroy(world, world->ids[i]);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+uint32_t entity_build_instances(const EntityWorld *world, EntityMesh mesh, EntityVector<float> &instances) {
+    TRACE_SCOPE("entity_build_instances");
+
+    uint32_t count = entity_count(world);
+    instances.resize((size_t)count * ENTITY_INSTANCE_SIZE);
+
+    float *out = instances.data();
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (world->mesh[i] != mesh) {
+            continue;
+        }
+        out[0] = world->pos_x[i];
+        out[1] = world->pos_y[i];
+        out[2] = world->pos_z[i];
+        out[3] = world->half_x[i];
+        out[4] = world->half_y[i];
+        out[5] = world->half_z[i];
+        out += ENTITY_INSTANCE_SIZE;
+        n++;
+    }
+    instances.resize((size_t)n * ENTITY_INSTANCE_SIZE);
+    return n;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "jobs.h"
+#include "memory.h"
+#include "world.h"
+
+// Entities live in chunk space, like blocks: block (x, y, z) is the unit
+// cube centered at (x, y, z).
+
+#define ENTITY_GRAVITY 24.0f
+#define ENTITY_TERMINAL_VELOCITY 30.0f
+// entities falling below this are removed by entity_update
+#define ENTITY_KILL_Y -32.0f
+// entities per job batch, small enough to spread over the workers
+#define ENTITY_UPDATE_BATCH 1024
+
+// Handle: slot in the low ENTITY_SLOT_BITS, generation above. A destroyed
+// entity's handle stays invalid until its slot wraps the generation around.
+typedef uint32_t EntityId;
+#define ENTITY_SLOT_BITS 20
+#define ENTITY_SLOT_MASK ((1u << ENTITY_SLOT_BITS) - 1)
+#define ENTITY_NONE 0xFFFFFFFFu
+
+// Meshes entities are drawn with, one instanced draw each.
+enum EntityMesh : uint8_t {
+    ENTITY_MESH_BLOCK = 0,
+
+    ENTITY_MESH_COUNT
+};
+
+enum EntityFlag : uint8_t {
+    ENTITY_ON_GROUND = 1 << 0,
+    ENTITY_DEAD = 1 << 1,
+};
+
+template <class T>
+using EntityVector = std::vector<T, TagAllocator<T, MEM_WORLD>>;
+
+// floats per instance: center (3), half extents (3)
+#define ENTITY_INSTANCE_SIZE 6
+
+// Components are stored as parallel arrays indexed by a dense index, so a
+// system only streams through the fields it touches. Destroying an entity
+// moves the last one into its place.
+struct EntityWorld {
+    // position, center of the bounding box
+    EntityVector<float> pos_x;
+    EntityVector<float> pos_y;
+    EntityVector<float> pos_z;
+    // velocity, blocks per second
+    EntityVector<float> vel_x;
+    EntityVector<float> vel_y;
+    EntityVector<float> vel_z;
+    // bounding box half extents
+    EntityVector<float> half_x;
+    EntityVector<float> half_y;
+    EntityVector<float> half_z;
+    // render instance
+    EntityVector<uint8_t> mesh;
+    EntityVector<uint8_t> flags;
+
+    // dense index -> handle
+    EntityVector<EntityId> ids;
+    // slot -> dense index and current generation
+    EntityVector<uint32_t> slot_index;
+    EntityVector<uint16_t> slot_generation;
+    EntityVector<uint32_t> free_slots;
+};
+
+// Returns ENTITY_NONE when all slots are taken.
+EntityId entity_create(EntityWorld *world, glm::vec3 position, glm::vec3 half_extents, EntityMesh mesh);
+void entity_destroy(EntityWorld *world, EntityId id);
+// Dense index of a live entity, -1 for stale handles.
+int64_t entity_index(const EntityWorld *world, EntityId id);
+uint32_t entity_count(const EntityWorld *world);
+
+// Integrates velocity and collides every entity against the blocks of
+// `blocks`, spread over `jobs` (NULL runs on the calling thread). Entities
+// below ENTITY_KILL_Y are destroyed after, returns how many.
+uint32_t entity_update(EntityWorld *world, JobPool *jobs, const World *blocks, float dt);
+
+// Replaces `instances` with ENTITY_INSTANCE_SIZE floats per entity drawn
+// with `mesh`, returns the instance count.
+uint32_t entity_build_instances(const EntityWorld *world, EntityMesh mesh, EntityVector<float> &instances);
@@ -0,0 +1,336 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "farfield.h"
+#include "trace.h"
+
+// cells at least this solid (out of 255) stop a ray, same as the shader's 0.5
+#define FAR_SOLID_ALPHA 128
+// chunks per job batch when building the whole world
+#define FAR_BUILD_BATCH 16
+
+static void chunk_coords(const World *world, uint32_t index, int *cx, int *cy, int *cz) {
+    *cz = (int)(index % (uint32_t)world->size_z);
+    *cy = (int)(index / (uint32_t)world->size_z % (uint32_t)world->size_y);
+    *cx = (int)(index / (uint32_t)world->size_z / (uint32_t)world->size_y);
+}
+
+static bool has_solid_cells(const uint8_t *cells) {
+    for (int i = 3; i < FAR_CHUNK_BYTES; i += 4) {
+        if (cells[i] >= FAR_SOLID_ALPHA) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void far_field_block_colors(
+    const uint8_t *atlas,
+    int width,
+    int height,
+    int channels,
+    const BlockCoord *coords,
+    uint8_t colors[BLOCK_COUNT][3]
+) {
+    memset(colors, 0, BLOCK_COUNT * 3);
+    for (int block = BLOCK_AIR + 1; block < BLOCK_COUNT; block++) {
+        const BlockCoord &c = coords[block];
+        int x1 = (int)(fminf(c.top_x1, c.top_x2) * width + 0.5f);
+        int x2 = (int)(fmaxf(c.top_x1, c.top_x2) * width + 0.5f);
+        int y1 = (int)(fminf(c.top_y1, c.top_y2) * height + 0.5f);
+        int y2 = (int)(fmaxf(c.top_y1, c.top_y2) * height + 0.5f);
+
+        uint64_t sum[3] = {};
+        uint64_t count = 0;
+        for (int y = y1; y < y2 && y < height; y++) {
+            for (int x = x1; x < x2 && x < width; x++) {
+                const uint8_t *p = atlas + ((size_t)y * width + x) * channels;
+                // see-through pixels don't show from afar either
+                if (channels == 4 && p[3] == 0) {
+                    continue;
+                }
+                sum[0] += p[0];
+                sum[1] += p[1];
+                sum[2] += p[2];
+                count++;
+            }
+        }
+        if (count > 0) {
+            for (int i = 0; i < 3; i++) {
+                colors[block][i] = (uint8_t)(sum[i] / count);
+            }
+        }
+    }
+}
+
+void far_field_build_chunk(
+    const World *world,
+    const uint8_t colors[BLOCK_COUNT][3],
+    int cx,
+    int cy,
+    int cz,
+    uint8_t *cells
+) {
+    memset(cells, 0, FAR_CHUNK_BYTES);
+    const Chunk *chunk = world_chunk(world, cx, cy, cz);
+    uint32_t blocks = 0;
+    for (int block = BLOCK_AIR + 1; block < BLOCK_COUNT; block++) {
+        blocks += chunk->counts[block];
+    }
+    if (blocks == 0) {
+        return;
+    }
+
+    for (int x = 0; x < FAR_CHUNK_CELLS; x++) {
+        for (int y = 0; y < FAR_CHUNK_CELLS; y++) {
+            for (int z = 0; z < FAR_CHUNK_CELLS; z++) {
+                uint32_t solid = 0;
+                uint32_t visible = 0;
+                uint32_t solid_sum[3] = {};
+                uint32_t visible_sum[3] = {};
+                for (int lx = x * FAR_CELL; lx < (x + 1) * FAR_CELL; lx++) {
+                    for (int ly = y * FAR_CELL; ly < (y + 1) * FAR_CELL; ly++) {
+                        for (int lz = z * FAR_CELL; lz < (z + 1) * FAR_CELL; lz++) {
+                            uint8_t block = chunk->blocks[lx][ly][lz];
+                            if (block == BLOCK_AIR) {
+                                continue;
+                            }
+                            const uint8_t *color = colors[block];
+                            solid++;
+                            solid_sum[0] += color[0];
+                            solid_sum[1] += color[1];
+                            solid_sum[2] += color[2];
+
+                            uint8_t above = ly + 1 < CHUNK_SIZE
+                                ? chunk->blocks[lx][ly + 1][lz]
+                                : world_get_block(world, cx * CHUNK_SIZE + lx, (cy + 1) * CHUNK_SIZE, cz * CHUNK_SIZE + lz);
+                            if (above == BLOCK_AIR) {
+                                visible++;
+                                visible_sum[0] += color[0];
+                                visible_sum[1] += color[1];
+                                visible_sum[2] += color[2];
+                            }
+                        }
+                    }
+                }
+                if (solid == 0) {
+                    continue;
+                }
+                uint8_t *cell = cells + (((z * FAR_CHUNK_CELLS) + y) * FAR_CHUNK_CELLS + x) * 4;
+                const uint32_t *sum = visible > 0 ? visible_sum : solid_sum;
+                uint32_t count = visible > 0 ? visible : solid;
+                cell[0] = (uint8_t)(sum[0] / count);
+                cell[1] = (uint8_t)(sum[1] / count);
+                cell[2] = (uint8_t)(sum[2] / count);
+                cell[3] = (uint8_t)(solid * 255 / (FAR_CELL * FAR_CELL * FAR_CELL));
+            }
+        }
+    }
+}
+
+struct BuildJob {
+    FarField *far;
+    uint8_t *cells;  // the whole level 0
+    int width;       // in cells
+    int height;
+};
+
+static void build_chunks(void *ctx, uint32_t first, uint32_t last) {
+    TRACE_SCOPE("far_field_build");
+
+    BuildJob *job = (BuildJob *)ctx;
+    FarField *far = job->far;
+    uint8_t cells[FAR_CHUNK_BYTES];
+    for (uint32_t index = first; index < last; index++) {
+        int cx, cy, cz;
+        chunk_coords(far->world, index, &cx, &cy, &cz);
+        far_field_build_chunk(far->world, far->colors, cx, cy, cz, cells);
+        far->solid[index] = has_solid_cells(cells);
+
+        // chunks are disjoint boxes of the level, rows of cells go in one by one
+        for (int z = 0; z < FAR_CHUNK_CELLS; z++) {
+            for (int y = 0; y < FAR_CHUNK_CELLS; y++) {
+                size_t at = (((size_t)(cz * FAR_CHUNK_CELLS + z) * job->height) + cy * FAR_CHUNK_CELLS + y) * job->width
+                    + cx * FAR_CHUNK_CELLS;
+                memcpy(job->cells + at * 4, cells + (z * FAR_CHUNK_CELLS + y) * FAR_CHUNK_CELLS * 4, FAR_CHUNK_CELLS * 4);
+            }
+        }
+    }
+}
+
+bool far_field_init(FarField *far, const World *world, const uint8_t colors[BLOCK_COUNT][3], JobPool *jobs) {
+    TRACE_SCOPE("far_field_init");
+
+    far->world = world;
+    memcpy(far->colors, colors, sizeof(far->colors));
+    far->texture = 0;
+    far->vao = 0;
+    far->marched_count = 0;
+
+    int width = world->size_x * FAR_CHUNK_CELLS;
+    int height = world->size_y * FAR_CHUNK_CELLS;
+    int depth = world->size_z * FAR_CHUNK_CELLS;
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_size);
+    if (width > max_size || height > max_size || depth > max_size) {
+        fprintf(stderr, "Failed to fit %dx%dx%d far field cells into a 3D texture, max is %d\n", width, height, depth, max_size);
+        return false;
+    }
+
+    uint32_t count = (uint32_t)world->size_x * world->size_y * world->size_z;
+    far->solid.assign(count, 0);
+    far->meshed.assign(count, 0);
+    far->marched.assign(count, 0);
+    far->dirty.assign(count, 0);
+    far->dirty_chunks.clear();
+    far->changed_chunks.clear();
+
+    FarVector<uint8_t> cells((size_t)width * height * depth * 4);
+    BuildJob job = { far, cells.data(), width, height };
+    jobs_parallel_for(jobs, count, FAR_BUILD_BATCH, build_chunks, &job);
+
+    FarVector<uint8_t> chunk_level((size_t)count * 4, 0);
+    for (uint32_t index = 0; index < count; index++) {
+        if (!far->solid[index]) {
+            continue;
+        }
+        int cx, cy, cz;
+        chunk_coords(world, index, &cx, &cy, &cz);
+        far->marched[index] = 255;
+        far->marched_count++;
+        chunk_level[(((size_t)cz * world->size_y + cy) * world->size_x + cx) * 4 + 3] = 255;
+    }
+
+    glGenTextures(1, &far->texture);
+    glBindTexture(GL_TEXTURE_3D, far->texture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, FAR_CHUNK_LEVEL);
+    gpu_tex_image_3d(MEM_TEXTURES, far->texture, 0, GL_RGBA8, width, height, depth, GL_RGBA, GL_UNSIGNED_BYTE, cells.data());
+    // never read, but the texture is incomplete without it
+    gpu_tex_image_3d(MEM_TEXTURES, far->texture, 1, GL_RGBA8, width / 2, height / 2, depth / 2, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    gpu_tex_image_3d(
+        MEM_TEXTURES,
+        far->texture,
+        FAR_CHUNK_LEVEL,
+        GL_RGBA8,
+        world->size_x,
+        world->size_y,
+        world->size_z,
+        GL_RGBA,
+        GL_UNSIGNED_BYTE,
+        chunk_level.data()
+    );
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    glGenVertexArrays(1, &far->vao);
+    return true;
+}
+
+void far_field_destroy(FarField *far) {
+    if (far->texture != 0) {
+        gpu_delete_textures(1, &far->texture);
+        glDeleteVertexArrays(1, &far->vao);
+        far->texture = 0;
+        far->vao = 0;
+    }
+    far->solid = FarVector<uint8_t>();
+    far->meshed = FarVector<uint8_t>();
+    far->marched = FarVector<uint8_t>();
+    far->dirty = FarVector<uint8_t>();
+    far->dirty_chunks = FarVector<uint32_t>();
+    far->changed_chunks = FarVector<uint32_t>();
+}
+
+static void mark_chunk(FarField *far, int cx, int cy, int cz) {
+    const World *world = far->world;
+    if (cy < 0) {
+        return;
+    }
+    uint32_t index = ((uint32_t)cx * world->size_y + cy) * world->size_z + cz;
+    if (!far->dirty[index]) {
+        far->dirty[index] = 1;
+        far->dirty_chunks.push_back(index);
+    }
+}
+
+void far_field_mark_block(FarField *far, int x, int y, int z) {
+    if (far->texture == 0 || !world_contains(far->world, x, y, z)) {
+        return;
+    }
+    mark_chunk(far, x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE);
+    // the top blocks of the chunk below look up into this one
+    if (y % CHUNK_SIZE == 0) {
+        mark_chunk(far, x / CHUNK_SIZE, y / CHUNK_SIZE - 1, z / CHUNK_SIZE);
+    }
+}
+
+void far_field_set_meshed(FarField *far, uint32_t index, bool meshed) {
+    if (far->texture == 0 || far->meshed[index] == (uint8_t)meshed) {
+        return;
+    }
+    far->meshed[index] = (uint8_t)meshed;
+    far->changed_chunks.push_back(index);
+}
+
+void far_field_update(FarField *far, GLStateCache *state) {
+    if (far->texture == 0 || (far->dirty_chunks.empty() && far->changed_chunks.empty())) {
+        return;
+    }
+    TRACE_SCOPE("far_field_update");
+
+    const World *world = far->world;
+    state_bind_texture(state, GL_TEXTURE_3D, far->texture);
+
+    uint8_t cells[FAR_CHUNK_BYTES];
+    for (uint32_t index : far->dirty_chunks) {
+        int cx, cy, cz;
+        chunk_coords(world, index, &cx, &cy, &cz);
+        far_field_build_chunk(world, far->colors, cx, cy, cz, cells);
+        glTexSubImage3D(
+            GL_TEXTURE_3D,
+            0,
+            cx * FAR_CHUNK_CELLS,
+            cy * FAR_CHUNK_CELLS,
+            cz * FAR_CHUNK_CELLS,
+            FAR_CHUNK_CELLS,
+            FAR_CHUNK_CELLS,
+            FAR_CHUNK_CELLS,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            cells
+        );
+        far->dirty[index] = 0;
+        far->solid[index] = has_solid_cells(cells);
+        far->changed_chunks.push_back(index);
+    }
+    far->dirty_chunks.clear();
+
+    for (uint32_t index : far->changed_chunks) {
+        uint8_t marched = far->solid[index] && !far->meshed[index] ? 255 : 0;
+        if (marched == far->marched[index]) {
+            continue;
+        }
+        far->marched[index] = marched;
+        if (marched) {
+            far->marched_count++;
+        } else {
+            far->marched_count--;
+        }
+
+        int cx, cy, cz;
+        chunk_coords(world, index, &cx, &cy, &cz);
+        uint8_t texel[4] = { 0, 0, 0, marched };
+        glTexSubImage3D(GL_TEXTURE_3D, FAR_CHUNK_LEVEL, cx, cy, cz, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    }
+    far->changed_chunks.clear();
+}
+
+bool far_field_visible(const FarField *far) {
+    return far->texture != 0 && far->marched_count > 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "chunk.h"
+#include "jobs.h"
+#include "render.h"
+#include "world.h"
+
+// Terrain beyond the meshed chunks, raymarched in one fullscreen pass.
+//
+// The world is reduced to cells of FAR_CELL^3 blocks in a 3D texture: the
+// average color of the cell's visible blocks and the fraction of it that
+// is solid. Mip level 2 has one texel per chunk, set for the chunks the
+// ray has to look into: not empty and without a mesh of their own. Rays
+// step over all other chunks at once, so the cost per pixel stays about
+// the same however many chunks are out there.
+
+// blocks per cell side
+#define FAR_CELL 4
+#define FAR_CHUNK_CELLS (CHUNK_SIZE / FAR_CELL)
+// bytes of one chunk's cells, RGBA with x varying fastest like GL
+#define FAR_CHUNK_BYTES (FAR_CHUNK_CELLS * FAR_CHUNK_CELLS * FAR_CHUNK_CELLS * 4)
+// mip level with one texel per chunk
+#define FAR_CHUNK_LEVEL 2
+
+template <class T>
+using FarVector = std::vector<T, TagAllocator<T, MEM_TEXTURES>>;
+
+struct FarField {
+    const World *world;
+    uint8_t colors[BLOCK_COUNT][3];
+    GLuint texture;  // 0 when there is no far field
+    GLuint vao;      // no attributes, the vertex shader makes the triangle
+
+    FarVector<uint8_t> solid;   // per chunk like World::chunks, has solid cells
+    FarVector<uint8_t> meshed;  // drawn by the chunk meshes instead
+    FarVector<uint8_t> marched; // the value in the chunk level
+    FarVector<uint8_t> dirty;   // cells have to be rebuilt
+    FarVector<uint32_t> dirty_chunks;
+    FarVector<uint32_t> changed_chunks;  // marched may differ from the texture
+    uint32_t marched_count;
+};
+
+// Average colors of the top faces of every block, from the RGBA or RGB
+// atlas pixels the coords point into (bottom row first, as loaded for GL).
+void far_field_block_colors(
+    const uint8_t *atlas,
+    int width,
+    int height,
+    int channels,
+    const BlockCoord *coords,
+    uint8_t colors[BLOCK_COUNT][3]
+);
+
+// Builds the cells of chunk (cx, cy, cz) into `cells`, FAR_CHUNK_BYTES long.
+// Blocks count as visible with air above them; a cell without any takes
+// the average of all its solid blocks.
+void far_field_build_chunk(
+    const World *world,
+    const uint8_t colors[BLOCK_COUNT][3],
+    int cx,
+    int cy,
+    int cz,
+    uint8_t *cells
+);
+
+// Builds the whole world, spread over `jobs`, and uploads it. False if the
+// world doesn't fit a 3D texture. Needs the GL context.
+bool far_field_init(FarField *far, const World *world, const uint8_t colors[BLOCK_COUNT][3], JobPool *jobs);
+void far_field_destroy(FarField *far);
+
+// The block at (x, y, z) changed, its chunk is rebuilt on the next update.
+void far_field_mark_block(FarField *far, int x, int y, int z);
+// Chunk `index` (like World::chunks) is drawn by a mesh or not anymore.
+void far_field_set_meshed(FarField *far, uint32_t index, bool meshed);
+// Rebuilds the changed chunks and uploads them.
+void far_field_update(FarField *far, GLStateCache *state);
+// Nothing to draw when every chunk is meshed or empty.
+bool far_field_visible(const FarField *far);
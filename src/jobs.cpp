@@ -0,0 +1,120 @@
+#include "jobs.h"
+#include "trace.h"
+
+static void run_batches(JobPool *pool, JobFn fn, void *ctx, uint32_t count, uint32_t batch) {
+    for (;;) {
+        uint32_t first = pool->next.fetch_add(batch, std::memory_order_relaxed);
+        if (first >= count) {
+            break;
+        }
+        uint32_t last = first + batch < count ? first + batch : count;
+        fn(ctx, first, last);
+        pool->pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+static void worker_main(JobPool *pool, int index) {
+    TRACE_THREAD_NAME("job_worker");
+    (void)index;
+
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    for (;;) {
+        pool->wake.wait(lock, [pool, seen] { return pool->quit || pool->generation != seen; });
+        if (pool->quit) {
+            break;
+        }
+        seen = pool->generation;
+        // woke up too late, the loop is already done
+        if (pool->pending.load(std::memory_order_acquire) == 0) {
+            continue;
+        }
+
+        // the loop can't be replaced while we are active
+        JobFn fn = pool->fn;
+        void *ctx = pool->ctx;
+        uint32_t count = pool->count;
+        uint32_t batch = pool->batch;
+        pool->active++;
+        lock.unlock();
+
+        run_batches(pool, fn, ctx, count, batch);
+
+        lock.lock();
+        pool->active--;
+        if (pool->active == 0 && pool->pending.load(std::memory_order_acquire) == 0) {
+            pool->finished.notify_all();
+        }
+    }
+}
+
+void jobs_init(JobPool *pool, int threads) {
+    if (threads <= 0) {
+        threads = (int)std::thread::hardware_concurrency() - 1;
+    }
+    pool->generation = 0;
+    pool->quit = false;
+    pool->fn = NULL;
+    pool->ctx = NULL;
+    pool->count = 0;
+    pool->batch = 0;
+    pool->next.store(0);
+    pool->pending.store(0);
+    pool->active = 0;
+
+    for (int i = 0; i < threads; i++) {
+        pool->workers.push_back(std::thread(worker_main, pool, i));
+    }
+}
+
+void jobs_destroy(JobPool *pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->quit = true;
+    }
+    pool->wake.notify_all();
+    for (std::thread &worker : pool->workers) {
+        worker.join();
+    }
+    pool->workers.clear();
+}
+
+void jobs_parallel_for(JobPool *pool, uint32_t count, uint32_t batch, JobFn fn, void *ctx) {
+    if (count == 0) {
+        return;
+    }
+    if (batch == 0) {
+        batch = 1;
+    }
+
+    // not worth waking anyone for a single batch
+    if (pool == NULL || pool->workers.empty() || count <= batch) {
+        for (uint32_t first = 0; first < count; first += batch) {
+            fn(ctx, first, first + batch < count ? first + batch : count);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->fn = fn;
+        pool->ctx = ctx;
+        pool->count = count;
+        pool->batch = batch;
+        pool->next.store(0, std::memory_order_relaxed);
+        pool->pending.store((count + batch - 1) / batch, std::memory_order_release);
+        pool->generation++;
+    }
+    pool->wake.notify_all();
+
+    run_batches(pool, fn, ctx, count, batch);
+
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    pool->finished.wait(lock, [pool] {
+        return pool->active == 0 && pool->pending.load(std::memory_order_acquire) == 0;
+    });
+}
+
+int jobs_thread_count(const JobPool *pool) {
+    return (int)pool->workers.size() + 1;
+}
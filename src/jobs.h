@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs [first, last) ranges of an index space, `ctx` is passed through.
+typedef void (*JobFn)(void *ctx, uint32_t first, uint32_t last);
+
+// Fixed set of worker threads for data parallel loops. The calling thread
+// works on the loop too. One loop at a time, not reentrant.
+struct JobPool {
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    uint64_t generation;  // bumped for every loop, wakes the workers
+    bool quit;
+
+    // current loop
+    JobFn fn;
+    void *ctx;
+    uint32_t count;
+    uint32_t batch;
+    std::atomic<uint32_t> next;     // first index not handed out yet
+    std::atomic<uint32_t> pending;  // batches not finished yet
+    uint32_t active;                // workers inside the loop
+};
+
+// 0 threads picks one less than the hardware threads.
+void jobs_init(JobPool *pool, int threads = 0);
+void jobs_destroy(JobPool *pool);
+// Calls `fn` on batches of at most `batch` indices until all of [0, count)
+// are done. With a NULL pool everything runs on the calling thread.
+void jobs_parallel_for(JobPool *pool, uint32_t count, uint32_t batch, JobFn fn, void *ctx);
+int jobs_thread_count(const JobPool *pool);
@@ -1,7 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <stdarg.h>
 #include <map>
+#include <vector>
 #include <iostream>
 
 #include <GL/glew.h>
@@ -13,19 +16,134 @@
 #include <glm/gtc/type_ptr.hpp>
 using namespace glm;
 
-#include <ft2build.h>
-#include FT_FREETYPE_H
+#include "memory.h"
+#include "model.h"
 
+// decoded images are charged to MEM_TEXTURES
+#define STBI_MALLOC(size) mem_malloc(MEM_TEXTURES, size)
+#define STBI_REALLOC(p, size) mem_realloc(MEM_TEXTURES, p, size)
+#define STBI_FREE(p) mem_free(MEM_TEXTURES, p)
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include "shader.h"
+#include "chunk.h"
+#include "entity.h"
+#include "farfield.h"
+#include "jobs.h"
+#include "particle.h"
+#include "tick.h"
+#include "world.h"
+#include "capture.h"
+#include "render.h"
+#include "replay.h"
+#include "terrain.h"
+#include "text.h"
+#include "trace.h"
+#include "resolution.h"
 
 #define WINDOW_WIDTH 1920
 #define WINDOW_HEIGHT 1080
 
+// default frame time the scene resolution is scaled to hold
+#define FRAME_TIME_TARGET_MS 16.6f
+
+#define TRACE_DEFAULT_PATH "shahter_trace.json"
+#define TRACE_DEFAULT_SECONDS 10.0
+
+#define MEMORY_REPORT_PATH "shahter_memory.csv"
+#define MB (1024ll * 1024ll)
+
+// entities and particles are simulated at a fixed rate, a slow frame runs
+// at most SIM_MAX_STEPS and drops the rest
+#define SIM_STEP (1.0 / 60.0)
+#define SIM_MAX_STEPS 4
+// chunk space to world space, see block_model
+#define CHUNK_SCALE 0.5f
+// N adds this many entities to the population
+#define ENTITY_SPAWN_COUNT 1000
+// spawns per frame when topping the population up
+#define ENTITY_SPAWN_MAX 2000
+#define GAME_SEED 0x3779b97fu
+
+#define PARTICLE_CAPACITY 131072
+#define PARTICLE_SEED 0x2545f491u
+// debris pieces per broken block
+#define PARTICLE_BURST 64
+// the collision window is moved back over the camera once it gets this far
+// off the middle
+#define PARTICLE_RECENTER 4
+// weather falls this far around the camera, what is left of the window
+// after recentring and some room for drifting sideways
+#define WEATHER_DRIFT 4
+#define WEATHER_RADIUS (PARTICLE_WINDOW / 2 - PARTICLE_RECENTER - WEATHER_DRIFT)
+
+#define TICK_SEED 0x6a09e667u
+// G drops sand this high over the ground, within this many blocks of the
+// camera with --world
+#define SAND_DROP_HEIGHT 8
+#define SAND_DROP_RADIUS 4
+
+// far plane, pushed out when the far field draws what's beyond the meshes
+#define VIEW_DISTANCE 100.0f
+#define FAR_VIEW_DISTANCE 1000.0f
+// game ticks run in a frame at most, the rest is dropped like SIM_MAX_STEPS
+#define TICK_MAX_STEPS 4
+
+// scratch for per-frame HUD strings
+#define HUD_ARENA_SIZE 4096
+
+const char *trace_path = TRACE_DEFAULT_PATH;
+double trace_seconds = TRACE_DEFAULT_SECONDS;
+
+int window_width = WINDOW_WIDTH;
+int window_height = WINDOW_HEIGHT;
+bool window_resized = false;
+
+bool show_memory = false;
+
+// entities kept alive, the ones falling out of the world respawn
+uint32_t entity_target = 0;
+uint32_t game_rng = GAME_SEED;
+
+enum WeatherKind {
+    WEATHER_CLEAR = 0,
+    WEATHER_RAIN,
+    WEATHER_SNOW,
+
+    WEATHER_COUNT
+};
+
+int weather_kind = WEATHER_CLEAR;
+// B breaks blocks for show, the frame loop emits the debris
+int block_bursts = 0;
+// G drops sand over the dirt patch, or the ground around the camera with
+// --world
+int sand_drops = 0;
+
+ModelLoader model_loader;
+
+// F12 saves the next frame, F9 records until pressed again, --capture
+// records from the start
+Capture capture;
+bool capture_started = false;
+const char *capture_directory = "captures";
+CaptureFormat capture_format = CAPTURE_PNG;
+int capture_every = 1;
+bool capture_recording = false;
+bool capture_screenshot = false;
+
+InputRecorder input_recorder = {};
+bool replaying = false;
+
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-    glViewport(0, 0, width, height);
+    // minimized, keep the old size around
+    if (width == 0 || height == 0) {
+        return;
+    }
+    window_width = width;
+    window_height = height;
+    window_resized = true;
 }
 
 vec3 camera_pos(0.0f, 0.0f, 3.0f);
@@ -57,39 +175,73 @@ Fov fov = {
 
 bool mouse_first = true;
 
-void process_input(GLFWwindow *window) {
-    if (
-        glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS
-        || glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS
-    ) {
+// keys polled every frame, a frame's key state is a bit mask over these
+enum InputKey {
+    KEY_QUIT = 0,
+    KEY_QUIT_ALT,
+    KEY_SPRINT,
+    KEY_FORWARD,
+    KEY_BACK,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_UP,
+    KEY_DOWN,
+
+    KEY_COUNT
+};
+
+static const int INPUT_KEYS[KEY_COUNT] = {
+    GLFW_KEY_ESCAPE,
+    GLFW_KEY_Q,
+    GLFW_KEY_LEFT_SHIFT,
+    GLFW_KEY_W,
+    GLFW_KEY_S,
+    GLFW_KEY_A,
+    GLFW_KEY_D,
+    GLFW_KEY_SPACE,
+    GLFW_KEY_LEFT_CONTROL,
+};
+
+uint32_t poll_keys(GLFWwindow *window) {
+    uint32_t keys = 0;
+    for (int i = 0; i < KEY_COUNT; i++) {
+        if (glfwGetKey(window, INPUT_KEYS[i]) == GLFW_PRESS) {
+            keys |= 1u << i;
+        }
+    }
+    return keys;
+}
+
+void process_input(GLFWwindow *window, uint32_t keys) {
+    if (keys & ((1u << KEY_QUIT) | (1u << KEY_QUIT_ALT))) {
         glfwSetWindowShouldClose(window, true);
     }
 
     float camera_speed = 3.0f * (float)delta_time;
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
+    if (keys & (1u << KEY_SPRINT)) {
         camera_speed *= 2.0f;
     }
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+    if (keys & (1u << KEY_FORWARD)) {
         camera_pos += camera_speed * camera_front;
     }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+    if (keys & (1u << KEY_BACK)) {
         camera_pos -= camera_speed * camera_front;
     }
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
+    if (keys & (1u << KEY_LEFT)) {
         camera_pos -= normalize(cross(camera_front, camera_up)) * camera_speed;
     }
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
+    if (keys & (1u << KEY_RIGHT)) {
         camera_pos += normalize(cross(camera_front, camera_up)) * camera_speed;
     }
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
+    if (keys & (1u << KEY_UP)) {
         camera_pos += camera_speed * camera_up;
     }
-    if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS) {
+    if (keys & (1u << KEY_DOWN)) {
         camera_pos -= camera_speed * camera_up;
     }
 }
 
-void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+void handle_mouse_button(int button, int action)
 {
     if (button == GLFW_MOUSE_BUTTON_MIDDLE && action == GLFW_PRESS) {
         if (!fov.is_close) {
@@ -111,7 +263,7 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 }
 
 bool debug_mode = false;
-void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+void handle_key(int key, int action) {
     if (key == GLFW_KEY_F && action == GLFW_PRESS)
     {
         if (debug_mode) {
@@ -121,9 +273,114 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         }
         debug_mode = !debug_mode;
     }
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        trace_dump_async(trace_path, trace_seconds);
+    }
+    if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        show_memory = !show_memory;
+    }
+    if (key == GLFW_KEY_E && action == GLFW_PRESS) {
+        mem_export(MEMORY_REPORT_PATH);
+    }
+    if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+        entity_target += ENTITY_SPAWN_COUNT;
+    }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        weather_kind = (weather_kind + 1) % WEATHER_COUNT;
+    }
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        block_bursts++;
+    }
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        sand_drops++;
+    }
+    if (key == GLFW_KEY_F12 && action == GLFW_PRESS) {
+        capture_screenshot = true;
+    }
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS) {
+        capture_recording = !capture_recording;
+    }
 }
 
-void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
+// The atlas tile with its top left pixel at (x, y) on every face.
+static BlockCoord block_coords_tile(float x, float y, int atlas_width, int atlas_height) {
+    float x1 = x / atlas_width;
+    float y1 = 1.0f - (y / atlas_height);
+    float x2 = (x + 16.0f) / atlas_width;
+    float y2 = 1.0f - ((y + 16.0f) / atlas_height);
+    return {
+        x1, y1, x2, y2,
+        x1, y1, x2, y2,
+        x1, y1, x2, y2,
+        x1, y1, x2, y2,
+        x1, y1, x2, y2,
+        x1, y1, x2, y2,
+    };
+}
+
+static float game_random(float lo, float hi) {
+    // xorshift32, seeded so replays spawn the same things
+    uint32_t x = game_rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    game_rng = x;
+    return lo + (hi - lo) * (float)(x >> 8) / (float)(1u << 24);
+}
+
+// Drops small blocks over the chunk with a little sideways push.
+static void spawn_entities(EntityWorld *world, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        float half = game_random(0.1f, 0.3f);
+        vec3 position(game_random(-2.0f, 4.0f), game_random(4.0f, 16.0f), game_random(-2.0f, 2.0f));
+        EntityId id = entity_create(world, position, vec3(half), ENTITY_MESH_BLOCK);
+        if (id == ENTITY_NONE) {
+            return;
+        }
+        int64_t index = entity_index(world, id);
+        world->vel_x[index] = game_random(-1.5f, 1.5f);
+        world->vel_z[index] = game_random(-1.5f, 1.5f);
+    }
+}
+
+// Block the camera is in, blocks are centered on whole chunk space
+// coordinates.
+static ivec3 camera_block() {
+    return ivec3(glm::floor(camera_pos / CHUNK_SCALE + 0.5f));
+}
+
+// Collision window of the particles with the camera in the middle.
+static ivec3 particle_window() {
+    return camera_block() - PARTICLE_WINDOW / 2;
+}
+
+// Highest free block over the ground of column (x, z), at most `height`
+// above it. -1 when the column is full up to the top of the world.
+static int drop_height(const World *world, int x, int z, int height) {
+    int top = world->size_y * CHUNK_SIZE - 1;
+    int y = top;
+    while (y >= 0 && world_get_block(world, x, y, z) == BLOCK_AIR) {
+        y--;
+    }
+    if (y == top) {
+        return -1;
+    }
+    return y + 1 + height < top ? y + 1 + height : top;
+}
+
+static const char *hud_printf(Arena *arena, const char *fmt, ...) {
+    char *text = (char *)arena_alloc(arena, 64, 1);
+    if (text == NULL) {
+        return "";
+    }
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(text, 64, fmt, args);
+    va_end(args);
+    return text;
+}
+
+void handle_cursor(double xpos, double ypos) {
     if (mouse_first) {
         last_x = xpos;
         last_y = ypos;
@@ -155,7 +412,7 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
     camera_front = normalize(direction);
 }
 
-void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
+void handle_scroll(double yoffset) {
     fov.normal -= (float)yoffset;
     if (fov.normal < 1.0f) {
         fov.normal = 1.0f;
@@ -165,196 +422,156 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     }
 }
 
-void drop_callback(GLFWwindow *window, int count, const char **paths) {
-    printf("Drop event\n");
-    for (int i = 0; i < count; i++) {
-        printf("path %d: %s\n", i, paths[i]);
+void handle_event(const InputEvent &event) {
+    switch (event.type) {
+    case INPUT_CURSOR:
+        handle_cursor(event.x, event.y);
+        break;
+    case INPUT_SCROLL:
+        handle_scroll(event.y);
+        break;
+    case INPUT_MOUSE_BUTTON:
+        handle_mouse_button(event.key, event.action);
+        break;
+    case INPUT_KEY:
+        handle_key(event.key, event.action);
+        break;
+    default:
+        break;
     }
 }
 
-struct Character {
-    unsigned int TextureID;  // ID handle of the glyph texture
-    glm::ivec2   Size;       // Size of glyph
-    glm::ivec2   Bearing;    // Offset from baseline to left/top of glyph
-    unsigned int Advance;    // Offset to advance to next glyph
-};
+// Live GLFW input is recorded (when recording) and handled, unless a
+// replay is driving the game instead.
+void live_event(const InputEvent &event) {
+    if (replaying) {
+        return;
+    }
+    input_record_event(&input_recorder, event);
+    handle_event(event);
+}
 
-std::map<char, Character> Characters;
+void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
+    live_event({ .type = INPUT_CURSOR, .x = xpos, .y = ypos });
+}
 
-void render_text(Shader &s, GLuint vao, GLuint vbo, std::string text, float x, float y, float scale, glm::vec3 color)
-{
-    // activate corresponding render state
-    s.use();
-    s.setVec3("textColor", color.x, color.y, color.z);
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(vao);
+void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
+    live_event({ .type = INPUT_SCROLL, .x = xoffset, .y = yoffset });
+}
 
-    // iterate through all characters
-    std::string::const_iterator c;
-    for (c = text.begin(); c != text.end(); c++)
-    {
-        Character ch = Characters[*c];
-
-        float xpos = x + ch.Bearing.x * scale;
-        float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
-
-        float w = ch.Size.x * scale;
-        float h = ch.Size.y * scale;
-        // update VBO for each character
-        float vertices[6][4] = {
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos,     ypos,       0.0f, 1.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-            { xpos + w, ypos + h,   1.0f, 0.0f }
-        };
-        // render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-        // update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        // render quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        // now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-        x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64)
-    }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
+    live_event({ .type = INPUT_MOUSE_BUTTON, .key = button, .action = action, .mods = mods });
 }
 
-struct BlockCoord {
-    float front_x1;
-    float front_y1;
-    float front_x2;
-    float front_y2;
-
-    float back_x1;
-    float back_y1;
-    float back_x2;
-    float back_y2;
-
-    float top_x1;
-    float top_y1;
-    float top_x2;
-    float top_y2;
-
-    float bottom_x1;
-    float bottom_y1;
-    float bottom_x2;
-    float bottom_y2;
-
-    float left_x1;
-    float left_y1;
-    float left_x2;
-    float left_y2;
-
-    float right_x1;
-    float right_y1;
-    float right_x2;
-    float right_y2;
-};
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    live_event({ .type = INPUT_KEY, .key = key, .action = action, .mods = mods });
+}
 
-inline void set_texture_coords(
-    float *vertices,
-    BlockCoord c
-) {
-    vertices[0 * 5 + 3] = c.back_x2;
-    vertices[0 * 5 + 4] = c.back_y2;
-    vertices[1 * 5 + 3] = c.back_x1;
-    vertices[1 * 5 + 4] = c.back_y2;
-    vertices[2 * 5 + 3] = c.back_x1;
-    vertices[2 * 5 + 4] = c.back_y1;
-    vertices[3 * 5 + 3] = c.back_x1;
-    vertices[3 * 5 + 4] = c.back_y1;
-    vertices[4 * 5 + 3] = c.back_x2;
-    vertices[4 * 5 + 4] = c.back_y1;
-    vertices[5 * 5 + 3] = c.back_x2;
-    vertices[5 * 5 + 4] = c.back_y2;
-
-    vertices[6 * 5 + 3] = c.front_x1;
-    vertices[6 * 5 + 4] = c.front_y2;
-    vertices[7 * 5 + 3] = c.front_x2;
-    vertices[7 * 5 + 4] = c.front_y2;
-    vertices[8 * 5 + 3] = c.front_x2;
-    vertices[8 * 5 + 4] = c.front_y1;
-    vertices[9 * 5 + 3] = c.front_x2;
-    vertices[9 * 5 + 4] = c.front_y1;
-    vertices[10 * 5 + 3] = c.front_x1;
-    vertices[10 * 5 + 4] = c.front_y1;
-    vertices[11 * 5 + 3] = c.front_x1;
-    vertices[11 * 5 + 4] = c.front_y2;
-
-    vertices[12 * 5 + 3] = c.left_x2;
-    vertices[12 * 5 + 4] = c.left_y1;
-    vertices[13 * 5 + 3] = c.left_x1;
-    vertices[13 * 5 + 4] = c.left_y1;
-    vertices[14 * 5 + 3] = c.left_x1;
-    vertices[14 * 5 + 4] = c.left_y2;
-    vertices[15 * 5 + 3] = c.left_x1;
-    vertices[15 * 5 + 4] = c.left_y2;
-    vertices[16 * 5 + 3] = c.left_x2;
-    vertices[16 * 5 + 4] = c.left_y2;
-    vertices[17 * 5 + 3] = c.left_x2;
-    vertices[17 * 5 + 4] = c.left_y1;
-
-    vertices[18 * 5 + 3] = c.right_x1;
-    vertices[18 * 5 + 4] = c.right_y1;
-    vertices[19 * 5 + 3] = c.right_x2;
-    vertices[19 * 5 + 4] = c.right_y1;
-    vertices[20 * 5 + 3] = c.right_x2;
-    vertices[20 * 5 + 4] = c.right_y2;
-    vertices[21 * 5 + 3] = c.right_x2;
-    vertices[21 * 5 + 4] = c.right_y2;
-    vertices[22 * 5 + 3] = c.right_x1;
-    vertices[22 * 5 + 4] = c.right_y2;
-    vertices[23 * 5 + 3] = c.right_x1;
-    vertices[23 * 5 + 4] = c.right_y1;
-
-    vertices[24 * 5 + 3] = c.bottom_x1;
-    vertices[24 * 5 + 4] = c.bottom_y2;
-    vertices[25 * 5 + 3] = c.bottom_x2;
-    vertices[25 * 5 + 4] = c.bottom_y2;
-    vertices[26 * 5 + 3] = c.bottom_x2;
-    vertices[26 * 5 + 4] = c.bottom_y1;
-    vertices[27 * 5 + 3] = c.bottom_x2;
-    vertices[27 * 5 + 4] = c.bottom_y1;
-    vertices[28 * 5 + 3] = c.bottom_x1;
-    vertices[28 * 5 + 4] = c.bottom_y1;
-    vertices[29 * 5 + 3] = c.bottom_x1;
-    vertices[29 * 5 + 4] = c.bottom_y2;
-
-    vertices[30 * 5 + 3] = c.top_x1;
-    vertices[30 * 5 + 4] = c.top_y1;
-    vertices[31 * 5 + 3] = c.top_x2;
-    vertices[31 * 5 + 4] = c.top_y1;
-    vertices[32 * 5 + 3] = c.top_x2;
-    vertices[32 * 5 + 4] = c.top_y2;
-    vertices[33 * 5 + 3] = c.top_x2;
-    vertices[33 * 5 + 4] = c.top_y2;
-    vertices[34 * 5 + 3] = c.top_x1;
-    vertices[34 * 5 + 4] = c.top_y2;
-    vertices[35 * 5 + 3] = c.top_x1;
-    vertices[35 * 5 + 4] = c.top_y1;
+void drop_callback(GLFWwindow *window, int count, const char **paths) {
+    for (int i = 0; i < count; i++) {
+        printf("Importing %s\n", paths[i]);
+        model_loader_request(&model_loader, paths[i]);
+    }
 }
 
-int main() {
-    FT_Library ft;
-    if (FT_Init_FreeType(&ft)) {
-        fprintf(stderr, "ERROR::FREETYPE: Could not init FreeType Library\n");
+int main(int argc, char **argv) {
+    TRACE_THREAD_NAME("main");
+
+    float frame_target_ms = FRAME_TIME_TARGET_MS;
+    bool trace_on_exit = false;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *frame_log_path = NULL;
+    bool headless = false;
+    double fixed_step_ms = 0.0;
+    // one chunk with a few hand placed blocks unless --world asks for terrain
+    int world_x = 1;
+    int world_y = 1;
+    int world_z = 1;
+    bool world_terrain = false;
+    std::vector<const char *> model_paths;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frame-target") == 0 && i + 1 < argc) {
+            frame_target_ms = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            // also dump on exit, so startup ends up in the trace
+            trace_path = argv[++i];
+            trace_on_exit = true;
+        } else if (strcmp(argv[i], "--trace-seconds") == 0 && i + 1 < argc) {
+            trace_seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--frame-log") == 0 && i + 1 < argc) {
+            frame_log_path = argv[++i];
+        } else if (strcmp(argv[i], "--fixed-step") == 0 && i + 1 < argc) {
+            fixed_step_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--entities") == 0 && i + 1 < argc) {
+            entity_target = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--weather") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "rain") == 0) {
+                weather_kind = WEATHER_RAIN;
+            } else if (strcmp(argv[i], "snow") == 0) {
+                weather_kind = WEATHER_SNOW;
+            }
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            model_paths.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--world") == 0 && i + 3 < argc) {
+            world_x = atoi(argv[++i]);
+            world_y = atoi(argv[++i]);
+            world_z = atoi(argv[++i]);
+            world_terrain = true;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_directory = argv[++i];
+            capture_recording = true;
+        } else if (strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "raw") == 0) {
+                capture_format = CAPTURE_RAW;
+            } else if (strcmp(argv[i], "png") == 0) {
+                capture_format = CAPTURE_PNG;
+            }
+        } else if (strcmp(argv[i], "--capture-every") == 0 && i + 1 < argc) {
+            capture_every = atoi(argv[++i]);
+        }
+    }
+    if (world_x < 1 || world_y < 1 || world_z < 1) {
+        fprintf(stderr, "Invalid world size %dx%dx%d\n", world_x, world_y, world_z);
         return -1;
     }
+    if (capture_every < 1) {
+        fprintf(stderr, "Invalid capture interval, capturing every frame\n");
+        capture_every = 1;
+    }
+    if (frame_target_ms <= 0.0f) {
+        fprintf(stderr, "Invalid frame target, using %.1f ms\n", FRAME_TIME_TARGET_MS);
+        frame_target_ms = FRAME_TIME_TARGET_MS;
+    }
 
-    FT_Face face;
-    if (FT_New_Face(ft, "./resources/FiraCode-Regular.ttf", 0, &face))
-    {
-        fprintf(stderr, "ERROR::FREETYPE: Failed to load font\n");
+    InputReplay replay;
+    FrameLog frame_log;
+    if (replay_path) {
+        if (!input_replay_open(&replay, replay_path) || !frame_log_open(&frame_log, frame_log_path)) {
+            return -1;
+        }
+        replaying = true;
+    } else if (headless) {
+        fprintf(stderr, "--headless only works with --replay\n");
         return -1;
     }
 
-    FT_Set_Pixel_Sizes(face, 0, 36);
+    mem_set_budget(MEM_WORLD, 256 * MB);
+    mem_set_budget(MEM_MESHES, 256 * MB);
+    mem_set_budget(MEM_TEXTURES, 512 * MB);
+    mem_set_budget(MEM_TEXT, 16 * MB);
+    mem_set_budget(MEM_SHADERS, 4 * MB);
+    mem_set_budget(MEM_RENDER, 256 * MB);
+    mem_set_budget(MEM_MODELS, 512 * MB);
+    mem_set_budget(MEM_PARTICLES, 64 * MB);
 
     glewExperimental = true;
     glfwInit();
@@ -364,6 +581,9 @@ int main() {
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     glfwWindowHint(GLFW_FLOATING, GL_TRUE);
+    if (headless) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
 
     glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
 
@@ -375,7 +595,10 @@ int main() {
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Shahter", NULL, NULL);
+    // a replay gets the framebuffer size it was recorded at
+    int create_width = replaying ? replay.width : WINDOW_WIDTH;
+    int create_height = replaying ? replay.height : WINDOW_HEIGHT;
+    GLFWwindow *window = glfwCreateWindow(create_width, create_height, "Shahter", NULL, NULL);
     if (window == NULL) {
         fprintf(stderr, "Failed to create GLFW window\n");
         glfwTerminate();
@@ -383,6 +606,10 @@ int main() {
     }
 
     glfwMakeContextCurrent(window);
+    if (replaying) {
+        // measure frames, not the display refresh rate
+        glfwSwapInterval(0);
+    }
 
     glewExperimental = true;
     if (glewInit() != GLEW_OK) {
@@ -392,9 +619,7 @@ int main() {
 
     glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
 
-    glEnable(GL_DEPTH_TEST);
-
-    glEnable(GL_BLEND);
+    // depth test and blending are toggled per pass by the render queue
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
@@ -424,11 +649,26 @@ int main() {
         "./shaders/skybox.frag"
     );
 
+    Shader entity_shader = compile_shader(
+        "./shaders/entity.vert",
+        "./shaders/block.frag"
+    );
+
+    Shader particle_shader = compile_shader(
+        "./shaders/particle.vert",
+        "./shaders/particle.frag"
+    );
+
     Shader font_shader = compile_shader(
         "./shaders/font.vert",
         "./shaders/font.frag"
     );
 
+    Shader far_shader = compile_shader(
+        "./shaders/farfield.vert",
+        "./shaders/farfield.frag"
+    );
+
     float cube_vertices[] = {
         -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
@@ -480,7 +720,7 @@ int main() {
     glBindVertexArray(cube_vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, cube_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+    gpu_buffer_data(MEM_RENDER, cube_vbo, GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
     glEnableVertexAttribArray(0);
@@ -549,7 +789,7 @@ int main() {
     glBindVertexArray(skybox_vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, skybox_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skybox_vertices), skybox_vertices, GL_STATIC_DRAW);
+    gpu_buffer_data(MEM_RENDER, skybox_vbo, GL_ARRAY_BUFFER, sizeof(skybox_vertices), skybox_vertices, GL_STATIC_DRAW);
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
     glEnableVertexAttribArray(0);
@@ -560,15 +800,17 @@ int main() {
 
     int i_width, i_height, i_nr_channels;
     for (int i = 0; i < 6; i++) {
+        TRACE_SCOPE("load_skybox_face");
         unsigned char *data = stbi_load(cubemap_faces[i], &i_width, &i_height, &i_nr_channels, 0);
         if (data) {
-            glTexImage2D(
+            gpu_tex_image_2d(
+                MEM_TEXTURES,
+                cubemap_texture_id,
                 GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
                 0,
                 GL_RGB,
                 i_width,
                 i_height,
-                0,
                 GL_RGB,
                 GL_UNSIGNED_BYTE,
                 data
@@ -586,49 +828,6 @@ int main() {
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     }
 
-    float block_vertices[] = {
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f,  0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f,  0.5f, -0.5f, 0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f, 0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-
-        -0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
-        0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
-        0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
-        0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
-
-        -0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f, 0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
-
-        0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
-        0.5f,  0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
-        0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
-
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
-        0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-
-        -0.5f,  0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f,  0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
-        0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f, 0.0f, 0.0f,
-    };
     GLuint minecraft_atlas_id;
     glGenTextures(1, &minecraft_atlas_id);
     glBindTexture(GL_TEXTURE_2D, minecraft_atlas_id);
@@ -639,22 +838,30 @@ int main() {
 
     int atlas_w, atlas_h, nr_channels;
     stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load("resources/minecraft1.17.png", &atlas_w, &atlas_h, &nr_channels, 0);
+    unsigned char *data;
+    {
+        TRACE_SCOPE("load_atlas");
+        data = stbi_load("resources/minecraft1.17.png", &atlas_w, &atlas_h, &nr_channels, 0);
+    }
     if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlas_w, atlas_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        gpu_tex_image_2d(MEM_TEXTURES, minecraft_atlas_id, GL_TEXTURE_2D, 0, GL_RGBA, atlas_w, atlas_h, GL_RGBA, GL_UNSIGNED_BYTE, data);
         // glGenerateMipmap(GL_TEXTURE_2D);
     } else {
         fprintf(stderr, "Failed to load minecraft1.17.png\n");
         exit(1);
     }
-    stbi_image_free(data);
     block_shader.use();
     block_shader.setInt("texture1", 0);
+    entity_shader.use();
+    entity_shader.setInt("texture1", 0);
+    particle_shader.use();
+    particle_shader.setInt("texture1", 0);
 
     int w = atlas_w;
     int h = atlas_h;
 
-    BlockCoord coord = {
+    BlockCoord block_coords[BLOCK_COUNT] = {};
+    block_coords[BLOCK_FURNACE] = {
         .front_x1 = 384.0f / w,
         .front_y1 = 1.0f - (48.0f / h),
         .front_x2 = 400.0f / w,
@@ -685,158 +892,669 @@ int main() {
         .right_x2 = 400.0f / w,
         .right_y2 = 1.0f - (96.0f / h),
     };
-    set_texture_coords(block_vertices, coord);
-
-    GLuint block_vao, block_vbo;
-    glGenVertexArrays(1, &block_vao);
-    glGenBuffers(1, &block_vbo);
 
-    glBindVertexArray(block_vao);
+    block_coords[BLOCK_SAND] = block_coords_tile(128.0f, 352.0f, w, h);
+    block_coords[BLOCK_DIRT] = block_coords_tile(80.0f, 176.0f, w, h);
+    block_coords[BLOCK_GRASS] = block_coords_tile(192.0f, 48.0f, w, h);
+    // the atlas has no water with alpha, a blue stained glass stands in
+    block_coords[BLOCK_WATER] = block_coords_tile(384.0f, 0.0f, w, h);
+    block_coords[BLOCK_GLASS] = block_coords_tile(480.0f, 0.0f, w, h);
 
-    glBindBuffer(GL_ARRAY_BUFFER, block_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(block_vertices), block_vertices, GL_STATIC_DRAW);
+    // what the far field paints its cells with
+    uint8_t block_colors[BLOCK_COUNT][3];
+    far_field_block_colors(data, atlas_w, atlas_h, nr_channels, block_coords, block_colors);
+    stbi_image_free(data);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
+    World world;
+    if (!world_init(&world, world_x, world_y, world_z)) {
+        return -1;
+    }
+    Chunk *chunk = world_chunk(&world, 0, 0, 0);
+    if (world_terrain) {
+        world_generate(&world);
+        // lakes in the valleys
+        world_flood(&world, world_y * CHUNK_SIZE / 4 - 2);
+        // start over the middle, a bit above the ground
+        int x = world_x * CHUNK_SIZE / 2;
+        int z = world_z * CHUNK_SIZE / 2;
+        int y = world_y * CHUNK_SIZE - 1;
+        while (y > 0 && world_get_block(&world, x, y, z) == BLOCK_AIR) {
+            y--;
+        }
+        camera_pos = vec3(x, y + 8, z) * CHUNK_SCALE;
+    } else {
+        chunk_set_block(chunk, 0, 0, 0, BLOCK_FURNACE);
+        chunk_set_block(chunk, 1, 0, 0, BLOCK_FURNACE);
+        chunk_set_block(chunk, 1, 1, 0, BLOCK_FURNACE);
+        // dirt patch the grass in its corner spreads over
+        for (int x = 4; x < 12; x++) {
+            for (int z = 4; z < 12; z++) {
+                chunk_set_block(chunk, x, 0, z, BLOCK_DIRT);
+            }
+        }
+        chunk_set_block(chunk, 4, 0, 4, BLOCK_GRASS);
+        // a pond and a glass pillar to look through
+        for (int x = 12; x < 15; x++) {
+            for (int z = 1; z < 4; z++) {
+                chunk_set_block(chunk, x, 0, z, BLOCK_WATER);
+            }
+        }
+        for (int y = 0; y < 3; y++) {
+            chunk_set_block(chunk, 2, y, 12, BLOCK_GLASS);
+        }
+    }
 
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    TickEngine ticks;
+    tick_init(&ticks, &world, TICK_SEED);
+    double tick_accumulator = 0.0;
+
+    // meshes around the camera, built in the frame loop
+    TerrainMeshes terrain;
+    terrain_init(&terrain, &world, block_coords, CHUNK_SCALE);
+
+    // rain and snow sample a water and a snow tile of the atlas
+    Weather weathers[WEATHER_COUNT] = {};
+    weathers[WEATHER_RAIN] = {
+        .rate = 40000.0f,
+        .radius = WEATHER_RADIUS,
+        .height = 24.0f,
+        .fall_speed = 20.0f,
+        .drift = 0.2f,
+        .life = 3.0f,
+        .rest = 0.0f,
+        .size = 0.08f,
+        .uv = vec4(464.0f / w, 1.0f - (208.0f / h), 480.0f / w, 1.0f - (224.0f / h)),
+    };
+    weathers[WEATHER_SNOW] = {
+        .rate = 8000.0f,
+        .radius = WEATHER_RADIUS,
+        .height = 20.0f,
+        .fall_speed = 2.0f,
+        .drift = 0.6f,
+        .life = 14.0f,
+        .rest = 3.0f,
+        .size = 0.12f,
+        .uv = vec4(480.0f / w, 1.0f - (240.0f / h), 496.0f / w, 1.0f - (256.0f / h)),
+    };
+    const BlockCoord &furnace = block_coords[BLOCK_FURNACE];
+    vec4 debris_uv(furnace.front_x1, furnace.front_y1, furnace.front_x2, furnace.front_y2);
+
+    // entity meshes, the instance buffer feeds attributes 3 and 4
+    GLuint entity_vaos[ENTITY_MESH_COUNT];
+    GLuint entity_vbos[ENTITY_MESH_COUNT];
+    GLsizei entity_vertex_counts[ENTITY_MESH_COUNT];
+    InstanceBuffer entity_instances[ENTITY_MESH_COUNT] = {};
+    glGenVertexArrays(ENTITY_MESH_COUNT, entity_vaos);
+    glGenBuffers(ENTITY_MESH_COUNT, entity_vbos);
+    for (int m = 0; m < ENTITY_MESH_COUNT; m++) {
+        // a lone block meshes to a unit cube around the origin
+        Chunk *single = chunk_create();
+        if (single == NULL) {
+            fprintf(stderr, "Failed to allocate chunk\n");
+            return -1;
+        }
+        chunk_set_block(single, 0, 0, 0, BLOCK_FURNACE);
+        MeshVertices cube;
+        mesh_chunk(single, block_coords, cube);
+        chunk_destroy(single);
+        entity_vertex_counts[m] = (GLsizei)(cube.size() / CHUNK_VERTEX_SIZE);
+
+        glBindVertexArray(entity_vaos[m]);
+        glBindBuffer(GL_ARRAY_BUFFER, entity_vbos[m]);
+        gpu_buffer_data(MEM_MESHES, entity_vbos[m], GL_ARRAY_BUFFER, cube.size() * sizeof(float), cube.data(), GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, CHUNK_VERTEX_SIZE * sizeof(float), (void *)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, CHUNK_VERTEX_SIZE * sizeof(float), (void *)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, CHUNK_VERTEX_SIZE * sizeof(float), (void *)(5 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        instance_buffer_upload(&entity_instances[m], MEM_RENDER, NULL, 0);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, ENTITY_INSTANCE_SIZE * sizeof(float), (void *)0);
+        glEnableVertexAttribArray(3);
+        glVertexAttribDivisor(3, 1);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, ENTITY_INSTANCE_SIZE * sizeof(float), (void *)(3 * sizeof(float)));
+        glEnableVertexAttribArray(4);
+        glVertexAttribDivisor(4, 1);
+    }
+    glBindVertexArray(0);
 
     stbi_set_flip_vertically_on_load(false);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // disable byte-alignment restriction
-    for (unsigned char c = 0; c < 128; c++)
-    {
-        // load character glyph
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER))
-        {
-            fprintf(stderr, "ERROR::FREETYPE: Failed to load Glyph");
-            continue;
-        }
-        // generate texture
-        unsigned int texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RED,
-            face->glyph->bitmap.width,
-            face->glyph->bitmap.rows,
-            0,
-            GL_RED,
-            GL_UNSIGNED_BYTE,
-            face->glyph->bitmap.buffer
-        );
-        // set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // now store character for later use
-        Character character = {
-            texture,
-            glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-            glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-            static_cast<unsigned int>(face->glyph->advance.x)
-        };
-        Characters.insert(std::pair<char, Character>(c, character));
-    }
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
 
-    glm::mat4 text_projection = glm::ortho(0.0f, (float)WINDOW_WIDTH, 0.0f, (float)WINDOW_HEIGHT);
+    // glyphs are rasterized as they are first drawn
+    GlyphCache glyph_cache;
+    if (!glyph_cache_init(&glyph_cache)) {
+        return -1;
+    }
+    if (glyph_cache_add_font(&glyph_cache, "./resources/FiraCode-Regular.ttf") < 0) {
+        return -1;
+    }
+    glyph_cache_init_gl(&glyph_cache);
 
-    unsigned int text_vao, text_vbo;
-    glGenVertexArrays(1, &text_vao);
-    glGenBuffers(1, &text_vbo);
-    glBindVertexArray(text_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, text_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+    glfwGetFramebufferSize(window, &window_width, &window_height);
+    if (record_path && !input_record_open(&input_recorder, record_path, window_width, window_height)) {
+        return -1;
+    }
+    glm::mat4 text_projection = glm::ortho(0.0f, (float)window_width, 0.0f, (float)window_height);
+
+    TextBatch text_batch = {};
+    text_batch.program = font_shader.ID;
+    text_batch.glyphs = &glyph_cache;
+    glGenVertexArrays(1, &text_batch.vao);
+    glGenBuffers(1, &text_batch.vbo);
+    glBindVertexArray(text_batch.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, text_batch.vbo);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, TEXT_VERTEX_SIZE * sizeof(float), 0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, TEXT_VERTEX_SIZE * sizeof(float), (void *)(4 * sizeof(float)));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
-    double last_frame_time = glfwGetTime();
+    font_shader.use();
+    font_shader.setMat4("projection", text_projection);
+
+    GLint block_model_location = glGetUniformLocation(block_shader.ID, "model");
+    GLint entity_model_location = glGetUniformLocation(entity_shader.ID, "model");
+    GLint particle_model_location = glGetUniformLocation(particle_shader.ID, "model");
+
+    glActiveTexture(GL_TEXTURE0);
+
+    SceneTarget scene_target = {};
+    if (!scene_target_resize(&scene_target, window_width, window_height)) {
+        fprintf(stderr, "Failed to create scene framebuffer\n");
+        return -1;
+    }
+
+    DynamicResolution dynres;
+    dynres_init(&dynres, frame_target_ms);
+
+    // imports run on their own thread, the frame loop only uploads results
+    std::vector<Model> models;
+    model_loader_start(&model_loader);
+    for (const char *path : model_paths) {
+        model_loader_request(&model_loader, path);
+    }
+
+    // workers for the entity systems
+    JobPool jobs;
+    jobs_init(&jobs);
+
+    // raymarched terrain past the meshes, only worth it with --world
+    FarField far_field = {};
+    if (world_terrain && !far_field_init(&far_field, &world, block_colors, &jobs)) {
+        fprintf(stderr, "Failed to build the far field, drawing meshes only\n");
+    }
+    float view_distance = far_field.texture != 0 ? FAR_VIEW_DISTANCE : VIEW_DISTANCE;
+    GLint far_chunk_count_location = glGetUniformLocation(far_shader.ID, "chunk_count");
+    far_shader.use();
+    far_shader.setInt("cells", 0);
+    EntityWorld entities;
+    EntityVector<float> instance_data;
+    double sim_accumulator = 0.0;
+
+    ParticleSystem particles;
+    if (!particle_init(&particles, PARTICLE_CAPACITY, PARTICLE_SEED)) {
+        return -1;
+    }
+    particle_init_gl(&particles);
+    particle_set_world(&particles, &world, particle_window());
+    printf("Particle kernel: %s\n", particle_kernel_name(particles.kernel));
+
+    RenderQueue render_queue;
+    Arena hud_arena;
+    arena_init(&hud_arena, MEM_TEXT, HUD_ARENA_SIZE);
+    GLStateCache gl_state;
+    state_reset(&gl_state);
+
+    // read back for the replay framebuffer hash
+    std::vector<uint8_t, TagAllocator<uint8_t, MEM_RENDER>> frame_pixels;
+
+    // counted in game time, so replays draw the same HUD
+    double fps_time = 0.0;
     int frames_num = 0;
     int fps = 0;
     double ms = 0.0;
+    uint64_t frame_number = 0;
 
     while (!glfwWindowShouldClose(window)) {
+        TRACE_SCOPE("frame");
+
+        double frame_start = glfwGetTime();
+        uint32_t keys;
+        if (replaying) {
+            double recorded_delta;
+            if (!input_replay_frame(&replay, &recorded_delta, &keys)) {
+                break;
+            }
+            delta_time = fixed_step_ms > 0.0 ? fixed_step_ms / 1000.0 : recorded_delta;
+        } else {
+            double current_frame = glfwGetTime();
+            delta_time = current_frame - last_frame;
+            last_frame = current_frame;
+            keys = poll_keys(window);
+            input_record_frame(&input_recorder, delta_time, keys);
+        }
 
-        double current_frame_time = glfwGetTime();
         frames_num++;
-        if (current_frame_time - last_frame_time >= 1.0) {
+        fps_time += delta_time;
+        if (fps_time >= 1.0) {
             ms = 1000.0 / double(frames_num);
             fps = frames_num;
             frames_num = 0;
-            last_frame_time += 1.0;
+            fps_time -= 1.0;
         }
 
-        double current_frame = glfwGetTime();
-        delta_time = current_frame - last_frame;
-        last_frame = current_frame;
-
         // input
-        process_input(window);
+        process_input(window, keys);
+
+        {
+            uint32_t count = entity_count(&entities);
+            if (count < entity_target) {
+                uint32_t missing = entity_target - count;
+                spawn_entities(&entities, missing < ENTITY_SPAWN_MAX ? missing : ENTITY_SPAWN_MAX);
+            }
+
+            for (; block_bursts > 0; block_bursts--) {
+                particle_emit_block(&particles, vec3(1.0f, 1.0f, 0.0f), debris_uv, PARTICLE_BURST);
+            }
+
+            bool world_changed = sand_drops > 0;
+            ivec3 drop_center = world_terrain ? camera_block() : ivec3(CHUNK_SIZE / 2);
+            for (; sand_drops > 0; sand_drops--) {
+                int x = drop_center.x + (int)floor(game_random(-SAND_DROP_RADIUS, SAND_DROP_RADIUS));
+                int z = drop_center.z + (int)floor(game_random(-SAND_DROP_RADIUS, SAND_DROP_RADIUS));
+                int y = drop_height(&world, x, z, SAND_DROP_HEIGHT);
+                if (!world_contains(&world, x, y, z)) {
+                    continue;
+                }
+                tick_set_block(&ticks, x, y, z, BLOCK_SAND);
+                terrain_mark_block(&terrain, x, y, z);
+                far_field_mark_block(&far_field, x, y, z);
+            }
+
+            tick_accumulator += delta_time;
+            int tick_steps = 0;
+            while (tick_accumulator >= 1.0 / TICK_RATE && tick_steps < TICK_MAX_STEPS) {
+                tick_step(&ticks, &jobs);
+                for (const BlockChange &change : ticks.applied) {
+                    terrain_mark_block(&terrain, change.x, change.y, change.z);
+                    far_field_mark_block(&far_field, change.x, change.y, change.z);
+                }
+                world_changed |= !ticks.applied.empty();
+                tick_accumulator -= 1.0 / TICK_RATE;
+                tick_steps++;
+            }
+            if (tick_steps == TICK_MAX_STEPS) {
+                tick_accumulator = 0.0;
+            }
+            ivec3 window = particle_window();
+            ivec3 moved = window - particles.origin;
+            if (world_changed || abs(moved.x) > PARTICLE_RECENTER || abs(moved.y) > PARTICLE_RECENTER
+                || abs(moved.z) > PARTICLE_RECENTER) {
+                particle_set_world(&particles, &world, window);
+            }
+
+            // weather follows the camera
+            vec3 camera_chunk = camera_pos / CHUNK_SCALE;
+
+            sim_accumulator += delta_time;
+            int steps = 0;
+            while (sim_accumulator >= SIM_STEP && steps < SIM_MAX_STEPS) {
+                entity_update(&entities, &jobs, &world, (float)SIM_STEP);
+                if (weather_kind != WEATHER_CLEAR) {
+                    particle_emit_weather(&particles, &weathers[weather_kind], camera_chunk, (float)SIM_STEP);
+                }
+                particle_update(&particles, (float)SIM_STEP);
+                sim_accumulator -= SIM_STEP;
+                steps++;
+            }
+            if (steps == SIM_MAX_STEPS) {
+                sim_accumulator = 0.0;
+            }
+        }
+
+        if (window_resized) {
+            window_resized = false;
+            if (!scene_target_resize(&scene_target, window_width, window_height)) {
+                fprintf(stderr, "Failed to resize scene framebuffer\n");
+            }
+            state_reset(&gl_state);
+
+            text_projection = glm::ortho(0.0f, (float)window_width, 0.0f, (float)window_height);
+            state_use_program(&gl_state, font_shader.ID);
+            font_shader.setMat4("projection", text_projection);
+        }
+
+        float scene_scale = dynres_update(&dynres, (float)(delta_time * 1000.0));
+        int scene_width = (int)(window_width * scene_scale);
+        int scene_height = (int)(window_height * scene_scale);
+        if (scene_width < 1) {
+            scene_width = 1;
+        }
+        if (scene_height < 1) {
+            scene_height = 1;
+        }
+
+        // finished imports show up in front of the camera
+        int added = model_loader_poll(&model_loader, &gl_state, models);
+        for (size_t i = models.size() - added; i < models.size(); i++) {
+            models[i].transform = model_fit(&models[i], camera_pos + camera_front * 3.0f, 1.0f);
+        }
+
+        // chunks that got or lost a mesh switch over to the far field and back
+        terrain_update(&terrain, &gl_state, camera_pos / CHUNK_SCALE);
+        for (uint32_t index : terrain.changed) {
+            far_field_set_meshed(&far_field, index, terrain.meshes[index].built);
+        }
+        far_field_update(&far_field, &gl_state);
+        // water and glass faces back to front, when the camera moved on a block
+        terrain_sort(&terrain, &gl_state, &jobs, camera_pos / CHUNK_SCALE);
 
         mat4 view = lookAt(camera_pos, camera_pos + camera_front, camera_up);
-        mat4 projection = perspective(radians(fov.normal), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f);
+        mat4 projection = perspective(radians(fov.normal), (float)window_width / (float)window_height, 0.1f, view_distance);
         mat4 block_model(1.0f);
-        block_model = scale(block_model, vec3(0.5f, 0.5f, 0.5f));
+        block_model = scale(block_model, vec3(CHUNK_SCALE));
 
         // render
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        render_queue_clear(&render_queue);
+        text_batch.vertices.clear();
 
-        glDepthMask(GL_FALSE);
-        skybox_shader.use();
+        state_use_program(&gl_state, block_shader.ID);
+        block_shader.setMat4("view", view);
+        block_shader.setMat4("projection", projection);
+
+        vec3 chunk_center = vec3(block_model * vec4(vec3(CHUNK_SIZE / 2.0f - 0.5f), 1.0f));
+        DrawItem chunk_item = {
+            .pass = PASS_OPAQUE,
+            .program = block_shader.ID,
+            .texture_target = GL_TEXTURE_2D,
+            .texture = minecraft_atlas_id,
+            .vao = 0,
+            .mode = GL_TRIANGLES,
+            .first = 0,
+            .count = 0,
+            .model = NULL,
+            .model_location = block_model_location,
+            .depth = 0.0f,
+        };
+        terrain_submit(&terrain, &render_queue, chunk_item, camera_pos, view_distance);
+        chunk_item.pass = PASS_TRANSLUCENT;
+        terrain_submit(&terrain, &render_queue, chunk_item, camera_pos, view_distance, true);
+
+        if (far_field_visible(&far_field)) {
+            mat4 view_projection = projection * view;
+            state_use_program(&gl_state, far_shader.ID);
+            far_shader.setMat4("view_projection", view_projection);
+            far_shader.setMat4("inverse_view_projection", inverse(view_projection));
+            far_shader.setVec3("camera", camera_pos);
+            far_shader.setFloat("block_size", CHUNK_SCALE);
+            // just short of the far plane, so hits never get clipped
+            far_shader.setFloat("max_distance", view_distance / CHUNK_SCALE * 0.99f);
+            glUniform3i(far_chunk_count_location, world.size_x, world.size_y, world.size_z);
+
+            DrawItem far_item = {
+                .pass = PASS_FAR_FIELD,
+                .program = far_shader.ID,
+                .texture_target = GL_TEXTURE_3D,
+                .texture = far_field.texture,
+                .vao = far_field.vao,
+                .mode = GL_TRIANGLES,
+                .first = 0,
+                .count = 3,
+                .model = NULL,
+                .model_location = -1,
+                .depth = 1.0f,
+            };
+            render_queue_submit(&render_queue, far_item);
+        }
+
+        for (const Model &m : models) {
+            vec3 model_center = vec3(m.transform * vec4((m.bounds_min + m.bounds_max) * 0.5f, 1.0f));
+            DrawItem model_item = {
+                .pass = PASS_OPAQUE,
+                .program = block_shader.ID,
+                .texture_target = GL_TEXTURE_2D,
+                .texture = m.texture,
+                .vao = m.vao,
+                .mode = GL_TRIANGLES,
+                .first = 0,
+                .count = m.index_count,
+                .model = &m.transform,
+                .model_location = block_model_location,
+                .depth = distance(camera_pos, model_center) / view_distance,
+                .index_type = GL_UNSIGNED_INT,
+            };
+            render_queue_submit(&render_queue, model_item);
+        }
+
+        // one instanced draw per entity mesh
+        state_use_program(&gl_state, entity_shader.ID);
+        entity_shader.setMat4("view", view);
+        entity_shader.setMat4("projection", projection);
+        for (int m = 0; m < ENTITY_MESH_COUNT; m++) {
+            uint32_t instance_count = entity_build_instances(&entities, (EntityMesh)m, instance_data);
+            if (instance_count == 0) {
+                continue;
+            }
+            instance_buffer_upload(&entity_instances[m], MEM_RENDER, instance_data.data(), instance_data.size() * sizeof(float));
+
+            DrawItem entity_item = {
+                .pass = PASS_OPAQUE,
+                .program = entity_shader.ID,
+                .texture_target = GL_TEXTURE_2D,
+                .texture = minecraft_atlas_id,
+                .vao = entity_vaos[m],
+                .mode = GL_TRIANGLES,
+                .first = 0,
+                .count = entity_vertex_counts[m],
+                .model = &block_model,
+                .model_location = entity_model_location,
+                .depth = distance(camera_pos, chunk_center) / view_distance,
+                .instance_count = (GLsizei)instance_count,
+            };
+            render_queue_submit(&render_queue, entity_item);
+        }
+
+        // all particles in one instanced draw of camera facing quads
+        if (particles.count > 0) {
+            state_use_program(&gl_state, particle_shader.ID);
+            particle_shader.setMat4("view", view);
+            particle_shader.setMat4("projection", projection);
+            particle_upload(&particles);
+
+            DrawItem particle_item = {
+                .pass = PASS_OPAQUE,
+                .program = particle_shader.ID,
+                .texture_target = GL_TEXTURE_2D,
+                .texture = minecraft_atlas_id,
+                .vao = particles.vao,
+                .mode = GL_TRIANGLE_STRIP,
+                .first = 0,
+                .count = 4,
+                .model = &block_model,
+                .model_location = particle_model_location,
+                .depth = distance(camera_pos, chunk_center) / view_distance,
+                .instance_count = (GLsizei)particles.count,
+            };
+            render_queue_submit(&render_queue, particle_item);
+        }
+
+        state_use_program(&gl_state, skybox_shader.ID);
         mat4 skybox_view = mat4(mat3(view));
         skybox_shader.setMat4("view", skybox_view);
         skybox_shader.setMat4("projection", projection);
-        glBindVertexArray(skybox_vao);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_texture_id);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glDepthMask(GL_TRUE);
 
-        glBindVertexArray(block_vao);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, minecraft_atlas_id);
+        DrawItem skybox_item = {
+            .pass = PASS_SKYBOX,
+            .program = skybox_shader.ID,
+            .texture_target = GL_TEXTURE_CUBE_MAP,
+            .texture = cubemap_texture_id,
+            .vao = skybox_vao,
+            .mode = GL_TRIANGLES,
+            .first = 0,
+            .count = 36,
+            .model = NULL,
+            .model_location = -1,
+            .depth = 1.0f,
+        };
+        render_queue_submit(&render_queue, skybox_item);
 
-        block_shader.use();
-        block_shader.setMat4("model", block_model);
-        block_shader.setMat4("view", view);
-        block_shader.setMat4("projection", projection);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        mem_check_budgets();
+        arena_reset(&hud_arena);
+
+        int64_t cpu_total = 0;
+        int64_t gpu_total = 0;
+        for (int i = 0; i < MEM_COUNT; i++) {
+            MemStats stats = mem_stats((MemTag)i);
+            cpu_total += stats.cpu_bytes;
+            gpu_total += stats.gpu_bytes;
+        }
 
-        block_model = translate(block_model, vec3(1.0f, 0.0f, 0.0f));
-        block_shader.setMat4("model", block_model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glm::vec3 white(1.0f, 1.0f, 1.0f);
+        glm::vec3 red(1.0f, 0.2f, 0.2f);
+        float hud_x = window_width - 250.0f;
+        float hud_y = window_height - 70.0f;
+
+        glyph_cache_begin_frame(&glyph_cache);
+        render_text(&render_queue, &text_batch, "Shahter v0.0.1", 25.0f, 25.0f, 36.0f, glm::vec3(0.3f, 0.3f, 0.8f));
+        render_text(&render_queue, &text_batch, hud_printf(&hud_arena, "fps: %d", fps), hud_x, hud_y, 36.0f, white);
+        render_text(&render_queue, &text_batch, hud_printf(&hud_arena, "ms: %.2f", ms), hud_x, hud_y - 36.0f, 36.0f, white);
+        render_text(&render_queue, &text_batch, hud_printf(&hud_arena, "res: %d%%", (int)(scene_scale * 100.0f + 0.5f)), hud_x, hud_y - 72.0f, 36.0f, white);
+        render_text(&render_queue, &text_batch, hud_printf(&hud_arena, "ent: %u", entity_count(&entities)), hud_x, hud_y - 108.0f, 36.0f, white);
+        render_text(&render_queue, &text_batch, hud_printf(&hud_arena, "part: %u", particles.count), hud_x, hud_y - 144.0f, 36.0f, white);
+        if (capture_recording && !replaying) {
+            const char *line = hud_printf(&hud_arena, "rec: %llu", (unsigned long long)capture_written(&capture));
+            render_text(&render_queue, &text_batch, line, hud_x, hud_y - 180.0f, 36.0f, red);
+        }
+
+        // memory, per subsystem with M
+        float mem_x = 25.0f;
+        float mem_y = window_height - 70.0f;
+        render_text(
+            &render_queue,
+            &text_batch,
+            hud_printf(&hud_arena, "mem cpu %.1f MB gpu %.1f MB", (double)cpu_total / MB, (double)gpu_total / MB),
+            mem_x,
+            mem_y,
+            22.0f,
+            white
+        );
+        if (show_memory) {
+            for (int i = 0; i < MEM_COUNT; i++) {
+                MemStats stats = mem_stats((MemTag)i);
+                const char *line = hud_printf(
+                    &hud_arena,
+                    "%-9s cpu %7.2f gpu %7.2f / %.0f MB",
+                    mem_tag_name((MemTag)i),
+                    (double)stats.cpu_bytes / MB,
+                    (double)stats.gpu_bytes / MB,
+                    (double)stats.budget / MB
+                );
+                mem_y -= 24.0f;
+                render_text(&render_queue, &text_batch, line, mem_x, mem_y, 22.0f, mem_over_budget((MemTag)i) ? red : white);
+            }
+        }
+        text_batch_upload(&text_batch, &gl_state);
+
+        // 3D scene at the dynamic resolution
+        glBindFramebuffer(GL_FRAMEBUFFER, scene_target.fbo);
+        glViewport(0, 0, scene_width, scene_height);
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        // the cached depth mask must allow clearing depth
+        state_set_depth_write(&gl_state, true);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        render_queue_execute_passes(&render_queue, &gl_state, PASS_OPAQUE, PASS_TRANSLUCENT);
+
+        // upscale to the window, HUD on top at native resolution
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, window_width, window_height);
+        scene_target_upscale(&scene_target, scene_width, scene_height, window_width, window_height);
+        render_queue_execute_passes(&render_queue, &gl_state, PASS_HUD, PASS_HUD);
 
-        block_model = translate(block_model, vec3(0.0f, 1.0f, 0.0f));
-        block_shader.setMat4("model", block_model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        if (replaying) {
+            // wait for the GPU so the frame time covers its work too
+            glFinish();
+            double frame_ms = (glfwGetTime() - frame_start) * 1000.0;
 
-        glBindTexture(GL_TEXTURE_2D, 0);
+            frame_pixels.resize((size_t)window_width * (size_t)window_height * 4);
+            glReadPixels(0, 0, window_width, window_height, GL_RGBA, GL_UNSIGNED_BYTE, frame_pixels.data());
+            uint64_t hash = hash_bytes(frame_pixels.data(), frame_pixels.size());
 
-        font_shader.use();
-        font_shader.setMat4("projection", text_projection);
-        char fps_text[32];
-        char ms_text[32];
-        sprintf(fps_text, "fps: %d", fps);
-        sprintf(ms_text, "ms: %.2f", ms);
-        render_text(font_shader, text_vao, text_vbo, "Shahter v0.0.1", 25.0f, 25.0f, 1.0f, glm::vec3(0.3f, 0.3f, 0.8f));
-        render_text(font_shader, text_vao, text_vbo, fps_text, WINDOW_WIDTH - 250.0f, WINDOW_HEIGHT - 70.0f, 1.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-        render_text(font_shader, text_vao, text_vbo, ms_text, WINDOW_WIDTH - 250.0f, WINDOW_HEIGHT - 70.0f - 36.0f, 1.0f, glm::vec3(1.0f, 1.0f, 1.0f));
+            frame_log_add(&frame_log, replay.frames, delta_time * 1000.0, frame_ms, hash);
+        }
 
-        // clean up
-        glBindVertexArray(0);
-        glUseProgram(0);
+        // replays name captures after the recorded frame, so runs line up
+        uint64_t capture_number = replaying ? replay.frames : frame_number;
+        bool capture_this = capture_screenshot || (capture_recording && capture_number % capture_every == 0);
+        if (capture_this && !capture_started) {
+            capture_started = capture_start(&capture, capture_directory);
+            capture.keep_all = replaying;
+            if (!capture_started) {
+                capture_recording = false;
+            }
+        }
+        if (capture_started) {
+            if (capture_this) {
+                // while recording the screenshot is just the recorded frame
+                CaptureFormat format = capture_screenshot && !capture_recording ? CAPTURE_PNG : capture_format;
+                capture_frame(&capture, capture_number, window_width, window_height, format);
+            } else {
+                capture_poll(&capture);
+            }
+        }
+        capture_screenshot = false;
+        frame_number++;
 
         // poll and swap buffers
         glfwPollEvents();
-        glfwSwapBuffers(window);
+        if (replaying) {
+            InputEvent event;
+            while (input_replay_event(&replay, &event)) {
+                handle_event(event);
+            }
+        }
+        {
+            TRACE_SCOPE("swap_buffers");
+            glfwSwapBuffers(window);
+        }
+    }
+
+    input_record_close(&input_recorder);
+    if (replaying) {
+        frame_log_close(&frame_log);
+    }
+
+    if (trace_on_exit) {
+        trace_dump(trace_path, trace_seconds);
+    }
+    trace_wait();
+
+    if (capture_started) {
+        capture_stop(&capture);
+        if (capture.dropped > 0) {
+            fprintf(stderr, "Dropped %llu captured frames\n", (unsigned long long)capture.dropped);
+        }
+    }
+    jobs_destroy(&jobs);
+    model_loader_stop(&model_loader);
+    terrain_destroy(&terrain);
+    far_field_destroy(&far_field);
+    for (Model &m : models) {
+        model_destroy(&m);
+    }
+    for (int m = 0; m < ENTITY_MESH_COUNT; m++) {
+        gpu_delete_buffers(1, &entity_instances[m].buffer);
     }
+    gpu_delete_buffers(ENTITY_MESH_COUNT, entity_vbos);
+    glDeleteVertexArrays(ENTITY_MESH_COUNT, entity_vaos);
+    particle_destroy(&particles);
+    scene_target_destroy(&scene_target);
+    glyph_cache_destroy(&glyph_cache);
+    arena_destroy(&hud_arena);
+    tick_destroy(&ticks);
+    world_destroy(&world);
 
     glfwTerminate();
 
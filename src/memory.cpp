@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <map>
+#include <tuple>
+
+#include "memory.h"
+
+// keeps the size in front of every tagged block, 16 keeps SSE alignment
+#define MEM_HEADER 16
+
+static const char *TAG_NAMES[MEM_COUNT] = {
+    "world",
+    "meshes",
+    "textures",
+    "text",
+    "shaders",
+    "render",
+    "models",
+    "particles",
+    "net",
+};
+
+static std::atomic<int64_t> cpu_bytes[MEM_COUNT];
+static std::atomic<int64_t> cpu_allocs[MEM_COUNT];
+static std::atomic<int64_t> gpu_bytes[MEM_COUNT];
+static std::atomic<int64_t> budgets[MEM_COUNT];
+static bool warned[MEM_COUNT];
+static std::atomic<uint64_t> alloc_count;
+
+const char *mem_tag_name(MemTag tag) {
+    return TAG_NAMES[tag];
+}
+
+void *mem_malloc(MemTag tag, size_t size) {
+    uint8_t *p = (uint8_t *)malloc(size + MEM_HEADER);
+    if (p == NULL) {
+        return NULL;
+    }
+    *(size_t *)p = size;
+
+    cpu_bytes[tag].fetch_add((int64_t)size, std::memory_order_relaxed);
+    cpu_allocs[tag].fetch_add(1, std::memory_order_relaxed);
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+
+    return p + MEM_HEADER;
+}
+
+void *mem_realloc(MemTag tag, void *p, size_t size) {
+    if (p == NULL) {
+        return mem_malloc(tag, size);
+    }
+
+    uint8_t *block = (uint8_t *)p - MEM_HEADER;
+    size_t old_size = *(size_t *)block;
+
+    block = (uint8_t *)realloc(block, size + MEM_HEADER);
+    if (block == NULL) {
+        return NULL;
+    }
+    *(size_t *)block = size;
+
+    cpu_bytes[tag].fetch_add((int64_t)size - (int64_t)old_size, std::memory_order_relaxed);
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+
+    return block + MEM_HEADER;
+}
+
+void mem_free(MemTag tag, void *p) {
+    if (p == NULL) {
+        return;
+    }
+
+    uint8_t *block = (uint8_t *)p - MEM_HEADER;
+    cpu_bytes[tag].fetch_sub((int64_t)*(size_t *)block, std::memory_order_relaxed);
+    cpu_allocs[tag].fetch_sub(1, std::memory_order_relaxed);
+
+    free(block);
+}
+
+uint64_t mem_alloc_count() {
+    return alloc_count.load(std::memory_order_relaxed);
+}
+
+void arena_init(Arena *arena, MemTag tag, size_t capacity) {
+    arena->tag = tag;
+    arena->base = (uint8_t *)mem_malloc(tag, capacity);
+    arena->capacity = capacity;
+    arena->used = 0;
+}
+
+void *arena_alloc(Arena *arena, size_t size, size_t align) {
+    size_t start = (arena->used + align - 1) & ~(align - 1);
+    if (start + size > arena->capacity) {
+        return NULL;
+    }
+    arena->used = start + size;
+
+    return arena->base + start;
+}
+
+void arena_reset(Arena *arena) {
+    arena->used = 0;
+}
+
+void arena_destroy(Arena *arena) {
+    mem_free(arena->tag, arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+}
+
+void pool_init(Pool *pool, MemTag tag, size_t item_size, size_t items_per_block) {
+    pool->tag = tag;
+    // free items hold the next pointer
+    pool->item_size = item_size < sizeof(void *) ? sizeof(void *) : item_size;
+    pool->item_size = (pool->item_size + 15) & ~(size_t)15;
+    pool->items_per_block = items_per_block;
+    pool->free_list = NULL;
+    pool->blocks = NULL;
+    pool->live = 0;
+}
+
+void *pool_alloc(Pool *pool) {
+    if (pool->free_list == NULL) {
+        // first 16 bytes link the blocks, items follow
+        uint8_t *block = (uint8_t *)mem_malloc(pool->tag, 16 + pool->item_size * pool->items_per_block);
+        if (block == NULL) {
+            return NULL;
+        }
+        *(void **)block = pool->blocks;
+        pool->blocks = block;
+
+        for (size_t i = pool->items_per_block; i > 0; i--) {
+            uint8_t *item = block + 16 + (i - 1) * pool->item_size;
+            *(void **)item = pool->free_list;
+            pool->free_list = item;
+        }
+    }
+
+    void *item = pool->free_list;
+    pool->free_list = *(void **)item;
+    pool->live++;
+
+    return item;
+}
+
+void pool_free(Pool *pool, void *item) {
+    if (item == NULL) {
+        return;
+    }
+    *(void **)item = pool->free_list;
+    pool->free_list = item;
+    pool->live--;
+}
+
+void pool_destroy(Pool *pool) {
+    void *block = pool->blocks;
+    while (block) {
+        void *next = *(void **)block;
+        mem_free(pool->tag, block);
+        block = next;
+    }
+    pool->blocks = NULL;
+    pool->free_list = NULL;
+    pool->live = 0;
+}
+
+struct GpuEntry {
+    MemTag tag;
+    int64_t bytes;
+};
+
+typedef std::tuple<int, uint32_t, uint32_t> GpuImage;
+
+// only touched from the GL thread
+static std::map<GpuImage, GpuEntry> gpu_images;
+
+void mem_gpu_track(MemTag tag, GpuResource kind, uint32_t id, uint32_t image, int64_t bytes) {
+    GpuImage key((int)kind, id, image);
+
+    auto it = gpu_images.find(key);
+    if (it != gpu_images.end()) {
+        gpu_bytes[it->second.tag].fetch_sub(it->second.bytes, std::memory_order_relaxed);
+    }
+    gpu_images[key] = GpuEntry { tag, bytes };
+    gpu_bytes[tag].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void mem_gpu_release(GpuResource kind, uint32_t id) {
+    auto it = gpu_images.lower_bound(GpuImage((int)kind, id, 0));
+    while (it != gpu_images.end() && std::get<0>(it->first) == (int)kind && std::get<1>(it->first) == id) {
+        gpu_bytes[it->second.tag].fetch_sub(it->second.bytes, std::memory_order_relaxed);
+        it = gpu_images.erase(it);
+    }
+}
+
+void mem_set_budget(MemTag tag, int64_t bytes) {
+    budgets[tag].store(bytes, std::memory_order_relaxed);
+}
+
+MemStats mem_stats(MemTag tag) {
+    MemStats stats = {
+        .cpu_bytes = cpu_bytes[tag].load(std::memory_order_relaxed),
+        .cpu_allocs = cpu_allocs[tag].load(std::memory_order_relaxed),
+        .gpu_bytes = gpu_bytes[tag].load(std::memory_order_relaxed),
+        .budget = budgets[tag].load(std::memory_order_relaxed),
+    };
+    return stats;
+}
+
+bool mem_over_budget(MemTag tag) {
+    MemStats stats = mem_stats(tag);
+    return stats.budget > 0 && stats.cpu_bytes + stats.gpu_bytes > stats.budget;
+}
+
+void mem_check_budgets() {
+    for (int i = 0; i < MEM_COUNT; i++) {
+        MemTag tag = (MemTag)i;
+        bool over = mem_over_budget(tag);
+        if (over && !warned[i]) {
+            MemStats stats = mem_stats(tag);
+            fprintf(
+                stderr,
+                "WARNING: %s memory over budget: %.1f MB of %.1f MB\n",
+                TAG_NAMES[i],
+                (double)(stats.cpu_bytes + stats.gpu_bytes) / (1024.0 * 1024.0),
+                (double)stats.budget / (1024.0 * 1024.0)
+            );
+        }
+        warned[i] = over;
+    }
+}
+
+bool mem_export(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: Failed to open memory report %s\n", path);
+        return false;
+    }
+
+    fprintf(f, "tag,cpu_bytes,cpu_allocs,gpu_bytes,budget\n");
+    for (int i = 0; i < MEM_COUNT; i++) {
+        MemStats stats = mem_stats((MemTag)i);
+        fprintf(
+            f,
+            "%s,%lld,%lld,%lld,%lld\n",
+            TAG_NAMES[i],
+            (long long)stats.cpu_bytes,
+            (long long)stats.cpu_allocs,
+            (long long)stats.gpu_bytes,
+            (long long)stats.budget
+        );
+    }
+    fclose(f);
+
+    printf("Wrote memory report to %s\n", path);
+
+    return true;
+}
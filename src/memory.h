@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+
+// Memory accounting per subsystem. CPU allocations go through the tagged
+// functions below, GPU memory is estimated from the size of every texture
+// and buffer upload (see the gpu_* wrappers in render.h).
+
+enum MemTag {
+    MEM_WORLD = 0,
+    MEM_MESHES,
+    MEM_TEXTURES,
+    MEM_TEXT,
+    MEM_SHADERS,
+    MEM_RENDER,
+    MEM_MODELS,
+    MEM_PARTICLES,
+    MEM_NET,
+
+    MEM_COUNT
+};
+
+struct MemStats {
+    int64_t cpu_bytes;
+    int64_t cpu_allocs;  // live allocations
+    int64_t gpu_bytes;
+    int64_t budget;      // cpu + gpu, 0 means unlimited
+};
+
+const char *mem_tag_name(MemTag tag);
+
+// malloc/realloc/free that charge `tag`, NULL on failure
+void *mem_malloc(MemTag tag, size_t size);
+void *mem_realloc(MemTag tag, void *p, size_t size);
+void mem_free(MemTag tag, void *p);
+// Tagged mallocs and reallocs made so far, over all tags.
+uint64_t mem_alloc_count();
+
+// STL allocator charging a tag, e.g. std::vector<float, TagAllocator<float, MEM_MESHES>>.
+template <class T, MemTag Tag>
+struct TagAllocator {
+    typedef T value_type;
+
+    template <class U>
+    struct rebind {
+        typedef TagAllocator<U, Tag> other;
+    };
+
+    TagAllocator() = default;
+    template <class U>
+    TagAllocator(const TagAllocator<U, Tag> &) {}
+
+    T *allocate(size_t n) {
+        T *p = (T *)mem_malloc(Tag, n * sizeof(T));
+        if (p == NULL) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+    void deallocate(T *p, size_t) {
+        mem_free(Tag, p);
+    }
+
+    template <class U>
+    bool operator==(const TagAllocator<U, Tag> &) const {
+        return true;
+    }
+    template <class U>
+    bool operator!=(const TagAllocator<U, Tag> &) const {
+        return false;
+    }
+};
+
+// Bump allocator, everything is released at once by arena_reset.
+// Meant for per-frame scratch data.
+struct Arena {
+    MemTag tag;
+    uint8_t *base;
+    size_t capacity;
+    size_t used;
+};
+
+void arena_init(Arena *arena, MemTag tag, size_t capacity);
+// Returns NULL when the arena is full.
+void *arena_alloc(Arena *arena, size_t size, size_t align = 16);
+void arena_reset(Arena *arena);
+void arena_destroy(Arena *arena);
+
+// Fixed size item allocator for objects that come and go a lot.
+// Blocks of items are never returned before pool_destroy.
+struct Pool {
+    MemTag tag;
+    size_t item_size;
+    size_t items_per_block;
+    void *free_list;
+    void *blocks;   // singly linked through the first pointer of each block
+    size_t live;
+};
+
+void pool_init(Pool *pool, MemTag tag, size_t item_size, size_t items_per_block);
+void *pool_alloc(Pool *pool);
+void pool_free(Pool *pool, void *item);
+void pool_destroy(Pool *pool);
+
+enum GpuResource {
+    GPU_TEXTURE = 0,
+    GPU_BUFFER,
+    GPU_RENDERBUFFER,
+};
+
+// Sets the size of one image of a GPU object (a texture level or cube face,
+// 0 for buffers), replacing what was recorded for it before.
+void mem_gpu_track(MemTag tag, GpuResource kind, uint32_t id, uint32_t image, int64_t bytes);
+// Drops all images of a deleted object.
+void mem_gpu_release(GpuResource kind, uint32_t id);
+
+void mem_set_budget(MemTag tag, int64_t bytes);
+MemStats mem_stats(MemTag tag);
+bool mem_over_budget(MemTag tag);
+// Warns once on stderr whenever a tag goes over its budget.
+void mem_check_budgets();
+// Writes a CSV line per tag, returns false if the file can't be written.
+bool mem_export(const char *path);
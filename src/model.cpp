@@ -0,0 +1,466 @@
+#include <fcntl.h>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <stb_image.h>
+
+#include "model.h"
+#include "replay.h"
+#include "trace.h"
+
+#define MODEL_CACHE_MAGIC "SHMC"
+#define MODEL_CACHE_VERSION 1
+
+// followed by the vertices, the indices and the texture path
+struct ModelCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t texture_path_size;  // not NUL terminated
+    uint32_t reserved;
+};
+
+static bool hash_file(const char *path, uint64_t *hash, uint64_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    *hash = hash_bytes(p, (size_t)st.st_size);
+    *size = (uint64_t)st.st_size;
+    munmap(p, (size_t)st.st_size);
+
+    return true;
+}
+
+static bool map_cache(ModelData *data, const char *cache_path, uint64_t hash, uint64_t source_size) {
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ModelCacheHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    const ModelCacheHeader *h = (const ModelCacheHeader *)p;
+    size_t vertices_size = (size_t)h->vertex_count * MODEL_VERTEX_SIZE * sizeof(float);
+    size_t indices_size = (size_t)h->index_count * sizeof(uint32_t);
+    if (
+        memcmp(h->magic, MODEL_CACHE_MAGIC, 4) != 0
+        || h->version != MODEL_CACHE_VERSION
+        || h->source_hash != hash
+        || h->source_size != source_size
+        || sizeof(ModelCacheHeader) + vertices_size + indices_size + h->texture_path_size != size
+    ) {
+        munmap(p, size);
+        return false;
+    }
+
+    const uint8_t *bytes = (const uint8_t *)p;
+    data->mapping = p;
+    data->mapping_size = size;
+    data->vertices = (const float *)(bytes + sizeof(ModelCacheHeader));
+    data->vertex_count = h->vertex_count;
+    data->indices = (const uint32_t *)(bytes + sizeof(ModelCacheHeader) + vertices_size);
+    data->index_count = h->index_count;
+    data->bounds_min = glm::vec3(h->bounds_min[0], h->bounds_min[1], h->bounds_min[2]);
+    data->bounds_max = glm::vec3(h->bounds_max[0], h->bounds_max[1], h->bounds_max[2]);
+
+    return true;
+}
+
+static std::string cache_texture_path(const ModelData *data) {
+    const ModelCacheHeader *h = (const ModelCacheHeader *)data->mapping;
+    const char *path = (const char *)data->indices + (size_t)data->index_count * sizeof(uint32_t);
+    return std::string(path, h->texture_path_size);
+}
+
+static void unmap_cache(ModelData *data) {
+    if (data->mapping) {
+        munmap(data->mapping, data->mapping_size);
+        data->mapping = NULL;
+    }
+}
+
+// Flattens every triangle mesh of the file into the engine layout and
+// writes it to `cache_path`.
+static bool import_model(const char *path, const char *cache_path, uint64_t hash, uint64_t source_size) {
+    TRACE_SCOPE("import_model");
+
+    Assimp::Importer importer;
+    // bakes node transforms in, so all meshes share one model matrix
+    const aiScene *scene = importer.ReadFile(
+        path,
+        aiProcess_Triangulate
+        | aiProcess_JoinIdenticalVertices
+        | aiProcess_PreTransformVertices
+        | aiProcess_SortByPType
+        | aiProcess_ImproveCacheLocality
+        | aiProcess_FlipUVs
+    );
+    if (scene == NULL || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || scene->mRootNode == NULL) {
+        fprintf(stderr, "ERROR: Failed to import %s: %s\n", path, importer.GetErrorString());
+        return false;
+    }
+
+    std::vector<float, TagAllocator<float, MEM_MODELS>> vertices;
+    std::vector<uint32_t, TagAllocator<uint32_t, MEM_MODELS>> indices;
+    glm::vec3 bounds_min(FLT_MAX);
+    glm::vec3 bounds_max(-FLT_MAX);
+    std::string texture;
+
+    for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+        const aiMesh *mesh = scene->mMeshes[i];
+        // points and lines
+        if (!(mesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE)) {
+            continue;
+        }
+
+        uint32_t base = (uint32_t)(vertices.size() / MODEL_VERTEX_SIZE);
+        for (unsigned int v = 0; v < mesh->mNumVertices; v++) {
+            glm::vec3 pos(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z);
+            bounds_min = glm::min(bounds_min, pos);
+            bounds_max = glm::max(bounds_max, pos);
+
+            vertices.push_back(pos.x);
+            vertices.push_back(pos.y);
+            vertices.push_back(pos.z);
+            if (mesh->HasTextureCoords(0)) {
+                vertices.push_back(mesh->mTextureCoords[0][v].x);
+                vertices.push_back(mesh->mTextureCoords[0][v].y);
+            } else {
+                vertices.push_back(0.0f);
+                vertices.push_back(0.0f);
+            }
+            // unoccluded
+            vertices.push_back(3.0f);
+        }
+        for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+            const aiFace &face = mesh->mFaces[f];
+            if (face.mNumIndices != 3) {
+                continue;
+            }
+            indices.push_back(base + face.mIndices[0]);
+            indices.push_back(base + face.mIndices[1]);
+            indices.push_back(base + face.mIndices[2]);
+        }
+
+        // one texture per model, the first diffuse map found
+        aiString name;
+        const aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+        if (
+            texture.empty()
+            && material->GetTexture(aiTextureType_DIFFUSE, 0, &name) == AI_SUCCESS
+            && name.C_Str()[0] != '*'  // embedded textures aren't supported
+        ) {
+            std::string dir(path);
+            size_t slash = dir.find_last_of('/');
+            dir = slash == std::string::npos ? "." : dir.substr(0, slash);
+            texture = dir + "/" + name.C_Str();
+            for (char &c : texture) {
+                if (c == '\\') {
+                    c = '/';
+                }
+            }
+        }
+    }
+
+    if (indices.empty()) {
+        fprintf(stderr, "ERROR: %s has no triangles\n", path);
+        return false;
+    }
+
+    ModelCacheHeader header = {};
+    memcpy(header.magic, MODEL_CACHE_MAGIC, 4);
+    header.version = MODEL_CACHE_VERSION;
+    header.source_hash = hash;
+    header.source_size = source_size;
+    header.vertex_count = (uint32_t)(vertices.size() / MODEL_VERTEX_SIZE);
+    header.index_count = (uint32_t)indices.size();
+    memcpy(header.bounds_min, &bounds_min[0], sizeof(header.bounds_min));
+    memcpy(header.bounds_max, &bounds_max[0], sizeof(header.bounds_max));
+    header.texture_path_size = (uint32_t)texture.size();
+
+    mkdir("cache", 0755);
+    mkdir(MODEL_CACHE_DIR, 0755);
+
+    // a crash mid write must not leave a cache file that looks valid
+    std::string tmp_path = std::string(cache_path) + ".tmp";
+    FILE *f = fopen(tmp_path.c_str(), "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: Failed to write model cache %s\n", tmp_path.c_str());
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(vertices.data(), sizeof(float), vertices.size(), f);
+    fwrite(indices.data(), sizeof(uint32_t), indices.size(), f);
+    fwrite(texture.data(), 1, texture.size(), f);
+    bool ok = ferror(f) == 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), cache_path) != 0) {
+        fprintf(stderr, "ERROR: Failed to write model cache %s\n", cache_path);
+        remove(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+static ModelData *load_model(const std::string &path) {
+    TRACE_SCOPE("load_model");
+
+    ModelData *data = new ModelData();
+    data->path = path;
+
+    uint64_t hash;
+    uint64_t size;
+    if (!hash_file(path.c_str(), &hash, &size)) {
+        fprintf(stderr, "ERROR: Failed to read model %s\n", path.c_str());
+        return data;
+    }
+
+    char cache_path[512];
+    snprintf(cache_path, sizeof(cache_path), "%s/%016llx.mesh", MODEL_CACHE_DIR, (unsigned long long)hash);
+
+    // only a cache miss pays for Assimp
+    if (!map_cache(data, cache_path, hash, size)) {
+        if (!import_model(path.c_str(), cache_path, hash, size) || !map_cache(data, cache_path, hash, size)) {
+            return data;
+        }
+    }
+
+    std::string texture = cache_texture_path(data);
+    if (!texture.empty()) {
+        TRACE_SCOPE("load_model_texture");
+        int channels;
+        data->pixels = stbi_load(texture.c_str(), &data->texture_width, &data->texture_height, &channels, 4);
+        if (data->pixels == NULL) {
+            fprintf(stderr, "Failed to load model texture: %s\n", texture.c_str());
+        }
+    }
+    data->ok = true;
+
+    return data;
+}
+
+static void free_model_data(ModelData *data) {
+    unmap_cache(data);
+    if (data->pixels) {
+        stbi_image_free(data->pixels);
+    }
+    delete data;
+}
+
+static void worker_main(ModelLoader *loader) {
+    TRACE_THREAD_NAME("model_loader");
+
+    std::unique_lock<std::mutex> lock(loader->mutex);
+    for (;;) {
+        loader->wake.wait(lock, [loader] { return loader->quit || !loader->requests.empty(); });
+        if (loader->quit) {
+            break;
+        }
+        std::string path = loader->requests.front();
+        loader->requests.pop_front();
+
+        lock.unlock();
+        ModelData *data = load_model(path);
+        lock.lock();
+
+        loader->done.push_back(data);
+    }
+}
+
+void model_loader_start(ModelLoader *loader) {
+    loader->quit = false;
+    loader->white_texture = 0;
+    loader->worker = std::thread(worker_main, loader);
+}
+
+void model_loader_stop(ModelLoader *loader) {
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->quit = true;
+        loader->requests.clear();
+    }
+    loader->wake.notify_one();
+    if (loader->worker.joinable()) {
+        loader->worker.join();
+    }
+
+    for (ModelData *data : loader->done) {
+        free_model_data(data);
+    }
+    loader->done.clear();
+    if (loader->white_texture) {
+        gpu_delete_textures(1, &loader->white_texture);
+        loader->white_texture = 0;
+    }
+}
+
+void model_loader_request(ModelLoader *loader, const char *path) {
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->requests.push_back(path);
+    }
+    loader->wake.notify_one();
+}
+
+int model_loader_poll(ModelLoader *loader, GLStateCache *state, std::vector<Model> &models) {
+    std::vector<ModelData *> done;
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        done.swap(loader->done);
+    }
+    if (done.empty()) {
+        return 0;
+    }
+    TRACE_SCOPE("model_upload");
+
+    int added = 0;
+    for (ModelData *data : done) {
+        if (!data->ok) {
+            free_model_data(data);
+            continue;
+        }
+
+        Model model = {};
+        model.index_count = (GLsizei)data->index_count;
+        model.bounds_min = data->bounds_min;
+        model.bounds_max = data->bounds_max;
+        model.transform = glm::mat4(1.0f);
+
+        glGenVertexArrays(1, &model.vao);
+        glGenBuffers(1, &model.vbo);
+        glGenBuffers(1, &model.ebo);
+        state_bind_vao(state, model.vao);
+
+        // straight from the mapped cache file
+        glBindBuffer(GL_ARRAY_BUFFER, model.vbo);
+        gpu_buffer_data(
+            MEM_MODELS,
+            model.vbo,
+            GL_ARRAY_BUFFER,
+            (GLsizeiptr)data->vertex_count * MODEL_VERTEX_SIZE * sizeof(float),
+            data->vertices,
+            GL_STATIC_DRAW
+        );
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.ebo);
+        gpu_buffer_data(
+            MEM_MODELS,
+            model.ebo,
+            GL_ELEMENT_ARRAY_BUFFER,
+            (GLsizeiptr)data->index_count * sizeof(uint32_t),
+            data->indices,
+            GL_STATIC_DRAW
+        );
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, MODEL_VERTEX_SIZE * sizeof(float), (void *)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, MODEL_VERTEX_SIZE * sizeof(float), (void *)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, MODEL_VERTEX_SIZE * sizeof(float), (void *)(5 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        if (data->pixels) {
+            glGenTextures(1, &model.texture);
+            state_bind_texture(state, GL_TEXTURE_2D, model.texture);
+            gpu_tex_image_2d(
+                MEM_MODELS,
+                model.texture,
+                GL_TEXTURE_2D,
+                0,
+                GL_RGBA8,
+                data->texture_width,
+                data->texture_height,
+                GL_RGBA,
+                GL_UNSIGNED_BYTE,
+                data->pixels
+            );
+            gpu_generate_mipmap(MEM_MODELS, model.texture, GL_TEXTURE_2D, GL_RGBA8, data->texture_width, data->texture_height);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            model.own_texture = true;
+        } else {
+            if (loader->white_texture == 0) {
+                const uint8_t white[4] = { 255, 255, 255, 255 };
+                glGenTextures(1, &loader->white_texture);
+                state_bind_texture(state, GL_TEXTURE_2D, loader->white_texture);
+                gpu_tex_image_2d(MEM_MODELS, loader->white_texture, GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, white);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            }
+            model.texture = loader->white_texture;
+            model.own_texture = false;
+        }
+
+        printf(
+            "Loaded model %s: %u vertices, %u triangles\n",
+            data->path.c_str(),
+            data->vertex_count,
+            data->index_count / 3
+        );
+        models.push_back(model);
+        added++;
+
+        free_model_data(data);
+    }
+
+    return added;
+}
+
+void model_destroy(Model *model) {
+    glDeleteVertexArrays(1, &model->vao);
+    gpu_delete_buffers(1, &model->vbo);
+    gpu_delete_buffers(1, &model->ebo);
+    if (model->own_texture) {
+        gpu_delete_textures(1, &model->texture);
+    }
+    *model = {};
+}
+
+glm::mat4 model_fit(const Model *model, glm::vec3 position, float radius) {
+    glm::vec3 center = (model->bounds_min + model->bounds_max) * 0.5f;
+    float extent = glm::length(model->bounds_max - model->bounds_min) * 0.5f;
+    float scale = radius / glm::max(extent, 1e-6f);
+
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+    transform = glm::scale(transform, glm::vec3(scale));
+    return glm::translate(transform, -center);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "render.h"
+
+// Models use the block vertex layout so they draw with the block shader:
+// position (3), texture coords (2), ambient occlusion (1, always 3).
+#define MODEL_VERTEX_SIZE CHUNK_VERTEX_SIZE
+
+// Imports are flattened into one vertex and index buffer and cached here,
+// named after the hash of the source file.
+#define MODEL_CACHE_DIR "cache/models"
+
+// Result of a background import, owned by the loader until it is uploaded.
+struct ModelData {
+    std::string path;
+    bool ok;
+
+    // the cache file mapped read-only, vertices and indices point into it
+    void *mapping;
+    size_t mapping_size;
+    const float *vertices;
+    uint32_t vertex_count;
+    const uint32_t *indices;
+    uint32_t index_count;
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+
+    // decoded diffuse texture, RGBA, NULL if the model has none
+    unsigned char *pixels;
+    int texture_width;
+    int texture_height;
+};
+
+struct Model {
+    GLuint vao;
+    GLuint vbo;
+    GLuint ebo;
+    GLuint texture;
+    bool own_texture;
+    GLsizei index_count;
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    glm::mat4 transform;
+};
+
+// One worker thread runs the imports, the GL thread picks the results up
+// with model_loader_poll.
+struct ModelLoader {
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::string> requests;
+    std::vector<ModelData *> done;
+    bool quit;
+
+    GLuint white_texture;  // for models without a texture
+};
+
+void model_loader_start(ModelLoader *loader);
+// Waits for the running import, pending requests are dropped.
+void model_loader_stop(ModelLoader *loader);
+void model_loader_request(ModelLoader *loader, const char *path);
+// Uploads finished imports and appends them to `models`, returns how many
+// were added. Call on the GL thread.
+int model_loader_poll(ModelLoader *loader, GLStateCache *state, std::vector<Model> &models);
+
+void model_destroy(Model *model);
+// Scales and centers the model to fit a sphere of `radius` at `position`.
+glm::mat4 model_fit(const Model *model, glm::vec3 position, float radius);
@@ -0,0 +1,355 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "net.h"
+#include "trace.h"
+
+// bytes read per recv call
+#define NET_RECEIVE_CHUNK 65536
+
+void net_put_u8(NetBuffer &out, uint8_t v) {
+    out.push_back(v);
+}
+
+void net_put_u16(NetBuffer &out, uint16_t v) {
+    uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+    out.insert(out.end(), b, b + 2);
+}
+
+void net_put_u32(NetBuffer &out, uint32_t v) {
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    out.insert(out.end(), b, b + 4);
+}
+
+void net_put_i8(NetBuffer &out, int8_t v) {
+    net_put_u8(out, (uint8_t)v);
+}
+
+void net_put_i16(NetBuffer &out, int16_t v) {
+    net_put_u16(out, (uint16_t)v);
+}
+
+void net_put_bytes(NetBuffer &out, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+size_t net_begin_message(NetBuffer &out, NetMessage type) {
+    size_t start = out.size();
+    net_put_u32(out, 0);
+    net_put_u8(out, type);
+    return start;
+}
+
+void net_end_message(NetBuffer &out, size_t start) {
+    uint32_t length = (uint32_t)(out.size() - start - 4);
+    out[start + 0] = (uint8_t)length;
+    out[start + 1] = (uint8_t)(length >> 8);
+    out[start + 2] = (uint8_t)(length >> 16);
+    out[start + 3] = (uint8_t)(length >> 24);
+}
+
+static inline bool reader_has(NetReader *r, size_t size) {
+    if (!r->ok || (size_t)(r->end - r->p) < size) {
+        r->ok = false;
+        return false;
+    }
+    return true;
+}
+
+uint8_t net_get_u8(NetReader *r) {
+    if (!reader_has(r, 1)) {
+        return 0;
+    }
+    return *r->p++;
+}
+
+uint16_t net_get_u16(NetReader *r) {
+    if (!reader_has(r, 2)) {
+        return 0;
+    }
+    uint16_t v = (uint16_t)(r->p[0] | r->p[1] << 8);
+    r->p += 2;
+    return v;
+}
+
+uint32_t net_get_u32(NetReader *r) {
+    if (!reader_has(r, 4)) {
+        return 0;
+    }
+    uint32_t v = (uint32_t)r->p[0] | (uint32_t)r->p[1] << 8 | (uint32_t)r->p[2] << 16 | (uint32_t)r->p[3] << 24;
+    r->p += 4;
+    return v;
+}
+
+int8_t net_get_i8(NetReader *r) {
+    return (int8_t)net_get_u8(r);
+}
+
+int16_t net_get_i16(NetReader *r) {
+    return (int16_t)net_get_u16(r);
+}
+
+const uint8_t *net_get_bytes(NetReader *r, size_t size) {
+    if (!reader_has(r, size)) {
+        return NULL;
+    }
+    const uint8_t *p = r->p;
+    r->p += size;
+    return p;
+}
+
+int64_t net_next_message(const uint8_t *data, size_t size, NetMessage *type, NetReader *payload) {
+    if (size < NET_HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t length = (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+    if (length == 0 || length > NET_MAX_MESSAGE) {
+        return -1;
+    }
+    if (size - 4 < length) {
+        return 0;
+    }
+    *type = (NetMessage)data[4];
+    payload->p = data + NET_HEADER_SIZE;
+    payload->end = data + 4 + length;
+    payload->ok = true;
+    return 4 + (int64_t)length;
+}
+
+uint32_t net_pack_block(int x, int y, int z) {
+    return (uint32_t)x | (uint32_t)y << 11 | (uint32_t)z << 21;
+}
+
+void net_unpack_block(uint32_t packed, int *x, int *y, int *z) {
+    *x = (int)(packed & 0x7FF);
+    *y = (int)((packed >> 11) & 0x3FF);
+    *z = (int)(packed >> 21);
+}
+
+int16_t net_quantize(float v) {
+    float q = roundf(v * NET_POSITION_SCALE);
+    if (q < -32768.0f) {
+        return -32768;
+    }
+    if (q > 32767.0f) {
+        return 32767;
+    }
+    return (int16_t)q;
+}
+
+float net_dequantize(int16_t v) {
+    return (float)v / NET_POSITION_SCALE;
+}
+
+bool net_compress_chunk(const Chunk *chunk, NetBuffer &out) {
+    TRACE_SCOPE("net_compress_chunk");
+
+    size_t start = out.size();
+    uLongf size = compressBound(sizeof(chunk->blocks));
+    out.resize(start + size);
+    int result = compress2(out.data() + start, &size, &chunk->blocks[0][0][0], sizeof(chunk->blocks), Z_BEST_SPEED);
+    if (result != Z_OK) {
+        fprintf(stderr, "Failed to compress chunk: %d\n", result);
+        out.resize(start);
+        return false;
+    }
+    out.resize(start + size);
+    return true;
+}
+
+bool net_decompress_chunk(const uint8_t *data, size_t size, uint8_t *blocks) {
+    uLongf blocks_size = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+    int result = uncompress(blocks, &blocks_size, data, size);
+    return result == Z_OK && blocks_size == CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+}
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// small messages every tick, waiting to batch them only adds latency
+static void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int net_listen(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0 || !set_nonblocking(fd)) {
+        fprintf(stderr, "Failed to listen on port %d: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int net_accept(int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fprintf(stderr, "Failed to accept connection: %s\n", strerror(errno));
+        }
+        return -1;
+    }
+    if (!set_nonblocking(fd)) {
+        fprintf(stderr, "Failed to make connection non-blocking: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    set_nodelay(fd);
+    return fd;
+}
+
+int net_connect(const char *host, int port) {
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = NULL;
+    int result = getaddrinfo(host, service, &hints, &addresses);
+    if (result != 0) {
+        fprintf(stderr, "Failed to resolve %s: %s\n", host, gai_strerror(result));
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo *a = addresses; a != NULL; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+
+    if (fd < 0) {
+        fprintf(stderr, "Failed to connect to %s:%d\n", host, port);
+        return -1;
+    }
+    if (!set_nonblocking(fd)) {
+        fprintf(stderr, "Failed to make connection non-blocking: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    set_nodelay(fd);
+    return fd;
+}
+
+void net_close(int fd) {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void net_connection_init(NetConnection *conn, int fd) {
+    conn->fd = fd;
+    conn->in.clear();
+    conn->out.clear();
+    conn->out_sent = 0;
+    conn->bytes_sent = 0;
+    conn->bytes_received = 0;
+    conn->closed = false;
+}
+
+void net_connection_close(NetConnection *conn) {
+    net_close(conn->fd);
+    conn->fd = -1;
+    conn->closed = true;
+    conn->in = NetBuffer();
+    conn->out = NetBuffer();
+    conn->out_sent = 0;
+}
+
+void net_receive(NetConnection *conn) {
+    if (conn->fd < 0 || conn->closed) {
+        return;
+    }
+    uint8_t buffer[NET_RECEIVE_CHUNK];
+    for (;;) {
+        ssize_t n = recv(conn->fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            net_put_bytes(conn->in, buffer, (size_t)n);
+            conn->bytes_received += (uint64_t)n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        conn->closed = true;
+        return;
+    }
+}
+
+void net_flush(NetConnection *conn) {
+    if (conn->closed) {
+        return;
+    }
+    if (conn->fd < 0) {
+        conn->bytes_sent += conn->out.size() - conn->out_sent;
+        conn->out.clear();
+        conn->out_sent = 0;
+        return;
+    }
+    while (conn->out_sent < conn->out.size()) {
+        ssize_t n = send(conn->fd, conn->out.data() + conn->out_sent, conn->out.size() - conn->out_sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->out_sent += (size_t)n;
+            conn->bytes_sent += (uint64_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        conn->closed = true;
+        return;
+    }
+
+    // drop the sent front once it's most of the buffer, not on every call
+    if (conn->out_sent == conn->out.size()) {
+        conn->out.clear();
+        conn->out_sent = 0;
+    } else if (conn->out_sent > conn->out.size() / 2) {
+        conn->out.erase(conn->out.begin(), conn->out.begin() + (ptrdiff_t)conn->out_sent);
+        conn->out_sent = 0;
+    }
+}
+
+size_t net_unsent(const NetConnection *conn) {
+    return conn->out.size() - conn->out_sent;
+}
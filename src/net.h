@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "chunk.h"
+#include "memory.h"
+
+// Client/server protocol over TCP. Every message is a little endian u32
+// length (counting the type byte and the payload), a u8 NetMessage type and
+// the payload. Positions of entities are fixed point, 1/NET_POSITION_SCALE
+// of a block, block positions are packed into a u32 by net_pack_block.
+
+#define NET_PROTOCOL_VERSION 2
+#define NET_DEFAULT_PORT 25570
+#define NET_HEADER_SIZE 5
+// bigger messages are treated as a corrupt stream
+#define NET_MAX_MESSAGE (1 << 20)
+#define NET_POSITION_SCALE 16.0f
+// largest world net_pack_block can address, in blocks
+#define NET_MAX_BLOCKS_X 2048
+#define NET_MAX_BLOCKS_Y 1024
+#define NET_MAX_BLOCKS_Z 2048
+
+enum NetMessage : uint8_t {
+    // client -> server
+    NET_HELLO = 1,      // u32 protocol version
+    NET_INPUT,          // i8 move x, i8 move z (-127..127 of full speed), u8 NetButton
+    NET_SET_BLOCK,      // u32 block position, u8 block
+
+    // server -> client
+    // u32 player entity, u16 world size x y z in chunks, u32 tick; sent
+    // again with the new player when it respawns
+    NET_WELCOME = 64,
+    NET_CHUNK,          // u16 cx cy cz, zlib compressed Chunk::blocks
+    NET_UNLOAD,         // u16 cx cy cz
+    NET_TICK,           // see server_send
+    NET_BYE,            // nothing, the server closes the connection after it
+};
+
+enum NetButton : uint8_t {
+    NET_BUTTON_JUMP = 1 << 0,
+};
+
+typedef std::vector<uint8_t, TagAllocator<uint8_t, MEM_NET>> NetBuffer;
+
+template <class T>
+using NetVector = std::vector<T, TagAllocator<T, MEM_NET>>;
+
+// --- encoding ---
+
+void net_put_u8(NetBuffer &out, uint8_t v);
+void net_put_u16(NetBuffer &out, uint16_t v);
+void net_put_u32(NetBuffer &out, uint32_t v);
+void net_put_i8(NetBuffer &out, int8_t v);
+void net_put_i16(NetBuffer &out, int16_t v);
+void net_put_bytes(NetBuffer &out, const void *data, size_t size);
+
+// Starts a message of `type`, returns what net_end_message needs to patch
+// in its length.
+size_t net_begin_message(NetBuffer &out, NetMessage type);
+void net_end_message(NetBuffer &out, size_t start);
+
+// Reads a payload, past the end every getter returns 0 and clears `ok`.
+struct NetReader {
+    const uint8_t *p;
+    const uint8_t *end;
+    bool ok;
+};
+
+uint8_t net_get_u8(NetReader *r);
+uint16_t net_get_u16(NetReader *r);
+uint32_t net_get_u32(NetReader *r);
+int8_t net_get_i8(NetReader *r);
+int16_t net_get_i16(NetReader *r);
+// Points at the next `size` bytes and skips them, NULL if there aren't enough.
+const uint8_t *net_get_bytes(NetReader *r, size_t size);
+
+// Finds the first complete message in `data`. Returns 0 if it isn't all
+// there yet, -1 on a corrupt stream, otherwise the bytes it takes up.
+int64_t net_next_message(const uint8_t *data, size_t size, NetMessage *type, NetReader *payload);
+
+uint32_t net_pack_block(int x, int y, int z);
+void net_unpack_block(uint32_t packed, int *x, int *y, int *z);
+
+int16_t net_quantize(float v);
+float net_dequantize(int16_t v);
+
+// zlib level 1: snapshots are cached on the server, but sand keeps
+// invalidating them, so compression time counts as much as size.
+// Appends the compressed blocks of `chunk` to `out`.
+bool net_compress_chunk(const Chunk *chunk, NetBuffer &out);
+// Fills `blocks` (CHUNK_SIZE^3 bytes in Chunk::blocks order).
+bool net_decompress_chunk(const uint8_t *data, size_t size, uint8_t *blocks);
+
+// --- sockets ---
+
+// One TCP stream with its unsent and unparsed bytes. A connection with fd -1
+// has no socket and throws away what it sends, benchmarks use it.
+struct NetConnection {
+    int fd;
+    NetBuffer in;         // received, not parsed yet
+    NetBuffer out;        // queued, out_sent of them already sent
+    size_t out_sent;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    bool closed;          // error or end of stream
+};
+
+// Non-blocking listening socket on all interfaces, -1 on failure.
+int net_listen(int port);
+// Next pending connection or -1, never blocks.
+int net_accept(int listen_fd);
+// Blocks until connected, -1 on failure. The socket is non-blocking after.
+int net_connect(const char *host, int port);
+void net_close(int fd);
+
+void net_connection_init(NetConnection *conn, int fd);
+void net_connection_close(NetConnection *conn);
+// Reads what has arrived without blocking. Sets `closed` on errors.
+void net_receive(NetConnection *conn);
+// Sends as much of `out` as the socket takes without blocking.
+void net_flush(NetConnection *conn);
+size_t net_unsent(const NetConnection *conn);
@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "particle.h"
+#include "render.h"
+#include "trace.h"
+
+static_assert(PARTICLE_WINDOW % 32 == 0, "a row of blocks must fill whole words of the solid bit mask");
+
+static const char *KERNEL_NAMES[PARTICLE_KERNEL_COUNT] = {
+    "scalar",
+    "sse2",
+    "avx2",
+};
+
+// billboard corners, drawn as a triangle strip
+static const float QUAD_CORNERS[] = {
+    -0.5f, -0.5f,
+    0.5f, -0.5f,
+    -0.5f, 0.5f,
+    0.5f, 0.5f,
+};
+
+bool particle_init(ParticleSystem *particles, uint32_t capacity, uint32_t seed) {
+    capacity = (capacity + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES;
+    size_t bytes = (size_t)capacity * PARTICLE_FIELD_COUNT * sizeof(float);
+    particles->storage = (float *)mem_malloc(MEM_PARTICLES, bytes);
+    if (particles->storage == NULL) {
+        fprintf(stderr, "Failed to allocate %u particles\n", capacity);
+        return false;
+    }
+    // the padding lanes past count are computed too, keep them finite
+    memset(particles->storage, 0, bytes);
+    for (int f = 0; f < PARTICLE_FIELD_COUNT; f++) {
+        particles->fields[f] = particles->storage + (size_t)f * capacity;
+    }
+
+    particles->count = 0;
+    particles->capacity = capacity;
+    particles->kernel = particle_best_kernel();
+    memset(particles->solid, 0, sizeof(particles->solid));
+    particles->origin = glm::ivec3(0);
+    particles->rng = seed ? seed : 1;
+    particles->spawn_carry = 0.0f;
+    particles->vao = 0;
+    particles->quad_vbo = 0;
+    particles->instance_vbo = 0;
+
+    return true;
+}
+
+void particle_init_gl(ParticleSystem *particles) {
+    glGenVertexArrays(1, &particles->vao);
+    glGenBuffers(1, &particles->quad_vbo);
+    glGenBuffers(1, &particles->instance_vbo);
+
+    glBindVertexArray(particles->vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, particles->quad_vbo);
+    gpu_buffer_data(MEM_PARTICLES, particles->quad_vbo, GL_ARRAY_BUFFER, sizeof(QUAD_CORNERS), QUAD_CORNERS, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+
+    // every draw field is its own stream of capacity floats
+    size_t field_bytes = (size_t)particles->capacity * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, particles->instance_vbo);
+    gpu_buffer_data(MEM_PARTICLES, particles->instance_vbo, GL_ARRAY_BUFFER, field_bytes * PARTICLE_DRAW_FIELDS, NULL, GL_STREAM_DRAW);
+    for (int f = 0; f < PARTICLE_DRAW_FIELDS; f++) {
+        glVertexAttribPointer(1 + f, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)(f * field_bytes));
+        glEnableVertexAttribArray(1 + f);
+        glVertexAttribDivisor(1 + f, 1);
+    }
+
+    glBindVertexArray(0);
+}
+
+void particle_destroy(ParticleSystem *particles) {
+    mem_free(MEM_PARTICLES, particles->storage);
+    particles->storage = NULL;
+    particles->count = 0;
+    particles->capacity = 0;
+
+    if (particles->vao) {
+        glDeleteVertexArrays(1, &particles->vao);
+        gpu_delete_buffers(1, &particles->quad_vbo);
+        gpu_delete_buffers(1, &particles->instance_vbo);
+        particles->vao = 0;
+    }
+}
+
+ParticleKernel particle_best_kernel() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return PARTICLE_KERNEL_AVX2;
+    }
+    // part of x86-64
+    return PARTICLE_KERNEL_SSE2;
+#else
+    return PARTICLE_KERNEL_SCALAR;
+#endif
+}
+
+const char *particle_kernel_name(ParticleKernel kernel) {
+    return KERNEL_NAMES[kernel];
+}
+
+void particle_set_world(ParticleSystem *particles, const World *world, glm::ivec3 origin) {
+    particles->origin = origin;
+    for (int x = 0; x < PARTICLE_WINDOW; x++) {
+        for (int y = 0; y < PARTICLE_WINDOW; y++) {
+            uint32_t *row = &particles->solid[(x * PARTICLE_WINDOW + y) * PARTICLE_WINDOW_WORDS];
+            memset(row, 0, PARTICLE_WINDOW_WORDS * sizeof(uint32_t));
+            for (int z = 0; z < PARTICLE_WINDOW; z++) {
+                if (world_get_block(world, origin.x + x, origin.y + y, origin.z + z) != BLOCK_AIR) {
+                    row[z >> 5] |= 1u << (z & 31);
+                }
+            }
+        }
+    }
+}
+
+// [lo, hi), xorshift32 so replays emit the same particles
+static float particle_random(ParticleSystem *particles, float lo, float hi) {
+    uint32_t x = particles->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    particles->rng = x;
+    return lo + (hi - lo) * (float)(x >> 8) / (float)(1u << 24);
+}
+
+// Random PARTICLE_UV_FRACTION sized part of an atlas rect.
+static glm::vec4 particle_random_uv(ParticleSystem *particles, glm::vec4 uv) {
+    float w = (uv.z - uv.x) * PARTICLE_UV_FRACTION;
+    float h = (uv.w - uv.y) * PARTICLE_UV_FRACTION;
+    float x = uv.x + particle_random(particles, 0.0f, 1.0f - PARTICLE_UV_FRACTION) * (uv.z - uv.x);
+    float y = uv.y + particle_random(particles, 0.0f, 1.0f - PARTICLE_UV_FRACTION) * (uv.w - uv.y);
+    return glm::vec4(x, y, x + w, y + h);
+}
+
+bool particle_spawn(ParticleSystem *particles, const ParticleSpawn &spawn) {
+    if (particles->count >= particles->capacity) {
+        return false;
+    }
+    uint32_t i = particles->count++;
+    float **f = particles->fields;
+
+    f[PARTICLE_POS_X][i] = spawn.position.x;
+    f[PARTICLE_POS_Y][i] = spawn.position.y;
+    f[PARTICLE_POS_Z][i] = spawn.position.z;
+    f[PARTICLE_SIZE][i] = spawn.size;
+    f[PARTICLE_UV_X1][i] = spawn.uv.x;
+    f[PARTICLE_UV_Y1][i] = spawn.uv.y;
+    f[PARTICLE_UV_X2][i] = spawn.uv.z;
+    f[PARTICLE_UV_Y2][i] = spawn.uv.w;
+    f[PARTICLE_VEL_X][i] = spawn.velocity.x;
+    f[PARTICLE_VEL_Y][i] = spawn.velocity.y;
+    f[PARTICLE_VEL_Z][i] = spawn.velocity.z;
+    f[PARTICLE_GRAVITY_SCALE][i] = spawn.gravity;
+    f[PARTICLE_LIFE][i] = spawn.life;
+    f[PARTICLE_REST][i] = spawn.rest;
+
+    return true;
+}
+
+void particle_emit_weather(ParticleSystem *particles, const Weather *weather, glm::vec3 center, float dt) {
+    float wanted = weather->rate * dt + particles->spawn_carry;
+    int count = (int)wanted;
+    particles->spawn_carry = wanted - (float)count;
+
+    float r = weather->radius;
+    float drift = weather->drift;
+    for (int i = 0; i < count; i++) {
+        ParticleSpawn spawn = {
+            .position = center + glm::vec3(
+                particle_random(particles, -r, r),
+                weather->height,
+                particle_random(particles, -r, r)
+            ),
+            .velocity = glm::vec3(
+                particle_random(particles, -drift, drift),
+                -weather->fall_speed,
+                particle_random(particles, -drift, drift)
+            ),
+            .gravity = 0.0f,
+            .life = weather->life,
+            .rest = weather->rest,
+            .size = weather->size,
+            .uv = particle_random_uv(particles, weather->uv),
+        };
+        if (!particle_spawn(particles, spawn)) {
+            // full, don't save up a burst for later
+            particles->spawn_carry = 0.0f;
+            break;
+        }
+    }
+}
+
+void particle_emit_block(ParticleSystem *particles, glm::vec3 center, glm::vec4 uv, int count) {
+    for (int i = 0; i < count; i++) {
+        glm::vec3 offset(
+            particle_random(particles, -0.4f, 0.4f),
+            particle_random(particles, -0.4f, 0.4f),
+            particle_random(particles, -0.4f, 0.4f)
+        );
+        float life = particle_random(particles, 1.0f, 2.0f);
+        ParticleSpawn spawn = {
+            .position = center + offset,
+            .velocity = offset * 4.0f + glm::vec3(0.0f, particle_random(particles, 2.0f, 5.0f), 0.0f),
+            .gravity = 1.0f,
+            .life = life,
+            .rest = life,
+            .size = particle_random(particles, 0.15f, 0.25f),
+            .uv = particle_random_uv(particles, uv),
+        };
+        if (!particle_spawn(particles, spawn)) {
+            break;
+        }
+    }
+}
+
+// All kernels do the same per particle: apply gravity, move, and if the
+// new position is inside a solid block stay at the old one, stop and cut
+// the life down to the rest time. `count` is a multiple of PARTICLE_LANES.
+
+static void update_scalar(ParticleSystem *particles, uint32_t count, float dt) {
+    float **f = particles->fields;
+    const uint32_t *solid = particles->solid;
+    glm::vec3 origin = glm::vec3(particles->origin) - 0.5f;
+    float g = PARTICLE_GRAVITY * dt;
+
+    for (uint32_t i = 0; i < count; i++) {
+        float vx = f[PARTICLE_VEL_X][i];
+        float vy = f[PARTICLE_VEL_Y][i] - f[PARTICLE_GRAVITY_SCALE][i] * g;
+        float vz = f[PARTICLE_VEL_Z][i];
+        if (vy < -PARTICLE_TERMINAL_VELOCITY) {
+            vy = -PARTICLE_TERMINAL_VELOCITY;
+        }
+        float x = f[PARTICLE_POS_X][i] + vx * dt;
+        float y = f[PARTICLE_POS_Y][i] + vy * dt;
+        float z = f[PARTICLE_POS_Z][i] + vz * dt;
+        float life = f[PARTICLE_LIFE][i] - dt;
+
+        // block i covers [i - 0.5, i + 0.5], truncation is floor once positive
+        float bx = x - origin.x;
+        float by = y - origin.y;
+        float bz = z - origin.z;
+        if (bx >= 0.0f && bx < PARTICLE_WINDOW && by >= 0.0f && by < PARTICLE_WINDOW && bz >= 0.0f && bz < PARTICLE_WINDOW
+            && (solid[((int)bx * PARTICLE_WINDOW + (int)by) * PARTICLE_WINDOW_WORDS + ((int)bz >> 5)] >> ((int)bz & 31)) & 1) {
+            x = f[PARTICLE_POS_X][i];
+            y = f[PARTICLE_POS_Y][i];
+            z = f[PARTICLE_POS_Z][i];
+            vx = 0.0f;
+            vy = 0.0f;
+            vz = 0.0f;
+            if (life > f[PARTICLE_REST][i]) {
+                life = f[PARTICLE_REST][i];
+            }
+        }
+        if (y < PARTICLE_KILL_Y) {
+            life = 0.0f;
+        }
+
+        f[PARTICLE_POS_X][i] = x;
+        f[PARTICLE_POS_Y][i] = y;
+        f[PARTICLE_POS_Z][i] = z;
+        f[PARTICLE_VEL_X][i] = vx;
+        f[PARTICLE_VEL_Y][i] = vy;
+        f[PARTICLE_VEL_Z][i] = vz;
+        f[PARTICLE_LIFE][i] = life;
+    }
+}
+
+#if defined(__x86_64__)
+
+static inline __m128 select_sse2(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+
+// SSE2 has no gather or per-lane shift, the block lookups are scalar but
+// only run for the lanes inside the window.
+static void update_sse2(ParticleSystem *particles, uint32_t count, float dt) {
+    float **f = particles->fields;
+    const uint32_t *solid = particles->solid;
+
+    const __m128 vdt = _mm_set1_ps(dt);
+    const __m128 vg = _mm_set1_ps(PARTICLE_GRAVITY * dt);
+    const __m128 terminal = _mm_set1_ps(-PARTICLE_TERMINAL_VELOCITY);
+    const __m128 origin_x = _mm_set1_ps(particles->origin.x - 0.5f);
+    const __m128 origin_y = _mm_set1_ps(particles->origin.y - 0.5f);
+    const __m128 origin_z = _mm_set1_ps(particles->origin.z - 0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 size = _mm_set1_ps((float)PARTICLE_WINDOW);
+    const __m128 kill = _mm_set1_ps(PARTICLE_KILL_Y);
+
+    for (uint32_t i = 0; i < count; i += 4) {
+        __m128 vx = _mm_loadu_ps(f[PARTICLE_VEL_X] + i);
+        __m128 vy = _mm_sub_ps(_mm_loadu_ps(f[PARTICLE_VEL_Y] + i), _mm_mul_ps(_mm_loadu_ps(f[PARTICLE_GRAVITY_SCALE] + i), vg));
+        __m128 vz = _mm_loadu_ps(f[PARTICLE_VEL_Z] + i);
+        vy = _mm_max_ps(vy, terminal);
+
+        __m128 ox = _mm_loadu_ps(f[PARTICLE_POS_X] + i);
+        __m128 oy = _mm_loadu_ps(f[PARTICLE_POS_Y] + i);
+        __m128 oz = _mm_loadu_ps(f[PARTICLE_POS_Z] + i);
+        __m128 x = _mm_add_ps(ox, _mm_mul_ps(vx, vdt));
+        __m128 y = _mm_add_ps(oy, _mm_mul_ps(vy, vdt));
+        __m128 z = _mm_add_ps(oz, _mm_mul_ps(vz, vdt));
+        __m128 life = _mm_sub_ps(_mm_loadu_ps(f[PARTICLE_LIFE] + i), vdt);
+
+        __m128 bx = _mm_sub_ps(x, origin_x);
+        __m128 by = _mm_sub_ps(y, origin_y);
+        __m128 bz = _mm_sub_ps(z, origin_z);
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(bx, zero), _mm_cmplt_ps(bx, size));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(by, zero), _mm_cmplt_ps(by, size)));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(bz, zero), _mm_cmplt_ps(bz, size)));
+
+        __m128 hit = zero;
+        int lanes = _mm_movemask_ps(inside);
+        if (lanes) {
+            alignas(16) int32_t ix[4];
+            alignas(16) int32_t iy[4];
+            alignas(16) int32_t iz[4];
+            alignas(16) int32_t hits[4];
+            _mm_store_si128((__m128i *)ix, _mm_cvttps_epi32(bx));
+            _mm_store_si128((__m128i *)iy, _mm_cvttps_epi32(by));
+            _mm_store_si128((__m128i *)iz, _mm_cvttps_epi32(bz));
+            for (int l = 0; l < 4; l++) {
+                bool solid_block = (lanes >> l) & 1
+                    && (solid[(ix[l] * PARTICLE_WINDOW + iy[l]) * PARTICLE_WINDOW_WORDS + (iz[l] >> 5)] >> (iz[l] & 31)) & 1;
+                hits[l] = solid_block ? -1 : 0;
+            }
+            hit = _mm_castsi128_ps(_mm_load_si128((const __m128i *)hits));
+        }
+
+        x = select_sse2(hit, x, ox);
+        y = select_sse2(hit, y, oy);
+        z = select_sse2(hit, z, oz);
+        vx = _mm_andnot_ps(hit, vx);
+        vy = _mm_andnot_ps(hit, vy);
+        vz = _mm_andnot_ps(hit, vz);
+        life = select_sse2(hit, life, _mm_min_ps(life, _mm_loadu_ps(f[PARTICLE_REST] + i)));
+        life = _mm_andnot_ps(_mm_cmplt_ps(y, kill), life);
+
+        _mm_storeu_ps(f[PARTICLE_POS_X] + i, x);
+        _mm_storeu_ps(f[PARTICLE_POS_Y] + i, y);
+        _mm_storeu_ps(f[PARTICLE_POS_Z] + i, z);
+        _mm_storeu_ps(f[PARTICLE_VEL_X] + i, vx);
+        _mm_storeu_ps(f[PARTICLE_VEL_Y] + i, vy);
+        _mm_storeu_ps(f[PARTICLE_VEL_Z] + i, vz);
+        _mm_storeu_ps(f[PARTICLE_LIFE] + i, life);
+    }
+}
+
+// Built for AVX2 regardless of the compiler flags, only called when the
+// CPU has it.
+__attribute__((target("avx2")))
+static void update_avx2(ParticleSystem *particles, uint32_t count, float dt) {
+    float **f = particles->fields;
+    const int *solid = (const int *)particles->solid;
+
+    const __m256 vdt = _mm256_set1_ps(dt);
+    const __m256 vg = _mm256_set1_ps(PARTICLE_GRAVITY * dt);
+    const __m256 terminal = _mm256_set1_ps(-PARTICLE_TERMINAL_VELOCITY);
+    const __m256 origin_x = _mm256_set1_ps(particles->origin.x - 0.5f);
+    const __m256 origin_y = _mm256_set1_ps(particles->origin.y - 0.5f);
+    const __m256 origin_z = _mm256_set1_ps(particles->origin.z - 0.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 size = _mm256_set1_ps((float)PARTICLE_WINDOW);
+    const __m256 kill = _mm256_set1_ps(PARTICLE_KILL_Y);
+    const __m256i row = _mm256_set1_epi32(PARTICLE_WINDOW);
+    const __m256i words = _mm256_set1_epi32(PARTICLE_WINDOW_WORDS);
+    const __m256i bit = _mm256_set1_epi32(31);
+    const __m256i one = _mm256_set1_epi32(1);
+
+    for (uint32_t i = 0; i < count; i += 8) {
+        __m256 vx = _mm256_loadu_ps(f[PARTICLE_VEL_X] + i);
+        __m256 vy = _mm256_sub_ps(_mm256_loadu_ps(f[PARTICLE_VEL_Y] + i), _mm256_mul_ps(_mm256_loadu_ps(f[PARTICLE_GRAVITY_SCALE] + i), vg));
+        __m256 vz = _mm256_loadu_ps(f[PARTICLE_VEL_Z] + i);
+        vy = _mm256_max_ps(vy, terminal);
+
+        __m256 ox = _mm256_loadu_ps(f[PARTICLE_POS_X] + i);
+        __m256 oy = _mm256_loadu_ps(f[PARTICLE_POS_Y] + i);
+        __m256 oz = _mm256_loadu_ps(f[PARTICLE_POS_Z] + i);
+        __m256 x = _mm256_add_ps(ox, _mm256_mul_ps(vx, vdt));
+        __m256 y = _mm256_add_ps(oy, _mm256_mul_ps(vy, vdt));
+        __m256 z = _mm256_add_ps(oz, _mm256_mul_ps(vz, vdt));
+        __m256 life = _mm256_sub_ps(_mm256_loadu_ps(f[PARTICLE_LIFE] + i), vdt);
+
+        __m256 bx = _mm256_sub_ps(x, origin_x);
+        __m256 by = _mm256_sub_ps(y, origin_y);
+        __m256 bz = _mm256_sub_ps(z, origin_z);
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(bx, zero, _CMP_GE_OQ), _mm256_cmp_ps(bx, size, _CMP_LT_OQ));
+        inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(by, zero, _CMP_GE_OQ), _mm256_cmp_ps(by, size, _CMP_LT_OQ)));
+        inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(bz, zero, _CMP_GE_OQ), _mm256_cmp_ps(bz, size, _CMP_LT_OQ)));
+
+        __m256 hit = zero;
+        if (_mm256_movemask_ps(inside)) {
+            // lanes outside the window are masked off the gather and read 0
+            __m256i iz = _mm256_cvttps_epi32(bz);
+            __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(bx), row), _mm256_cvttps_epi32(by));
+            index = _mm256_add_epi32(_mm256_mullo_epi32(index, words), _mm256_srli_epi32(iz, 5));
+            __m256i rows = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), solid, index, _mm256_castps_si256(inside), 4);
+            __m256i bits = _mm256_and_si256(_mm256_srlv_epi32(rows, _mm256_and_si256(iz, bit)), one);
+            hit = _mm256_castsi256_ps(_mm256_cmpeq_epi32(bits, one));
+        }
+
+        x = _mm256_blendv_ps(x, ox, hit);
+        y = _mm256_blendv_ps(y, oy, hit);
+        z = _mm256_blendv_ps(z, oz, hit);
+        vx = _mm256_andnot_ps(hit, vx);
+        vy = _mm256_andnot_ps(hit, vy);
+        vz = _mm256_andnot_ps(hit, vz);
+        life = _mm256_blendv_ps(life, _mm256_min_ps(life, _mm256_loadu_ps(f[PARTICLE_REST] + i)), hit);
+        life = _mm256_andnot_ps(_mm256_cmp_ps(y, kill, _CMP_LT_OQ), life);
+
+        _mm256_storeu_ps(f[PARTICLE_POS_X] + i, x);
+        _mm256_storeu_ps(f[PARTICLE_POS_Y] + i, y);
+        _mm256_storeu_ps(f[PARTICLE_POS_Z] + i, z);
+        _mm256_storeu_ps(f[PARTICLE_VEL_X] + i, vx);
+        _mm256_storeu_ps(f[PARTICLE_VEL_Y] + i, vy);
+        _mm256_storeu_ps(f[PARTICLE_VEL_Z] + i, vz);
+        _mm256_storeu_ps(f[PARTICLE_LIFE] + i, life);
+    }
+}
+
+#endif
+
+void particle_update(ParticleSystem *particles, float dt) {
+    TRACE_SCOPE("particle_update");
+
+    uint32_t lanes = (particles->count + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES;
+    switch (particles->kernel) {
+#if defined(__x86_64__)
+    case PARTICLE_KERNEL_AVX2:
+        update_avx2(particles, lanes, dt);
+        break;
+    case PARTICLE_KERNEL_SSE2:
+        update_sse2(particles, lanes, dt);
+        break;
+#endif
+    default:
+        update_scalar(particles, lanes, dt);
+        break;
+    }
+
+    // the last particle moves into every dead slot, order doesn't matter
+    float **f = particles->fields;
+    const float *life = f[PARTICLE_LIFE];
+    uint32_t i = 0;
+    while (i < particles->count) {
+        if (life[i] > 0.0f) {
+            i++;
+            continue;
+        }
+        uint32_t last = --particles->count;
+        for (int field = 0; field < PARTICLE_FIELD_COUNT; field++) {
+            f[field][i] = f[field][last];
+        }
+    }
+}
+
+void particle_upload(ParticleSystem *particles) {
+    TRACE_SCOPE("particle_upload");
+
+    size_t field_bytes = (size_t)particles->capacity * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, particles->instance_vbo);
+    // orphan, last frame's draw may still read the old storage
+    glBufferData(GL_ARRAY_BUFFER, field_bytes * PARTICLE_DRAW_FIELDS, NULL, GL_STREAM_DRAW);
+    if (particles->count == 0) {
+        return;
+    }
+    for (int f = 0; f < PARTICLE_DRAW_FIELDS; f++) {
+        glBufferSubData(GL_ARRAY_BUFFER, f * field_bytes, particles->count * sizeof(float), particles->fields[f]);
+    }
+}
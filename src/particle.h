@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "memory.h"
+#include "world.h"
+
+// Particles live in chunk space like blocks and entities, and collide as
+// points with the blocks of a window of the world, moved along with the
+// camera.
+
+#define PARTICLE_GRAVITY 24.0f
+#define PARTICLE_TERMINAL_VELOCITY 40.0f
+// particles falling below this die
+#define PARTICLE_KILL_Y -32.0f
+// arrays are padded to a multiple of this, kernels never run a scalar tail
+#define PARTICLE_LANES 8
+// emitters sample this fraction of their atlas rect per particle
+#define PARTICLE_UV_FRACTION 0.25f
+// side of the collision window in blocks, a row of it is this many words
+// of bits
+#define PARTICLE_WINDOW 64
+#define PARTICLE_WINDOW_WORDS (PARTICLE_WINDOW / 32)
+
+// One float array per field. The first PARTICLE_DRAW_FIELDS are uploaded
+// as they are, one instanced vertex attribute each.
+enum ParticleField {
+    PARTICLE_POS_X = 0,
+    PARTICLE_POS_Y,
+    PARTICLE_POS_Z,
+    PARTICLE_SIZE,
+    PARTICLE_UV_X1,
+    PARTICLE_UV_Y1,
+    PARTICLE_UV_X2,
+    PARTICLE_UV_Y2,
+    PARTICLE_VEL_X,
+    PARTICLE_VEL_Y,
+    PARTICLE_VEL_Z,
+    PARTICLE_GRAVITY_SCALE,
+    PARTICLE_LIFE,   // seconds left
+    PARTICLE_REST,   // life left at most after touching a block
+
+    PARTICLE_FIELD_COUNT
+};
+
+#define PARTICLE_DRAW_FIELDS (PARTICLE_UV_Y2 + 1)
+
+enum ParticleKernel {
+    PARTICLE_KERNEL_SCALAR = 0,
+    PARTICLE_KERNEL_SSE2,
+    PARTICLE_KERNEL_AVX2,
+
+    PARTICLE_KERNEL_COUNT
+};
+
+struct ParticleSpawn {
+    glm::vec3 position;
+    glm::vec3 velocity;
+    float gravity;   // 0 falls at a constant speed
+    float life;
+    float rest;
+    float size;
+    glm::vec4 uv;    // atlas rect x1, y1, x2, y2
+};
+
+// Continuous precipitation over a square around a center.
+struct Weather {
+    float rate;      // particles per second
+    float radius;    // half the side of the square
+    float height;    // spawn height above the center
+    float fall_speed;
+    float drift;     // max sideways speed
+    float life;
+    float rest;
+    float size;
+    glm::vec4 uv;
+};
+
+// Fixed capacity set of live particles, dead ones are compacted away after
+// every update. Nothing is allocated after particle_init.
+struct ParticleSystem {
+    float *fields[PARTICLE_FIELD_COUNT];
+    float *storage;
+    uint32_t count;
+    uint32_t capacity;
+
+    ParticleKernel kernel;
+    // solid blocks of the window from `origin`, relative to it bit z % 32
+    // of word (x * PARTICLE_WINDOW + y) * PARTICLE_WINDOW_WORDS + z / 32
+    uint32_t solid[PARTICLE_WINDOW * PARTICLE_WINDOW * PARTICLE_WINDOW_WORDS];
+    glm::ivec3 origin;
+
+    uint32_t rng;
+    float spawn_carry;  // fraction of a weather particle left from last time
+
+    GLuint vao;
+    GLuint quad_vbo;
+    GLuint instance_vbo;
+};
+
+// CPU side only. Picks the fastest kernel the CPU supports.
+bool particle_init(ParticleSystem *particles, uint32_t capacity, uint32_t seed);
+// Creates the billboard quad and the instance buffer, needs the GL context.
+void particle_init_gl(ParticleSystem *particles);
+void particle_destroy(ParticleSystem *particles);
+
+ParticleKernel particle_best_kernel();
+const char *particle_kernel_name(ParticleKernel kernel);
+
+// Takes a snapshot of the solid blocks of the window from block `origin`,
+// call again after edits. Particles outside it collide with nothing.
+void particle_set_world(ParticleSystem *particles, const World *world, glm::ivec3 origin);
+
+// False when the system is full.
+bool particle_spawn(ParticleSystem *particles, const ParticleSpawn &spawn);
+// Spawns `dt` seconds worth of `weather` around `center`.
+void particle_emit_weather(ParticleSystem *particles, const Weather *weather, glm::vec3 center, float dt);
+// Bursts `count` pieces of a broken block out of the unit cube at `center`,
+// `uv` is the atlas rect of one of its faces.
+void particle_emit_block(ParticleSystem *particles, glm::vec3 center, glm::vec4 uv, int count);
+
+// Integrates, collides and ages every particle, then drops the dead ones.
+void particle_update(ParticleSystem *particles, float dt);
+
+// Copies the draw fields of the live particles into the instance buffer.
+// Leaves it bound to GL_ARRAY_BUFFER.
+void particle_upload(ParticleSystem *particles);
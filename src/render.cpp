@@ -0,0 +1,441 @@
+#include <string.h>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "render.h"
+#include "trace.h"
+
+#define STATE_UNKNOWN 0xFFFFFFFFu
+
+void state_reset(GLStateCache *state) {
+    state->program = STATE_UNKNOWN;
+    state->vao = STATE_UNKNOWN;
+    state->texture_2d = STATE_UNKNOWN;
+    state->texture_cube = STATE_UNKNOWN;
+    state->texture_3d = STATE_UNKNOWN;
+    state->blend = -1;
+    state->depth_test = -1;
+    state->depth_write = -1;
+    state->depth_func = STATE_UNKNOWN;
+}
+
+void state_use_program(GLStateCache *state, GLuint program) {
+    if (state->program != program) {
+        glUseProgram(program);
+        state->program = program;
+    }
+}
+
+void state_bind_vao(GLStateCache *state, GLuint vao) {
+    if (state->vao != vao) {
+        glBindVertexArray(vao);
+        state->vao = vao;
+    }
+}
+
+void state_bind_texture(GLStateCache *state, GLenum target, GLuint texture) {
+    GLuint *bound = &state->texture_2d;
+    if (target == GL_TEXTURE_CUBE_MAP) {
+        bound = &state->texture_cube;
+    } else if (target == GL_TEXTURE_3D) {
+        bound = &state->texture_3d;
+    }
+    if (*bound != texture) {
+        glBindTexture(target, texture);
+        *bound = texture;
+    }
+}
+
+static inline void set_capability(int *cached, GLenum cap, bool enabled) {
+    if (*cached != (int)enabled) {
+        if (enabled) {
+            glEnable(cap);
+        } else {
+            glDisable(cap);
+        }
+        *cached = (int)enabled;
+    }
+}
+
+void state_set_blend(GLStateCache *state, bool enabled) {
+    set_capability(&state->blend, GL_BLEND, enabled);
+}
+
+void state_set_depth_test(GLStateCache *state, bool enabled) {
+    set_capability(&state->depth_test, GL_DEPTH_TEST, enabled);
+}
+
+void state_set_depth_write(GLStateCache *state, bool enabled) {
+    if (state->depth_write != (int)enabled) {
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+        state->depth_write = (int)enabled;
+    }
+}
+
+void state_set_depth_func(GLStateCache *state, GLenum func) {
+    if (state->depth_func != func) {
+        glDepthFunc(func);
+        state->depth_func = func;
+    }
+}
+
+void state_set_pass(GLStateCache *state, RenderPass pass) {
+    switch (pass) {
+    case PASS_OPAQUE:
+        state_set_blend(state, false);
+        state_set_depth_test(state, true);
+        state_set_depth_write(state, true);
+        state_set_depth_func(state, GL_LESS);
+        break;
+    case PASS_FAR_FIELD:
+        state_set_blend(state, false);
+        state_set_depth_test(state, true);
+        state_set_depth_write(state, true);
+        state_set_depth_func(state, GL_LESS);
+        break;
+    case PASS_SKYBOX:
+        // skybox is projected onto the far plane, so it only shows up
+        // where the opaque pass left the cleared depth
+        state_set_blend(state, false);
+        state_set_depth_test(state, true);
+        state_set_depth_write(state, false);
+        state_set_depth_func(state, GL_LEQUAL);
+        break;
+    case PASS_TRANSLUCENT:
+        // tested against the opaque depth, but doesn't hide what is behind
+        state_set_blend(state, true);
+        state_set_depth_test(state, true);
+        state_set_depth_write(state, false);
+        state_set_depth_func(state, GL_LESS);
+        break;
+    case PASS_HUD:
+        state_set_blend(state, true);
+        state_set_depth_test(state, false);
+        state_set_depth_write(state, false);
+        break;
+    default:
+        break;
+    }
+}
+
+uint64_t render_key(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth) {
+    if (depth < 0.0f) {
+        depth = 0.0f;
+    }
+    if (depth > 1.0f) {
+        depth = 1.0f;
+    }
+    uint64_t d = (uint64_t)(depth * (float)0xFFFFFF);
+
+    if (pass == PASS_TRANSLUCENT) {
+        return ((uint64_t)(pass & 0xF) << 60)
+            | ((0xFFFFFF - d) << 36)
+            | ((uint64_t)(program & 0xFF) << 28)
+            | ((uint64_t)(texture & 0xFFFF) << 12)
+            | (uint64_t)(vao & 0xFFF);
+    }
+    return ((uint64_t)(pass & 0xF) << 60)
+        | ((uint64_t)(program & 0xFF) << 52)
+        | ((uint64_t)(texture & 0xFFFF) << 36)
+        | ((uint64_t)(vao & 0xFFF) << 24)
+        | d;
+}
+
+void render_queue_clear(RenderQueue *queue) {
+    queue->items.clear();
+    queue->keys.clear();
+    queue->sorted = false;
+}
+
+void render_queue_submit(RenderQueue *queue, const DrawItem &item) {
+    queue->sorted = false;
+    queue->items.push_back(item);
+    queue->keys.push_back(render_key(item.pass, item.program, item.texture, item.vao, item.depth));
+}
+
+void render_queue_sort(RenderQueue *queue) {
+    TRACE_SCOPE("render_queue_sort");
+
+    uint32_t n = (uint32_t)queue->keys.size();
+    const uint64_t *keys = queue->keys.data();
+
+    queue->order.resize(n);
+    queue->scratch.resize(n);
+    for (uint32_t i = 0; i < n; i++) {
+        queue->order[i] = i;
+    }
+
+    uint32_t *src = queue->order.data();
+    uint32_t *dst = queue->scratch.data();
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        uint32_t counts[256];
+        memset(counts, 0, sizeof(counts));
+        for (uint32_t i = 0; i < n; i++) {
+            counts[(keys[src[i]] >> shift) & 0xFF]++;
+        }
+
+        // all keys share this byte, nothing to reorder
+        if (n == 0 || counts[(keys[src[0]] >> shift) & 0xFF] == n) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            uint32_t c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            dst[counts[(keys[src[i]] >> shift) & 0xFF]++] = src[i];
+        }
+
+        uint32_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != queue->order.data()) {
+        memcpy(queue->order.data(), src, n * sizeof(uint32_t));
+    }
+    queue->sorted = true;
+}
+
+void render_queue_execute_passes(RenderQueue *queue, GLStateCache *state, RenderPass first, RenderPass last) {
+    TRACE_SCOPE("render_queue_execute");
+
+    if (!queue->sorted) {
+        render_queue_sort(queue);
+    }
+
+    int pass = -1;
+    for (uint32_t index : queue->order) {
+        const DrawItem &item = queue->items[index];
+        if (item.pass < first) {
+            continue;
+        }
+        if (item.pass > last) {
+            break;
+        }
+
+        if (item.pass != pass) {
+            state_set_pass(state, item.pass);
+            pass = item.pass;
+        }
+        state_use_program(state, item.program);
+        state_bind_vao(state, item.vao);
+        if (item.texture_target) {
+            state_bind_texture(state, item.texture_target, item.texture);
+        }
+        if (item.model) {
+            glUniformMatrix4fv(item.model_location, 1, GL_FALSE, glm::value_ptr(*item.model));
+        }
+        if (item.index_type) {
+            size_t index_size = item.index_type == GL_UNSIGNED_INT ? 4 : 2;
+            void *offset = (void *)((size_t)item.first * index_size);
+            if (item.instance_count > 0) {
+                glDrawElementsInstanced(item.mode, item.count, item.index_type, offset, item.instance_count);
+            } else {
+                glDrawElements(item.mode, item.count, item.index_type, offset);
+            }
+        } else if (item.instance_count > 0) {
+            glDrawArraysInstanced(item.mode, item.first, item.count, item.instance_count);
+        } else {
+            glDrawArrays(item.mode, item.first, item.count);
+        }
+    }
+}
+
+void render_queue_execute(RenderQueue *queue, GLStateCache *state) {
+    render_queue_execute_passes(queue, state, (RenderPass)0, (RenderPass)(PASS_COUNT - 1));
+}
+
+bool scene_target_resize(SceneTarget *target, int width, int height) {
+    if (target->fbo && target->width == width && target->height == height) {
+        return true;
+    }
+    scene_target_destroy(target);
+
+    target->width = width;
+    target->height = height;
+
+    glGenFramebuffers(1, &target->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+
+    glGenTextures(1, &target->color);
+    glBindTexture(GL_TEXTURE_2D, target->color);
+    gpu_tex_image_2d(MEM_RENDER, target->color, GL_TEXTURE_2D, 0, GL_RGBA8, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->color, 0);
+
+    glGenRenderbuffers(1, &target->depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, target->depth);
+    gpu_renderbuffer_storage(MEM_RENDER, target->depth, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->depth);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    return complete;
+}
+
+void scene_target_destroy(SceneTarget *target) {
+    if (target->fbo) {
+        glDeleteFramebuffers(1, &target->fbo);
+        gpu_delete_textures(1, &target->color);
+        gpu_delete_renderbuffers(1, &target->depth);
+    }
+    target->fbo = 0;
+    target->color = 0;
+    target->depth = 0;
+}
+
+void scene_target_upscale(
+    const SceneTarget *target,
+    int width,
+    int height,
+    int window_width,
+    int window_height
+) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target->fbo);
+    glBlitFramebuffer(
+        0, 0, width, height,
+        0, 0, window_width, window_height,
+        GL_COLOR_BUFFER_BIT,
+        GL_LINEAR
+    );
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void instance_buffer_upload(InstanceBuffer *instances, MemTag tag, const void *data, GLsizeiptr size) {
+    if (instances->buffer == 0) {
+        glGenBuffers(1, &instances->buffer);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, instances->buffer);
+
+    if (size > instances->capacity) {
+        // double, so a growing population reallocates only a few times
+        GLsizeiptr capacity = instances->capacity * 2;
+        if (capacity < size) {
+            capacity = size;
+        }
+        gpu_buffer_data(tag, instances->buffer, GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        instances->capacity = capacity;
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, instances->capacity, NULL, GL_STREAM_DRAW);
+    }
+    if (size > 0) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+    }
+}
+
+// Estimate only, drivers are free to pad rows or RGB to RGBA.
+static int64_t bytes_per_pixel(GLint internal_format) {
+    switch (internal_format) {
+    case GL_RED:
+    case GL_R8:
+        return 1;
+    case GL_RG:
+    case GL_RG8:
+    case GL_R16F:
+        return 2;
+    case GL_RGBA16F:
+    case GL_RG32F:
+        return 8;
+    case GL_RGBA32F:
+        return 16;
+    default:
+        // RGB(A)8, depth24 / stencil8, R32F and anything unknown
+        return 4;
+    }
+}
+
+void gpu_tex_image_2d(
+    MemTag tag,
+    GLuint texture,
+    GLenum target,
+    GLint level,
+    GLint internal_format,
+    GLsizei width,
+    GLsizei height,
+    GLenum format,
+    GLenum type,
+    const void *data
+) {
+    glTexImage2D(target, level, internal_format, width, height, 0, format, type, data);
+
+    // cube map faces are separate images of one texture
+    uint32_t image = ((uint32_t)target << 8) | (uint32_t)level;
+    int64_t bytes = (int64_t)width * (int64_t)height * bytes_per_pixel(internal_format);
+    mem_gpu_track(tag, GPU_TEXTURE, texture, image, bytes);
+}
+
+void gpu_tex_image_3d(
+    MemTag tag,
+    GLuint texture,
+    GLint level,
+    GLint internal_format,
+    GLsizei width,
+    GLsizei height,
+    GLsizei depth,
+    GLenum format,
+    GLenum type,
+    const void *data
+) {
+    glTexImage3D(GL_TEXTURE_3D, level, internal_format, width, height, depth, 0, format, type, data);
+
+    uint32_t image = ((uint32_t)GL_TEXTURE_3D << 8) | (uint32_t)level;
+    int64_t bytes = (int64_t)width * (int64_t)height * (int64_t)depth * bytes_per_pixel(internal_format);
+    mem_gpu_track(tag, GPU_TEXTURE, texture, image, bytes);
+}
+
+void gpu_generate_mipmap(MemTag tag, GLuint texture, GLenum target, GLint internal_format, GLsizei width, GLsizei height) {
+    glGenerateMipmap(target);
+
+    // about a third on top of the base level
+    for (uint32_t level = 1; width > 1 || height > 1; level++) {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        uint32_t image = ((uint32_t)target << 8) | level;
+        int64_t bytes = (int64_t)width * (int64_t)height * bytes_per_pixel(internal_format);
+        mem_gpu_track(tag, GPU_TEXTURE, texture, image, bytes);
+    }
+}
+
+void gpu_buffer_data(MemTag tag, GLuint buffer, GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+    glBufferData(target, size, data, usage);
+    mem_gpu_track(tag, GPU_BUFFER, buffer, 0, (int64_t)size);
+}
+
+void gpu_renderbuffer_storage(MemTag tag, GLuint renderbuffer, GLenum internal_format, GLsizei width, GLsizei height) {
+    glRenderbufferStorage(GL_RENDERBUFFER, internal_format, width, height);
+
+    int64_t bytes = (int64_t)width * (int64_t)height * bytes_per_pixel((GLint)internal_format);
+    mem_gpu_track(tag, GPU_RENDERBUFFER, renderbuffer, 0, bytes);
+}
+
+void gpu_delete_textures(GLsizei n, const GLuint *textures) {
+    for (GLsizei i = 0; i < n; i++) {
+        mem_gpu_release(GPU_TEXTURE, textures[i]);
+    }
+    glDeleteTextures(n, textures);
+}
+
+void gpu_delete_buffers(GLsizei n, const GLuint *buffers) {
+    for (GLsizei i = 0; i < n; i++) {
+        mem_gpu_release(GPU_BUFFER, buffers[i]);
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+void gpu_delete_renderbuffers(GLsizei n, const GLuint *renderbuffers) {
+    for (GLsizei i = 0; i < n; i++) {
+        mem_gpu_release(GPU_RENDERBUFFER, renderbuffers[i]);
+    }
+    glDeleteRenderbuffers(n, renderbuffers);
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "memory.h"
+
+// Passes run in this order, each with a fixed blend/depth state.
+enum RenderPass : uint8_t {
+    PASS_OPAQUE = 0,
+    PASS_FAR_FIELD, // behind anything opaque, writes depth so the skybox stays out
+    PASS_SKYBOX,    // after opaque so depth test rejects covered pixels
+    PASS_TRANSLUCENT, // blended over everything, back to front, no depth writes
+    PASS_HUD,
+
+    PASS_COUNT
+};
+
+// Last GL state we have set, so redundant binds never reach the driver.
+struct GLStateCache {
+    GLuint program;
+    GLuint vao;
+    GLuint texture_2d;
+    GLuint texture_cube;
+    GLuint texture_3d;
+    int blend;
+    int depth_test;
+    int depth_write;
+    GLenum depth_func;
+};
+
+// Forgets everything, next calls always hit GL. Call after touching GL
+// state behind the cache's back.
+void state_reset(GLStateCache *state);
+void state_use_program(GLStateCache *state, GLuint program);
+void state_bind_vao(GLStateCache *state, GLuint vao);
+// Only texture unit 0 is used by the renderer.
+void state_bind_texture(GLStateCache *state, GLenum target, GLuint texture);
+void state_set_blend(GLStateCache *state, bool enabled);
+void state_set_depth_test(GLStateCache *state, bool enabled);
+void state_set_depth_write(GLStateCache *state, bool enabled);
+void state_set_depth_func(GLStateCache *state, GLenum func);
+void state_set_pass(GLStateCache *state, RenderPass pass);
+
+struct DrawItem {
+    RenderPass pass;
+    GLuint program;
+    GLenum texture_target;
+    GLuint texture;
+    GLuint vao;
+    GLenum mode;
+    GLint first;
+    GLsizei count;
+    // optional, must stay alive until the queue is executed
+    const glm::mat4 *model;
+    GLint model_location;
+    // normalized view depth in [0, 1], opaque items are drawn front to back,
+    // translucent ones back to front
+    float depth;
+    // GL_UNSIGNED_INT/SHORT draws `count` indices from the VAO's element
+    // buffer starting at index `first`, 0 draws arrays
+    GLenum index_type = 0;
+    // > 0 draws that many instances, the VAO brings the per-instance attributes
+    GLsizei instance_count = 0;
+};
+
+struct RenderQueue {
+    std::vector<DrawItem, TagAllocator<DrawItem, MEM_RENDER>> items;
+    std::vector<uint64_t, TagAllocator<uint64_t, MEM_RENDER>> keys;
+    std::vector<uint32_t, TagAllocator<uint32_t, MEM_RENDER>> order;
+    std::vector<uint32_t, TagAllocator<uint32_t, MEM_RENDER>> scratch;
+    bool sorted;
+};
+
+// Offscreen color + depth target the 3D scene is rendered into, sized for
+// the window. Only the lower left scale * size part is used in a frame.
+struct SceneTarget {
+    GLuint fbo;
+    GLuint color;
+    GLuint depth;
+    int width;
+    int height;
+};
+
+// Vertex buffer for per-instance attributes, refilled every frame.
+struct InstanceBuffer {
+    GLuint buffer;
+    GLsizeiptr capacity;
+};
+
+// Key layout from the most significant bit:
+// pass (4) | program (8) | texture (16) | vao (12) | depth (24)
+// PASS_TRANSLUCENT has to blend in depth order whatever the state changes
+// cost, so there it is pass (4) | inverted depth (24) | program | texture | vao.
+uint64_t render_key(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth);
+
+void render_queue_clear(RenderQueue *queue);
+void render_queue_submit(RenderQueue *queue, const DrawItem &item);
+// Stable LSD radix sort of the submitted items by key, result in queue->order.
+void render_queue_sort(RenderQueue *queue);
+// Sorts the queue if needed and draws the items of passes first..last
+// through the state cache.
+void render_queue_execute_passes(RenderQueue *queue, GLStateCache *state, RenderPass first, RenderPass last);
+void render_queue_execute(RenderQueue *queue, GLStateCache *state);
+
+// (Re)allocates the target, returns false if the framebuffer is incomplete.
+// Rebinds GL_TEXTURE_2D, so a GLStateCache in use has to be reset after.
+bool scene_target_resize(SceneTarget *target, int width, int height);
+void scene_target_destroy(SceneTarget *target);
+// Stretches the width x height corner of the target over the bound draw
+// framebuffer of window_width x window_height.
+void scene_target_upscale(
+    const SceneTarget *target,
+    int width,
+    int height,
+    int window_width,
+    int window_height
+);
+
+// Copies `size` bytes into the buffer, growing it when they don't fit.
+// Storage is orphaned first so the driver never waits on last frame's draws.
+// Leaves the buffer bound to GL_ARRAY_BUFFER.
+void instance_buffer_upload(InstanceBuffer *instances, MemTag tag, const void *data, GLsizeiptr size);
+
+// GL upload calls that also record the estimated GPU size under `tag`.
+// Border is always 0.
+void gpu_tex_image_2d(
+    MemTag tag,
+    GLuint texture,
+    GLenum target,
+    GLint level,
+    GLint internal_format,
+    GLsizei width,
+    GLsizei height,
+    GLenum format,
+    GLenum type,
+    const void *data
+);
+void gpu_tex_image_3d(
+    MemTag tag,
+    GLuint texture,
+    GLint level,
+    GLint internal_format,
+    GLsizei width,
+    GLsizei height,
+    GLsizei depth,
+    GLenum format,
+    GLenum type,
+    const void *data
+);
+// glGenerateMipmap for the bound texture, records the levels below the
+// width x height base level.
+void gpu_generate_mipmap(MemTag tag, GLuint texture, GLenum target, GLint internal_format, GLsizei width, GLsizei height);
+void gpu_buffer_data(MemTag tag, GLuint buffer, GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+// Storage for the bound renderbuffer.
+void gpu_renderbuffer_storage(MemTag tag, GLuint renderbuffer, GLenum internal_format, GLsizei width, GLsizei height);
+void gpu_delete_textures(GLsizei n, const GLuint *textures);
+void gpu_delete_buffers(GLsizei n, const GLuint *buffers);
+void gpu_delete_renderbuffers(GLsizei n, const GLuint *renderbuffers);
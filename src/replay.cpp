@@ -0,0 +1,254 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "replay.h"
+
+#define REPLAY_MAGIC "SHRP"
+#define REPLAY_VERSION 1
+
+template <class T>
+static inline void put(FILE *file, T value) {
+    fwrite(&value, sizeof(T), 1, file);
+}
+
+template <class T>
+static inline bool get(InputReplay *replay, T *value) {
+    if (replay->pos + sizeof(T) > replay->data.size()) {
+        return false;
+    }
+    memcpy(value, replay->data.data() + replay->pos, sizeof(T));
+    replay->pos += sizeof(T);
+    return true;
+}
+
+bool input_record_open(InputRecorder *recorder, const char *path, int width, int height) {
+    recorder->file = fopen(path, "wb");
+    recorder->frames = 0;
+    if (recorder->file == NULL) {
+        fprintf(stderr, "ERROR: Failed to open input recording %s\n", path);
+        return false;
+    }
+
+    fwrite(REPLAY_MAGIC, 4, 1, recorder->file);
+    put<uint32_t>(recorder->file, REPLAY_VERSION);
+    put<int32_t>(recorder->file, width);
+    put<int32_t>(recorder->file, height);
+
+    return true;
+}
+
+void input_record_frame(InputRecorder *recorder, double delta_time, uint32_t keys) {
+    if (recorder->file == NULL) {
+        return;
+    }
+    put<uint8_t>(recorder->file, INPUT_FRAME);
+    put<double>(recorder->file, delta_time);
+    put<uint32_t>(recorder->file, keys);
+    recorder->frames++;
+}
+
+void input_record_event(InputRecorder *recorder, const InputEvent &event) {
+    if (recorder->file == NULL) {
+        return;
+    }
+    put<uint8_t>(recorder->file, event.type);
+    switch (event.type) {
+    case INPUT_CURSOR:
+    case INPUT_SCROLL:
+        put<double>(recorder->file, event.x);
+        put<double>(recorder->file, event.y);
+        break;
+    case INPUT_MOUSE_BUTTON:
+    case INPUT_KEY:
+        put<int16_t>(recorder->file, (int16_t)event.key);
+        put<uint8_t>(recorder->file, (uint8_t)event.action);
+        put<uint8_t>(recorder->file, (uint8_t)event.mods);
+        break;
+    default:
+        break;
+    }
+}
+
+void input_record_close(InputRecorder *recorder) {
+    if (recorder->file == NULL) {
+        return;
+    }
+    fclose(recorder->file);
+    recorder->file = NULL;
+    printf("Recorded %llu frames of input\n", (unsigned long long)recorder->frames);
+}
+
+bool input_replay_open(InputReplay *replay, const char *path) {
+    replay->data.clear();
+    replay->pos = 0;
+    replay->frames = 0;
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: Failed to open input recording %s\n", path);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size > 0) {
+        replay->data.resize((size_t)size);
+        if (fread(replay->data.data(), 1, (size_t)size, file) != (size_t)size) {
+            replay->data.clear();
+        }
+    }
+    fclose(file);
+
+    char magic[4];
+    uint32_t version = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    if (
+        !get(replay, &magic)
+        || memcmp(magic, REPLAY_MAGIC, 4) != 0
+        || !get(replay, &version)
+        || !get(replay, &width)
+        || !get(replay, &height)
+    ) {
+        fprintf(stderr, "ERROR: %s is not an input recording\n", path);
+        return false;
+    }
+    if (version != REPLAY_VERSION) {
+        fprintf(stderr, "ERROR: %s has recording version %u, expected %u\n", path, version, REPLAY_VERSION);
+        return false;
+    }
+    replay->width = width;
+    replay->height = height;
+
+    return true;
+}
+
+bool input_replay_frame(InputReplay *replay, double *delta_time, uint32_t *keys) {
+    // skip whatever the last frame didn't consume
+    InputEvent event;
+    while (input_replay_event(replay, &event)) {
+    }
+
+    uint8_t type;
+    if (!get(replay, &type)) {
+        return false;
+    }
+    if (type != INPUT_FRAME || !get(replay, delta_time) || !get(replay, keys)) {
+        fprintf(stderr, "ERROR: Input recording is corrupt after frame %llu\n", (unsigned long long)replay->frames);
+        replay->pos = replay->data.size();
+        return false;
+    }
+    replay->frames++;
+
+    return true;
+}
+
+bool input_replay_event(InputReplay *replay, InputEvent *event) {
+    if (replay->pos >= replay->data.size() || replay->data[replay->pos] == INPUT_FRAME) {
+        return false;
+    }
+
+    uint8_t type = replay->data[replay->pos++];
+    *event = {};
+    event->type = (InputEventType)type;
+
+    bool ok;
+    switch (type) {
+    case INPUT_CURSOR:
+    case INPUT_SCROLL:
+        ok = get(replay, &event->x) && get(replay, &event->y);
+        break;
+    case INPUT_MOUSE_BUTTON:
+    case INPUT_KEY: {
+        int16_t key = 0;
+        uint8_t action = 0;
+        uint8_t mods = 0;
+        ok = get(replay, &key) && get(replay, &action) && get(replay, &mods);
+        event->key = key;
+        event->action = action;
+        event->mods = mods;
+        break;
+    }
+    default:
+        ok = false;
+        break;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "ERROR: Input recording is corrupt in frame %llu\n", (unsigned long long)replay->frames);
+        replay->pos = replay->data.size();
+    }
+    return ok;
+}
+
+bool frame_log_open(FrameLog *log, const char *path) {
+    log->frame_ms.clear();
+    log->hash = hash_bytes(NULL, 0);
+    log->file = NULL;
+    if (path == NULL) {
+        return true;
+    }
+
+    log->file = fopen(path, "w");
+    if (log->file == NULL) {
+        fprintf(stderr, "ERROR: Failed to open frame log %s\n", path);
+        return false;
+    }
+    fprintf(log->file, "frame,delta_ms,frame_ms,hash\n");
+
+    return true;
+}
+
+void frame_log_add(FrameLog *log, uint64_t frame, double delta_ms, double frame_ms, uint64_t hash) {
+    log->frame_ms.push_back((float)frame_ms);
+    log->hash = hash_bytes(&hash, sizeof(hash), log->hash);
+    if (log->file) {
+        fprintf(log->file, "%llu,%.3f,%.3f,%016llx\n", (unsigned long long)frame, delta_ms, frame_ms, (unsigned long long)hash);
+    }
+}
+
+void frame_log_close(FrameLog *log) {
+    if (log->file) {
+        fclose(log->file);
+        log->file = NULL;
+    }
+
+    size_t n = log->frame_ms.size();
+    if (n == 0) {
+        return;
+    }
+
+    std::vector<float> sorted = log->frame_ms;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (float ms : sorted) {
+        sum += ms;
+    }
+
+    printf(
+        "Replayed %zu frames: avg %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms, hash %016llx\n",
+        n,
+        sum / (double)n,
+        sorted[n / 2],
+        sorted[std::min(n - 1, n * 99 / 100)],
+        sorted[n - 1],
+        (unsigned long long)log->hash
+    );
+}
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t hash) {
+    const uint8_t *p = (const uint8_t *)data;
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; i++) {
+        uint64_t w;
+        memcpy(&w, p + i * 8, 8);
+        hash ^= w;
+        hash *= 0x100000001b3ull;
+    }
+    for (size_t i = words * 8; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
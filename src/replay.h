@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+// Input capture and replay. A recording is a header followed by records:
+// a frame record (delta_time and held keys) starts every frame, the events
+// GLFW delivered while that frame polled follow it. Values are written in
+// host byte order, recordings are not meant to move between architectures.
+
+enum InputEventType : uint8_t {
+    INPUT_FRAME = 0,
+    INPUT_CURSOR,
+    INPUT_SCROLL,
+    INPUT_MOUSE_BUTTON,
+    INPUT_KEY,
+};
+
+struct InputEvent {
+    InputEventType type;
+    double x = 0.0;  // cursor position or scroll offset
+    double y = 0.0;
+    int key = 0;     // key or mouse button
+    int action = 0;
+    int mods = 0;
+};
+
+struct InputRecorder {
+    FILE *file;
+    uint64_t frames;
+};
+
+bool input_record_open(InputRecorder *recorder, const char *path, int width, int height);
+void input_record_frame(InputRecorder *recorder, double delta_time, uint32_t keys);
+void input_record_event(InputRecorder *recorder, const InputEvent &event);
+void input_record_close(InputRecorder *recorder);
+
+struct InputReplay {
+    std::vector<uint8_t> data;
+    size_t pos;
+    int width;   // framebuffer size at the start of the recording
+    int height;
+    uint64_t frames;
+};
+
+// Loads the whole recording, false if it is missing or not a recording.
+bool input_replay_open(InputReplay *replay, const char *path);
+// Steps to the next frame, false once the recording ends.
+bool input_replay_frame(InputReplay *replay, double *delta_time, uint32_t *keys);
+// Next event of the current frame, false when there are no more.
+bool input_replay_event(InputReplay *replay, InputEvent *event);
+
+// Per-frame timings and framebuffer hashes of a replay as CSV.
+struct FrameLog {
+    FILE *file;
+    std::vector<float> frame_ms;
+    uint64_t hash;   // combined hash of every frame
+};
+
+bool frame_log_open(FrameLog *log, const char *path);
+void frame_log_add(FrameLog *log, uint64_t frame, double delta_ms, double frame_ms, uint64_t hash);
+// Prints frame time percentiles and the combined hash.
+void frame_log_close(FrameLog *log);
+
+// 64-bit FNV-1a, fed 8 bytes at a time so a full framebuffer hashes in
+// about a millisecond. Not the standard FNV-1a value.
+uint64_t hash_bytes(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull);
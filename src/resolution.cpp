@@ -0,0 +1,55 @@
+#include <math.h>
+
+#include "resolution.h"
+
+// weight of the newest sample in the frame time average
+#define DYNRES_SMOOTHING 0.1f
+// no change while the average stays within this fraction of the target
+#define DYNRES_DEADBAND 0.05f
+// largest scale change in a single frame
+#define DYNRES_MAX_STEP 0.05f
+// keeps the render size from creeping by a pixel every frame
+#define DYNRES_QUANTUM (1.0f / 64.0f)
+
+void dynres_init(DynamicResolution *r, float target_ms) {
+    r->target_ms = target_ms;
+    r->min_scale = 0.5f;
+    r->max_scale = 1.0f;
+    r->scale = 1.0f;
+    r->avg_ms = target_ms;
+}
+
+float dynres_update(DynamicResolution *r, float frame_ms) {
+    // hitches like window moves or breakpoints are not a load signal
+    if (frame_ms <= 0.0f || frame_ms > 250.0f) {
+        return r->scale;
+    }
+
+    r->avg_ms += (frame_ms - r->avg_ms) * DYNRES_SMOOTHING;
+
+    float error = r->avg_ms / r->target_ms;
+    if (fabsf(error - 1.0f) < DYNRES_DEADBAND) {
+        return r->scale;
+    }
+
+    float wanted = r->scale * sqrtf(1.0f / error);
+    float step = wanted - r->scale;
+    if (step > DYNRES_MAX_STEP) {
+        step = DYNRES_MAX_STEP;
+    }
+    if (step < -DYNRES_MAX_STEP) {
+        step = -DYNRES_MAX_STEP;
+    }
+
+    float scale = r->scale + step;
+    scale = roundf(scale / DYNRES_QUANTUM) * DYNRES_QUANTUM;
+    if (scale < r->min_scale) {
+        scale = r->min_scale;
+    }
+    if (scale > r->max_scale) {
+        scale = r->max_scale;
+    }
+    r->scale = scale;
+
+    return r->scale;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Picks the 3D scene render scale from measured frame time.
+// Pixel count goes with scale^2, so that is what the controller steers.
+struct DynamicResolution {
+    float target_ms;
+    float min_scale;
+    float max_scale;
+    float scale;
+    float avg_ms;  // smoothed frame time
+};
+
+void dynres_init(DynamicResolution *r, float target_ms);
+// Feeds the last frame time in, returns the scale for the next frame.
+float dynres_update(DynamicResolution *r, float frame_ms);
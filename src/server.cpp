@@ -0,0 +1,689 @@
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "server.h"
+#include "trace.h"
+
+// entities visible to one client at most, removals have to fit a u16
+#define SERVER_MAX_KNOWN_ENTITIES 65535
+// added and moved entities per client per tick, the rest waits a tick
+#define SERVER_MAX_ENTITY_UPDATES 4096
+
+#define PLAYER_HALF_WIDTH 0.3f
+#define PLAYER_HALF_HEIGHT 0.9f
+
+static uint32_t server_random(Server *server) {
+    // xorshift32
+    uint32_t x = server->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    server->rng = x;
+    return x;
+}
+
+static int chunk_index(const World *world, int cx, int cy, int cz) {
+    return (cx * world->size_y + cy) * world->size_z + cz;
+}
+
+// Chunk column cx * size_z + cz of a World::chunks index.
+static int chunk_column(const World *world, int chunk) {
+    int cz = chunk % world->size_z;
+    int cx = chunk / (world->size_y * world->size_z);
+    return cx * world->size_z + cz;
+}
+
+static int floor_div(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Center height of an entity standing on column (x, z).
+static float standing_y(const World *world, int x, int z, float half_height) {
+    int y = world->size_y * CHUNK_SIZE - 1;
+    while (y >= 0 && world_get_block(world, x, y, z) == BLOCK_AIR) {
+        y--;
+    }
+    return (float)y + 0.5f + half_height + 0.01f;
+}
+
+// False when every entity slot is taken.
+static bool spawn_falling_block(Server *server) {
+    int top = server->world.size_y * CHUNK_SIZE;
+    float half = 0.15f + (float)(server_random(server) % 200) / 1000.0f;
+    glm::vec3 position(
+        (float)(server_random(server) % (uint32_t)(server->world.size_x * CHUNK_SIZE)),
+        (float)(top - 2) - (float)(server_random(server) % 800) / 100.0f,
+        (float)(server_random(server) % (uint32_t)(server->world.size_z * CHUNK_SIZE))
+    );
+    EntityId id = entity_create(&server->entities, position, glm::vec3(half), ENTITY_MESH_BLOCK);
+    if (id == ENTITY_NONE) {
+        return false;
+    }
+    server->entities.vel_x[entity_index(&server->entities, id)] = (float)(server_random(server) % 200) / 100.0f - 1.0f;
+    return true;
+}
+
+// Creates the client's player near the middle of the world and tells it.
+static void spawn_player(Server *server, ServerClient *client) {
+    const World *world = &server->world;
+    int x = world->size_x * CHUNK_SIZE / 2 + (int)(server_random(server) % 16) - 8;
+    int z = world->size_z * CHUNK_SIZE / 2 + (int)(server_random(server) % 16) - 8;
+    glm::vec3 position((float)x, standing_y(world, x, z, PLAYER_HALF_HEIGHT), (float)z);
+    glm::vec3 half(PLAYER_HALF_WIDTH, PLAYER_HALF_HEIGHT, PLAYER_HALF_WIDTH);
+    client->player = entity_create(&server->entities, position, half, ENTITY_MESH_BLOCK);
+
+    NetBuffer &out = client->conn.out;
+    size_t start = net_begin_message(out, NET_WELCOME);
+    net_put_u32(out, client->player);
+    net_put_u16(out, (uint16_t)world->size_x);
+    net_put_u16(out, (uint16_t)world->size_y);
+    net_put_u16(out, (uint16_t)world->size_z);
+    net_put_u32(out, (uint32_t)server->ticks.tick);
+    net_end_message(out, start);
+}
+
+bool server_init(Server *server, const ServerConfig *config, JobPool *jobs) {
+    if (
+        config->size_x * CHUNK_SIZE > NET_MAX_BLOCKS_X
+        || config->size_y * CHUNK_SIZE > NET_MAX_BLOCKS_Y
+        || config->size_z * CHUNK_SIZE > NET_MAX_BLOCKS_Z
+    ) {
+        fprintf(stderr, "Failed to create server: a %dx%dx%d world is too big for the protocol\n", config->size_x, config->size_y, config->size_z);
+        return false;
+    }
+    if (!world_init(&server->world, config->size_x, config->size_y, config->size_z)) {
+        return false;
+    }
+    world_generate(&server->world);
+    tick_init(&server->ticks, &server->world, config->seed);
+
+    server->jobs = jobs;
+    // leave room for every player
+    server->entity_target = std::min(config->entities, (uint32_t)(ENTITY_SLOT_MASK - SERVER_MAX_CLIENTS));
+    server->rng = config->seed | 1;
+    server->stats = {};
+
+    size_t chunk_count = (size_t)config->size_x * config->size_y * config->size_z;
+    server->snapshots.resize(chunk_count);
+    server->snapshot_valid.assign(chunk_count, 0);
+
+    // square view, so the corners count too, nearest columns first
+    server->view_offsets.clear();
+    for (int d = 0; d <= SERVER_VIEW_RADIUS; d++) {
+        for (int dx = -d; dx <= d; dx++) {
+            for (int dz = -d; dz <= d; dz++) {
+                if (std::max(abs(dx), abs(dz)) == d) {
+                    server->view_offsets.push_back((int16_t)dx);
+                    server->view_offsets.push_back((int16_t)dz);
+                }
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < server->entity_target; i++) {
+        spawn_falling_block(server);
+    }
+
+    server->listen_fd = -1;
+    if (config->port != 0) {
+        server->listen_fd = net_listen(config->port);
+        if (server->listen_fd < 0) {
+            tick_destroy(&server->ticks);
+            world_destroy(&server->world);
+            return false;
+        }
+    }
+    return true;
+}
+
+void server_destroy(Server *server) {
+    for (ServerClient &client : server->clients) {
+        net_connection_close(&client.conn);
+    }
+    net_close(server->listen_fd);
+    server->listen_fd = -1;
+    server->clients = NetVector<ServerClient>();
+    server->snapshots = NetVector<NetBuffer>();
+    server->snapshot_valid = NetVector<uint8_t>();
+    server->entities = EntityWorld();
+    tick_destroy(&server->ticks);
+    world_destroy(&server->world);
+}
+
+bool server_add_client(Server *server, int fd) {
+    if (server->clients.size() >= SERVER_MAX_CLIENTS) {
+        fprintf(stderr, "Failed to add client: server is full\n");
+        net_close(fd);
+        return false;
+    }
+    server->clients.emplace_back();
+    ServerClient &client = server->clients.back();
+    net_connection_init(&client.conn, fd);
+    client.joined = false;
+    client.player = ENTITY_NONE;
+    client.move_x = 0;
+    client.move_z = 0;
+    client.buttons = 0;
+    client.view_cx = INT_MIN;
+    client.view_cz = INT_MIN;
+    client.view_done = false;
+    client.loaded.assign(server->snapshots.size(), 0);
+    return true;
+}
+
+static void record_change(Server *server, const BlockChange &change) {
+    server->changes.push_back(change);
+    int index = chunk_index(&server->world, change.x / CHUNK_SIZE, change.y / CHUNK_SIZE, change.z / CHUNK_SIZE);
+    server->snapshot_valid[index] = 0;
+}
+
+static void handle_set_block(Server *server, ServerClient *client, NetReader *r) {
+    int x, y, z;
+    net_unpack_block(net_get_u32(r), &x, &y, &z);
+    uint8_t block = net_get_u8(r);
+    if (!r->ok || block >= BLOCK_COUNT || !world_contains(&server->world, x, y, z)) {
+        return;
+    }
+    int64_t index = entity_index(&server->entities, client->player);
+    if (index < 0) {
+        return;
+    }
+    glm::vec3 player(server->entities.pos_x[index], server->entities.pos_y[index], server->entities.pos_z[index]);
+    if (glm::distance(player, glm::vec3((float)x, (float)y, (float)z)) > PLAYER_REACH) {
+        return;
+    }
+    if (world_get_block(&server->world, x, y, z) == block) {
+        return;
+    }
+    tick_set_block(&server->ticks, x, y, z, block);
+    record_change(server, { x, y, z, block });
+}
+
+// False when the client broke the protocol.
+static bool handle_message(Server *server, ServerClient *client, NetMessage type, NetReader *r) {
+    if (type == NET_HELLO) {
+        uint32_t version = net_get_u32(r);
+        if (!r->ok || version != NET_PROTOCOL_VERSION) {
+            fprintf(stderr, "Client speaks protocol %u, not %u\n", version, NET_PROTOCOL_VERSION);
+            return false;
+        }
+        if (!client->joined) {
+            client->joined = true;
+            spawn_player(server, client);
+        }
+        return true;
+    }
+    if (!client->joined) {
+        return false;
+    }
+
+    switch (type) {
+    case NET_INPUT:
+        client->move_x = net_get_i8(r);
+        client->move_z = net_get_i8(r);
+        client->buttons = net_get_u8(r);
+        break;
+    case NET_SET_BLOCK:
+        handle_set_block(server, client, r);
+        break;
+    default:
+        return false;
+    }
+    return r->ok;
+}
+
+void server_receive(Server *server) {
+    TRACE_SCOPE("server_receive");
+
+    if (server->listen_fd >= 0) {
+        int fd;
+        while ((fd = net_accept(server->listen_fd)) >= 0) {
+            if (server_add_client(server, fd)) {
+                printf("Client connected, %zu total\n", server->clients.size());
+            }
+        }
+    }
+
+    for (ServerClient &client : server->clients) {
+        NetConnection *conn = &client.conn;
+        net_receive(conn);
+
+        size_t offset = 0;
+        while (!conn->closed) {
+            NetMessage type;
+            NetReader payload;
+            int64_t size = net_next_message(conn->in.data() + offset, conn->in.size() - offset, &type, &payload);
+            if (size == 0) {
+                break;
+            }
+            if (size < 0 || !handle_message(server, &client, type, &payload)) {
+                fprintf(stderr, "Client sent a bad message, disconnecting it\n");
+                conn->closed = true;
+                break;
+            }
+            offset += (size_t)size;
+        }
+        if (!conn->closed) {
+            conn->in.erase(conn->in.begin(), conn->in.begin() + (ptrdiff_t)offset);
+        }
+    }
+}
+
+void server_tick(Server *server) {
+    TRACE_SCOPE("server_tick");
+
+    EntityWorld *entities = &server->entities;
+    for (const ServerClient &client : server->clients) {
+        int64_t i = entity_index(entities, client.player);
+        if (i < 0) {
+            continue;
+        }
+        entities->vel_x[i] = (float)client.move_x / 127.0f * PLAYER_SPEED;
+        entities->vel_z[i] = (float)client.move_z / 127.0f * PLAYER_SPEED;
+        if ((client.buttons & NET_BUTTON_JUMP) && (entities->flags[i] & ENTITY_ON_GROUND)) {
+            entities->vel_y[i] = PLAYER_JUMP_SPEED;
+        }
+    }
+
+    tick_step(&server->ticks, server->jobs);
+    for (const BlockChange &change : server->ticks.applied) {
+        record_change(server, change);
+    }
+
+    for (int i = 0; i < SERVER_ENTITY_STEPS; i++) {
+        entity_update(entities, server->jobs, &server->world, 1.0f / (TICK_RATE * SERVER_ENTITY_STEPS));
+    }
+
+    // players stay inside the world, the ones that still got lost respawn
+    float max_x = (float)(server->world.size_x * CHUNK_SIZE) - 1.0f;
+    float max_z = (float)(server->world.size_z * CHUNK_SIZE) - 1.0f;
+    uint32_t players = 0;
+    for (ServerClient &client : server->clients) {
+        if (!client.joined) {
+            continue;
+        }
+        int64_t i = entity_index(entities, client.player);
+        if (i < 0) {
+            spawn_player(server, &client);
+            i = entity_index(entities, client.player);
+        }
+        entities->pos_x[i] = std::clamp(entities->pos_x[i], 0.0f, max_x);
+        entities->pos_z[i] = std::clamp(entities->pos_z[i], 0.0f, max_z);
+        players++;
+    }
+
+    while (entity_count(entities) < server->entity_target + players) {
+        if (!spawn_falling_block(server)) {
+            break;
+        }
+    }
+}
+
+static uint8_t quantize_half(float v) {
+    return (uint8_t)std::min(255.0f, roundf(v * NET_POSITION_SCALE));
+}
+
+// Every live entity in slot order, then bucketed by column so clients only
+// look at the ones around them.
+static void collect_entities(Server *server) {
+    TRACE_SCOPE("server_collect_entities");
+
+    const EntityWorld *entities = &server->entities;
+    const World *world = &server->world;
+    server->visible.clear();
+    for (uint32_t slot = 0; slot < entities->slot_index.size(); slot++) {
+        uint32_t i = entities->slot_index[slot];
+        if (i >= entities->ids.size() || (entities->ids[i] & ENTITY_SLOT_MASK) != slot) {
+            continue;
+        }
+        NetEntity e;
+        e.id = entities->ids[i];
+        e.x = net_quantize(entities->pos_x[i]);
+        e.y = net_quantize(entities->pos_y[i]);
+        e.z = net_quantize(entities->pos_z[i]);
+        e.mesh = entities->mesh[i];
+        e.half_x = quantize_half(entities->half_x[i]);
+        e.half_y = quantize_half(entities->half_y[i]);
+        e.half_z = quantize_half(entities->half_z[i]);
+
+        // block i covers [i - 0.5, i + 0.5]
+        int bx = (int)floorf(entities->pos_x[i] + 0.5f);
+        int by = (int)floorf(entities->pos_y[i] + 0.5f);
+        int bz = (int)floorf(entities->pos_z[i] + 0.5f);
+        e.chunk = world_contains(world, bx, by, bz)
+            ? chunk_index(world, bx / CHUNK_SIZE, by / CHUNK_SIZE, bz / CHUNK_SIZE)
+            : -1;
+        server->visible.push_back(e);
+    }
+
+    // counting sort, stable so every column stays in slot order
+    int columns = world->size_x * world->size_z;
+    NetVector<uint32_t> &start = server->column_start;
+    start.assign((size_t)columns + 1, 0);
+    for (const NetEntity &e : server->visible) {
+        if (e.chunk >= 0) {
+            start[chunk_column(world, e.chunk) + 1]++;
+        }
+    }
+    for (int c = 0; c < columns; c++) {
+        start[c + 1] += start[c];
+    }
+    server->column_entities.resize(start[columns]);
+    for (uint32_t v = 0; v < server->visible.size(); v++) {
+        int chunk = server->visible[v].chunk;
+        if (chunk >= 0) {
+            server->column_entities[start[chunk_column(world, chunk)]++] = v;
+        }
+    }
+    // the fill moved every start to the next column's
+    for (int c = columns; c > 0; c--) {
+        start[c] = start[c - 1];
+    }
+    start[0] = 0;
+}
+
+// Marks the visible entities in the columns the client may have loaded.
+// The bits are read back in visible order, which is slot order, without
+// sorting.
+static void collect_nearby(Server *server, const ServerClient *client) {
+    NetVector<uint64_t> &nearby = server->nearby;
+    nearby.assign((server->visible.size() + 63) / 64, 0);
+    if (client->view_cx == INT_MIN) {
+        return;
+    }
+    // update_view unloads past one column of slack
+    const World *world = &server->world;
+    int reach = SERVER_VIEW_RADIUS + 1;
+    int x0 = std::max(client->view_cx - reach, 0);
+    int x1 = std::min(client->view_cx + reach, world->size_x - 1);
+    int z0 = std::max(client->view_cz - reach, 0);
+    int z1 = std::min(client->view_cz + reach, world->size_z - 1);
+    for (int cx = x0; cx <= x1; cx++) {
+        for (int cz = z0; cz <= z1; cz++) {
+            int c = cx * world->size_z + cz;
+            for (uint32_t i = server->column_start[c]; i < server->column_start[c + 1]; i++) {
+                uint32_t v = server->column_entities[i];
+                nearby[v / 64] |= 1ull << (v % 64);
+            }
+        }
+    }
+}
+
+static void put_u32_at(NetBuffer &out, size_t at, uint32_t v) {
+    out[at + 0] = (uint8_t)v;
+    out[at + 1] = (uint8_t)(v >> 8);
+    out[at + 2] = (uint8_t)(v >> 16);
+    out[at + 3] = (uint8_t)(v >> 24);
+}
+
+// Known entities missing from the nearby ones are gone or out of view,
+// either way removed.
+static void write_entity_deltas(Server *server, ServerClient *client, NetBuffer &out) {
+    NetBuffer &removed = server->removed;
+    NetBuffer &added = server->added;
+    NetBuffer &moved = server->moved;
+    NetVector<KnownEntity> &next = server->next_known;
+    const NetVector<KnownEntity> &known = client->known;
+    removed.clear();
+    added.clear();
+    moved.clear();
+    next.clear();
+    uint32_t removed_count = 0;
+    uint32_t added_count = 0;
+    uint32_t moved_count = 0;
+
+    collect_nearby(server, client);
+    size_t k = 0;
+    for (size_t word = 0; word < server->nearby.size(); word++) {
+        uint64_t bits = server->nearby[word];
+        while (bits != 0) {
+            const NetEntity &e = server->visible[word * 64 + (size_t)__builtin_ctzll(bits)];
+            bits &= bits - 1;
+            uint32_t slot = e.id & ENTITY_SLOT_MASK;
+            // known entities in earlier slots are gone
+            while (k < known.size() && (known[k].id & ENTITY_SLOT_MASK) < slot) {
+                net_put_u32(removed, known[k++].id);
+                removed_count++;
+            }
+            const KnownEntity *prev = NULL;
+            if (k < known.size() && (known[k].id & ENTITY_SLOT_MASK) == slot) {
+                if (known[k].id == e.id) {
+                    prev = &known[k];
+                } else {
+                    net_put_u32(removed, known[k].id);
+                    removed_count++;
+                }
+                k++;
+            }
+
+            if (e.chunk < 0 || !client->loaded[e.chunk]) {
+                if (prev != NULL) {
+                    net_put_u32(removed, prev->id);
+                    removed_count++;
+                }
+                continue;
+            }
+
+            bool budget = added_count + moved_count < SERVER_MAX_ENTITY_UPDATES;
+            if (prev == NULL) {
+                if (budget && next.size() < SERVER_MAX_KNOWN_ENTITIES) {
+                    net_put_u32(added, e.id);
+                    net_put_i16(added, e.x);
+                    net_put_i16(added, e.y);
+                    net_put_i16(added, e.z);
+                    net_put_u8(added, e.mesh);
+                    net_put_u8(added, e.half_x);
+                    net_put_u8(added, e.half_y);
+                    net_put_u8(added, e.half_z);
+                    added_count++;
+                    next.push_back({ e.id, e.x, e.y, e.z });
+                }
+                continue;
+            }
+
+            int dx = e.x - prev->x;
+            int dy = e.y - prev->y;
+            int dz = e.z - prev->z;
+            if ((dx == 0 && dy == 0 && dz == 0) || !budget) {
+                next.push_back(*prev);
+                continue;
+            }
+            if (abs(dx) > 127 || abs(dy) > 127 || abs(dz) > 127) {
+                net_put_u32(added, e.id);
+                net_put_i16(added, e.x);
+                net_put_i16(added, e.y);
+                net_put_i16(added, e.z);
+                net_put_u8(added, e.mesh);
+                net_put_u8(added, e.half_x);
+                net_put_u8(added, e.half_y);
+                net_put_u8(added, e.half_z);
+                added_count++;
+            } else {
+                net_put_u32(moved, e.id);
+                net_put_i8(moved, (int8_t)dx);
+                net_put_i8(moved, (int8_t)dy);
+                net_put_i8(moved, (int8_t)dz);
+                moved_count++;
+            }
+            next.push_back({ e.id, e.x, e.y, e.z });
+        }
+    }
+    while (k < known.size()) {
+        net_put_u32(removed, known[k++].id);
+        removed_count++;
+    }
+
+    net_put_u16(out, (uint16_t)removed_count);
+    net_put_bytes(out, removed.data(), removed.size());
+    net_put_u16(out, (uint16_t)added_count);
+    net_put_bytes(out, added.data(), added.size());
+    net_put_u16(out, (uint16_t)moved_count);
+    net_put_bytes(out, moved.data(), moved.size());
+    client->known.swap(next);
+}
+
+static void write_tick(Server *server, ServerClient *client) {
+    NetBuffer &out = client->conn.out;
+    const World *world = &server->world;
+    size_t start = net_begin_message(out, NET_TICK);
+    net_put_u32(out, (uint32_t)server->ticks.tick);
+
+    size_t count_at = out.size();
+    net_put_u32(out, 0);
+    uint32_t count = 0;
+    for (const BlockChange &change : server->changes) {
+        int index = chunk_index(world, change.x / CHUNK_SIZE, change.y / CHUNK_SIZE, change.z / CHUNK_SIZE);
+        if (!client->loaded[index]) {
+            continue;
+        }
+        net_put_u32(out, net_pack_block(change.x, change.y, change.z));
+        net_put_u8(out, change.block);
+        count++;
+    }
+    put_u32_at(out, count_at, count);
+
+    write_entity_deltas(server, client, out);
+    net_end_message(out, start);
+}
+
+static void write_chunk_position(NetBuffer &out, int cx, int cy, int cz) {
+    net_put_u16(out, (uint16_t)cx);
+    net_put_u16(out, (uint16_t)cy);
+    net_put_u16(out, (uint16_t)cz);
+}
+
+// Unloads what the player left behind, one column of slack so walking
+// along a border doesn't resend it every step, then loads the nearest
+// missing chunks while the connection keeps up.
+static void update_view(Server *server, ServerClient *client) {
+    const World *world = &server->world;
+    const EntityWorld *entities = &server->entities;
+    NetBuffer &out = client->conn.out;
+
+    int64_t i = entity_index(entities, client->player);
+    if (i < 0) {
+        return;
+    }
+    int pcx = std::clamp(floor_div((int)floorf(entities->pos_x[i] + 0.5f), CHUNK_SIZE), 0, world->size_x - 1);
+    int pcz = std::clamp(floor_div((int)floorf(entities->pos_z[i] + 0.5f), CHUNK_SIZE), 0, world->size_z - 1);
+
+    if (pcx != client->view_cx || pcz != client->view_cz) {
+        for (int cx = 0; cx < world->size_x; cx++) {
+            for (int cy = 0; cy < world->size_y; cy++) {
+                for (int cz = 0; cz < world->size_z; cz++) {
+                    int index = chunk_index(world, cx, cy, cz);
+                    if (client->loaded[index] && std::max(abs(cx - pcx), abs(cz - pcz)) > SERVER_VIEW_RADIUS + 1) {
+                        size_t start = net_begin_message(out, NET_UNLOAD);
+                        write_chunk_position(out, cx, cy, cz);
+                        net_end_message(out, start);
+                        client->loaded[index] = 0;
+                    }
+                }
+            }
+        }
+        client->view_cx = pcx;
+        client->view_cz = pcz;
+        client->view_done = false;
+    }
+    if (client->view_done) {
+        return;
+    }
+
+    int sent = 0;
+    for (size_t o = 0; o < server->view_offsets.size(); o += 2) {
+        int cx = pcx + server->view_offsets[o];
+        int cz = pcz + server->view_offsets[o + 1];
+        if (cx < 0 || cx >= world->size_x || cz < 0 || cz >= world->size_z) {
+            continue;
+        }
+        for (int cy = 0; cy < world->size_y; cy++) {
+            int index = chunk_index(world, cx, cy, cz);
+            if (client->loaded[index]) {
+                continue;
+            }
+            if (sent == SERVER_CHUNKS_PER_TICK || net_unsent(&client->conn) >= SERVER_SEND_WATERMARK) {
+                return;
+            }
+            if (!server->snapshot_valid[index]) {
+                server->snapshots[index].clear();
+                if (!net_compress_chunk(world_chunk(world, cx, cy, cz), server->snapshots[index])) {
+                    return;
+                }
+                server->snapshot_valid[index] = 1;
+                server->stats.compressed++;
+            }
+            const NetBuffer &snapshot = server->snapshots[index];
+            size_t start = net_begin_message(out, NET_CHUNK);
+            write_chunk_position(out, cx, cy, cz);
+            net_put_bytes(out, snapshot.data(), snapshot.size());
+            net_end_message(out, start);
+            client->loaded[index] = 1;
+            sent++;
+            server->stats.snapshots++;
+        }
+    }
+    client->view_done = true;
+}
+
+void server_send(Server *server) {
+    TRACE_SCOPE("server_send");
+
+    auto start = std::chrono::steady_clock::now();
+    server->stats.snapshots = 0;
+    server->stats.compressed = 0;
+    server->stats.bytes = 0;
+
+    collect_entities(server);
+    for (ServerClient &client : server->clients) {
+        if (!client.joined || client.conn.closed) {
+            continue;
+        }
+        size_t before = client.conn.out.size();
+        write_tick(server, &client);
+        update_view(server, &client);
+        server->stats.bytes += client.conn.out.size() - before;
+    }
+    server->changes.clear();
+
+    server->stats.clients = (uint32_t)server->clients.size();
+    server->stats.send_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+}
+
+void server_flush(Server *server) {
+    TRACE_SCOPE("server_flush");
+
+    for (size_t i = 0; i < server->clients.size();) {
+        ServerClient &client = server->clients[i];
+        net_flush(&client.conn);
+        size_t unsent = net_unsent(&client.conn);
+        if (!client.conn.closed && unsent <= SERVER_MAX_BACKLOG) {
+            i++;
+            continue;
+        }
+        if (client.conn.closed) {
+            printf("Client disconnected, %zu left\n", server->clients.size() - 1);
+        } else {
+            printf("Client dropped, %zu bytes behind, %zu left\n", unsent, server->clients.size() - 1);
+        }
+        entity_destroy(&server->entities, client.player);
+        net_connection_close(&client.conn);
+        if (i + 1 < server->clients.size()) {
+            client = std::move(server->clients.back());
+        }
+        server->clients.pop_back();
+    }
+}
+
+void server_say_bye(Server *server) {
+    for (ServerClient &client : server->clients) {
+        size_t start = net_begin_message(client.conn.out, NET_BYE);
+        net_end_message(client.conn.out, start);
+    }
+}
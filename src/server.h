@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "entity.h"
+#include "jobs.h"
+#include "net.h"
+#include "tick.h"
+#include "world.h"
+
+// Authoritative headless game: owns the world, block ticks and entities,
+// one player entity per client, and streams what each client can see.
+//
+// Per client, the view is every chunk column within SERVER_VIEW_RADIUS of
+// its player. New chunks go out as compressed snapshots, nearest first and
+// only while the connection keeps up; after that every tick carries the
+// block changes and entity deltas inside the loaded chunks:
+//
+//   u32 tick
+//   u32 block changes, each u32 position, u8 block
+//   u16 removed entities, each u32 id
+//   u16 added entities, each u32 id, i16 x y z, u8 mesh, u8 half x y z
+//   u16 moved entities, each u32 id, i8 dx dy dz
+//
+// Positions are fixed point (net_quantize), half extents too but unsigned.
+// An entity moving further than an i8 in one tick is sent as added again.
+
+// chunk columns around the player, in every direction
+#define SERVER_VIEW_RADIUS 4
+// snapshots per client per tick at most
+#define SERVER_CHUNKS_PER_TICK 16
+// no new snapshots while more than this is waiting to be sent
+#define SERVER_SEND_WATERMARK (64 * 1024)
+// clients this far behind are disconnected
+#define SERVER_MAX_BACKLOG (8 * 1024 * 1024)
+#define SERVER_MAX_CLIENTS 256
+// entity updates run at the client frame rate, several per game tick
+#define SERVER_ENTITY_STEPS 3
+
+#define PLAYER_SPEED 4.3f
+#define PLAYER_JUMP_SPEED 8.0f
+// blocks further than this from a player can't be edited by it
+#define PLAYER_REACH 8.0f
+
+struct ServerConfig {
+    int port;        // 0 doesn't listen, clients are only added by server_add_client
+    int size_x;      // world size in chunks
+    int size_y;
+    int size_z;
+    uint32_t seed;
+    uint32_t entities;  // falling blocks kept alive besides the players
+};
+
+// Entity as last sent to a client.
+struct KnownEntity {
+    EntityId id;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+};
+
+struct ServerClient {
+    NetConnection conn;
+    bool joined;        // hello received, has a player
+    EntityId player;
+    int8_t move_x;
+    int8_t move_z;
+    uint8_t buttons;
+
+    // chunk column the view was last filled around, view_done once all of
+    // it is loaded
+    int view_cx;
+    int view_cz;
+    bool view_done;
+    NetVector<uint8_t> loaded;      // per chunk, World::chunks order
+    NetVector<KnownEntity> known;   // by slot
+};
+
+// Live entity of this tick, as it goes on the wire.
+struct NetEntity {
+    EntityId id;
+    int32_t chunk;  // World::chunks index, -1 outside
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    uint8_t mesh;
+    uint8_t half_x;
+    uint8_t half_y;
+    uint8_t half_z;
+};
+
+struct ServerStats {
+    uint32_t clients;
+    uint64_t send_ns;        // time in server_send, last tick
+    uint64_t bytes;          // queued by server_send, last tick
+    uint32_t snapshots;      // chunks sent, last tick
+    uint32_t compressed;     // chunks compressed, last tick
+};
+
+struct Server {
+    World world;
+    TickEngine ticks;
+    EntityWorld entities;
+    JobPool *jobs;
+    int listen_fd;
+    uint32_t entity_target;
+    uint32_t rng;
+
+    NetVector<ServerClient> clients;
+    // block changes since the last server_send, edits and ticks
+    NetVector<BlockChange> changes;
+    // compressed blocks per chunk, dropped when the chunk changes
+    NetVector<NetBuffer> snapshots;
+    NetVector<uint8_t> snapshot_valid;
+    // columns of the view around (0, 0), nearest first
+    NetVector<int16_t> view_offsets;
+    // live entities of this tick in slot order, and bucketed by chunk
+    // column cx * size_z + cz: column c holds the visible indices
+    // column_entities[column_start[c] .. column_start[c + 1]), in slot
+    // order too
+    NetVector<NetEntity> visible;
+    NetVector<uint32_t> column_start;
+    NetVector<uint32_t> column_entities;
+
+    // scratch for the entity sections of a tick message
+    NetBuffer removed;
+    NetBuffer added;
+    NetBuffer moved;
+    NetVector<KnownEntity> next_known;
+    NetVector<uint64_t> nearby;  // bit per visible entity
+
+    ServerStats stats;
+};
+
+bool server_init(Server *server, const ServerConfig *config, JobPool *jobs);
+void server_destroy(Server *server);
+
+// Takes over a connected socket, -1 for a connection that sends nowhere.
+// Returns false when the server is full.
+bool server_add_client(Server *server, int fd);
+// Accepts new connections and handles everything the clients sent.
+void server_receive(Server *server);
+// Simulates one game tick.
+void server_tick(Server *server);
+// Queues this tick's messages for every client.
+void server_send(Server *server);
+// Writes queued messages to the sockets and drops broken or hopelessly
+// slow clients.
+void server_flush(Server *server);
+// Queues NET_BYE for everyone, server_flush until nothing is unsent.
+void server_say_bye(Server *server);
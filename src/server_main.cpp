@@ -0,0 +1,380 @@
+// Headless server, and scripted bots to load it.
+//
+// usage: shahter_server [--port <n>] [--world <x> <y> <z>] [--seed <n>]
+//                       [--entities <n>] [--threads <n>] [--seconds <s>]
+//                       [--bots <n>] [--connect <host>] [--trace <file>]
+//
+// --bots starts that many bots in this process, connected over loopback.
+// When the run ends each bot's copy of the world is checked against the
+// server's, the exit code is 1 if any of them differs. With --connect only
+// the bots run, against a server somewhere else.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "client.h"
+#include "jobs.h"
+#include "server.h"
+#include "trace.h"
+
+#define DEFAULT_WORLD_X 16
+#define DEFAULT_WORLD_Y 4
+#define DEFAULT_WORLD_Z 16
+#define SERVER_SEED 0x5e7e5e7eu
+// how long the bots get to read the last messages at the end
+#define BYE_TIMEOUT_SECONDS 5.0
+// bots change direction this often, in ticks
+#define BOT_TURN_TICKS 40
+// and drop a sand block this often
+#define BOT_SAND_TICKS 10
+
+static volatile sig_atomic_t quit = 0;
+
+static void handle_signal(int) {
+    quit = 1;
+}
+
+struct Bot {
+    NetClient client;
+    uint32_t rng;
+    uint32_t handled;  // ticks acted on
+    int move_x;
+    int move_z;
+    bool done;
+};
+
+static uint32_t bot_random(Bot *bot) {
+    // xorshift32
+    uint32_t x = bot->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    bot->rng = x;
+    return x;
+}
+
+// Wanders around, jumps now and then and drops sand a few blocks above
+// itself, which exercises scheduled ticks and block deltas.
+static void bot_act(Bot *bot) {
+    NetClient *client = &bot->client;
+    const ReplicaEntity *player = client_entity(client, client->player);
+    if (player == NULL) {
+        return;
+    }
+    if (bot->handled % BOT_TURN_TICKS == 0) {
+        bot->move_x = (int)(bot_random(bot) % 255) - 127;
+        bot->move_z = (int)(bot_random(bot) % 255) - 127;
+    }
+    uint8_t buttons = bot_random(bot) % 20 == 0 ? NET_BUTTON_JUMP : 0;
+    client_send_input(client, bot->move_x, bot->move_z, buttons);
+
+    if (bot->handled % BOT_SAND_TICKS == 0) {
+        int x = (int)net_dequantize(player->x);
+        int y = (int)net_dequantize(player->y) + 4;
+        int z = (int)net_dequantize(player->z);
+        if (client_get_block(client, x, y, z) == BLOCK_AIR) {
+            client_send_set_block(client, x, y, z, BLOCK_SAND);
+        }
+    }
+}
+
+// Runs until every bot is done or `stop` is set, then sets `finished`.
+static void run_bots(std::vector<Bot> *bots, std::atomic<bool> *stop, std::atomic<bool> *finished) {
+    TRACE_THREAD_NAME("bots");
+
+    for (;;) {
+        bool all_done = true;
+        for (Bot &bot : *bots) {
+            if (bot.done) {
+                continue;
+            }
+            if (!client_poll(&bot.client) || bot.client.bye) {
+                bot.done = true;
+                continue;
+            }
+            all_done = false;
+            if (bot.client.ticks > bot.handled) {
+                bot.handled = bot.client.ticks;
+                bot_act(&bot);
+            }
+            client_flush(&bot.client);
+        }
+        if (all_done || stop->load()) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    *finished = true;
+}
+
+// Compares what every bot was sent with the server's world and entities.
+static bool verify_bots(const Server *server, const std::vector<Bot> &bots) {
+    bool ok = true;
+    for (size_t b = 0; b < bots.size(); b++) {
+        const NetClient *client = &bots[b].client;
+        const ServerClient *peer = NULL;
+        for (const ServerClient &c : server->clients) {
+            if (c.joined && c.player == client->player) {
+                peer = &c;
+            }
+        }
+        if (peer == NULL || !client->bye) {
+            printf("bot %zu: not connected at the end\n", b);
+            ok = false;
+            continue;
+        }
+
+        uint32_t bad_chunks = 0;
+        for (size_t i = 0; i < peer->loaded.size(); i++) {
+            const uint8_t *blocks = client->chunks[i];
+            if (peer->loaded[i] != (blocks != NULL)) {
+                bad_chunks++;
+            } else if (blocks != NULL && memcmp(blocks, server->world.chunks[i]->blocks, sizeof(Chunk::blocks)) != 0) {
+                bad_chunks++;
+            }
+        }
+        uint32_t bad_entities = client->entity_count != peer->known.size() ? 1 : 0;
+        for (const KnownEntity &known : peer->known) {
+            const ReplicaEntity *e = client_entity(client, known.id);
+            if (e == NULL || e->x != known.x || e->y != known.y || e->z != known.z) {
+                bad_entities++;
+            }
+        }
+
+        printf(
+            "bot %zu: %u chunks, %u entities, %u ticks, %.1f KB received: %s\n",
+            b, client->chunk_count, client->entity_count, client->ticks,
+            (double)client->conn.bytes_received / 1024.0,
+            bad_chunks == 0 && bad_entities == 0 ? "ok" : "MISMATCH"
+        );
+        if (bad_chunks != 0 || bad_entities != 0) {
+            printf("    %u chunks and %u entities differ\n", bad_chunks, bad_entities);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool connect_bots(std::vector<Bot> &bots, int count, const char *host, int port) {
+    bots.resize((size_t)count);
+    for (int i = 0; i < count; i++) {
+        Bot &bot = bots[(size_t)i];
+        bot.rng = SERVER_SEED ^ (uint32_t)(i + 1) * 0x9e3779b9u;
+        bot.handled = 0;
+        bot.move_x = 0;
+        bot.move_z = 0;
+        bot.done = false;
+        if (!client_connect(&bot.client, host, port)) {
+            bots.resize((size_t)i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Bots against a server in another process, no checks.
+static int run_remote_bots(const char *host, int port, int count, double seconds) {
+    std::vector<Bot> bots;
+    if (!connect_bots(bots, count, host, port)) {
+        for (Bot &bot : bots) {
+            client_destroy(&bot.client);
+        }
+        return 1;
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<bool> finished(false);
+    auto start = std::chrono::steady_clock::now();
+    std::thread thread(run_bots, &bots, &stop, &finished);
+    while (!quit && !finished && (seconds <= 0.0 || seconds_since(start) < seconds)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    stop = true;
+    thread.join();
+
+    double elapsed = seconds_since(start);
+    for (size_t b = 0; b < bots.size(); b++) {
+        const NetClient *client = &bots[b].client;
+        printf(
+            "bot %zu: %u chunks, %u entities, %u ticks, %.1f KB/s received\n",
+            b, client->chunk_count, client->entity_count, client->ticks,
+            (double)client->conn.bytes_received / 1024.0 / elapsed
+        );
+        client_destroy(&bots[b].client);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    TRACE_THREAD_NAME("server");
+
+    ServerConfig config = {
+        .port = NET_DEFAULT_PORT,
+        .size_x = DEFAULT_WORLD_X,
+        .size_y = DEFAULT_WORLD_Y,
+        .size_z = DEFAULT_WORLD_Z,
+        .seed = SERVER_SEED,
+        .entities = 0,
+    };
+    int threads = 0;
+    double seconds = 0.0;
+    int bot_count = 0;
+    const char *connect_host = NULL;
+    const char *trace_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            config.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--world") == 0 && i + 3 < argc) {
+            config.size_x = atoi(argv[++i]);
+            config.size_y = atoi(argv[++i]);
+            config.size_z = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--entities") == 0 && i + 1 < argc) {
+            config.entities = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--bots") == 0 && i + 1 < argc) {
+            bot_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connect_host = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else {
+            fprintf(
+                stderr,
+                "usage: %s [--port <n>] [--world <x> <y> <z>] [--seed <n>] [--entities <n>] [--threads <n>]"
+                " [--seconds <s>] [--bots <n>] [--connect <host>] [--trace <file>]\n",
+                argv[0]
+            );
+            return 2;
+        }
+    }
+    if (config.port <= 0 || config.size_x <= 0 || config.size_y <= 0 || config.size_z <= 0) {
+        fprintf(stderr, "Port and world size have to be positive\n");
+        return 2;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    if (connect_host != NULL) {
+        return run_remote_bots(connect_host, config.port, bot_count, seconds);
+    }
+
+    JobPool jobs;
+    jobs_init(&jobs, threads);
+
+    Server server;
+    if (!server_init(&server, &config, &jobs)) {
+        jobs_destroy(&jobs);
+        return 1;
+    }
+    printf(
+        "Listening on port %d, %dx%dx%d chunks, %d job threads\n",
+        config.port, config.size_x, config.size_y, config.size_z, jobs_thread_count(&jobs)
+    );
+
+    std::vector<Bot> bots;
+    std::atomic<bool> stop_bots(false);
+    std::atomic<bool> bots_finished(false);
+    std::thread bot_thread;
+    if (bot_count > 0) {
+        if (!connect_bots(bots, bot_count, "127.0.0.1", config.port)) {
+            quit = 1;
+        }
+        bot_thread = std::thread(run_bots, &bots, &stop_bots, &bots_finished);
+    }
+
+    using clock = std::chrono::steady_clock;
+    const clock::duration tick_time = std::chrono::microseconds(1000000 / TICK_RATE);
+    clock::time_point start = clock::now();
+    clock::time_point next_tick = start;
+    clock::time_point next_report = start + std::chrono::seconds(1);
+    uint64_t report_bytes = 0;
+    uint64_t report_send_ns = 0;
+    uint32_t report_ticks = 0;
+    uint32_t report_snapshots = 0;
+
+    while (!quit && (seconds <= 0.0 || seconds_since(start) < seconds)) {
+        server_receive(&server);
+        server_tick(&server);
+        server_send(&server);
+        server_flush(&server);
+
+        report_bytes += server.stats.bytes;
+        report_send_ns += server.stats.send_ns;
+        report_snapshots += server.stats.snapshots;
+        report_ticks++;
+        if (clock::now() >= next_report) {
+            uint32_t clients = (uint32_t)server.clients.size();
+            printf(
+                "tick %llu: %u clients, %u entities, send %.1f us/tick, %.2f KB/s per client, %u snapshots\n",
+                (unsigned long long)server.ticks.tick, clients, entity_count(&server.entities),
+                (double)report_send_ns / 1000.0 / report_ticks,
+                clients > 0 ? (double)report_bytes / 1024.0 / clients : 0.0,
+                report_snapshots
+            );
+            report_bytes = 0;
+            report_send_ns = 0;
+            report_ticks = 0;
+            report_snapshots = 0;
+            next_report += std::chrono::seconds(1);
+        }
+
+        next_tick += tick_time;
+        if (next_tick < clock::now()) {
+            // too slow to keep up, don't try to catch up in a burst
+            next_tick = clock::now();
+        }
+        std::this_thread::sleep_until(next_tick);
+    }
+
+    int result = 0;
+    if (bot_count > 0) {
+        // one last flush of everything, then the bots get to read it
+        server_say_bye(&server);
+        clock::time_point bye = clock::now();
+        for (;;) {
+            bool unsent = false;
+            for (ServerClient &client : server.clients) {
+                net_flush(&client.conn);
+                unsent = unsent || (!client.conn.closed && net_unsent(&client.conn) > 0);
+            }
+            if (!unsent || seconds_since(bye) > BYE_TIMEOUT_SECONDS) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        while (!bots_finished && seconds_since(bye) < BYE_TIMEOUT_SECONDS) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        stop_bots = true;
+        bot_thread.join();
+
+        result = verify_bots(&server, bots) ? 0 : 1;
+        for (Bot &bot : bots) {
+            client_destroy(&bot.client);
+        }
+    }
+
+    if (trace_path != NULL) {
+        trace_dump(trace_path, 10.0);
+    }
+    server_destroy(&server);
+    jobs_destroy(&jobs);
+    return result;
+}
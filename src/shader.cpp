@@ -4,6 +4,8 @@
 #include <GL/glew.h>
 
 #include "shader.h"
+#include "memory.h"
+#include "trace.h"
 
 static char* get_shader_content(const char *path) {
     FILE *f;
@@ -20,7 +22,7 @@ static char* get_shader_content(const char *path) {
     fclose(f);
 
     f = fopen(path, "r");
-    buffer = (char *)malloc((size_t)(size + 1));
+    buffer = (char *)mem_malloc(MEM_SHADERS, (size_t)(size + 1));
     fread(buffer, 1, (size_t)size, f);
     buffer[size] = '\0';
     fclose(f);
@@ -29,6 +31,8 @@ static char* get_shader_content(const char *path) {
 }
 
 Shader compile_shader(const char *vertex_shader_path, const char *fragment_shader_path) {
+    TRACE_SCOPE("compile_shader");
+
     char *buffer;
 
     int success;
@@ -54,7 +58,7 @@ Shader compile_shader(const char *vertex_shader_path, const char *fragment_shade
         } else {
             printf("Compiled vertex shader: %s\n", vertex_shader_path);
         }
-        free(buffer);
+        mem_free(MEM_SHADERS, buffer);
     } else {
         fprintf(
             stderr,
@@ -83,7 +87,7 @@ Shader compile_shader(const char *vertex_shader_path, const char *fragment_shade
                 fragment_shader_path
             );
         }
-        free(buffer);
+        mem_free(MEM_SHADERS, buffer);
     } else {
         fprintf(
             stderr,
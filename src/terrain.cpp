@@ -0,0 +1,320 @@
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "terrain.h"
+#include "trace.h"
+
+void terrain_init(TerrainMeshes *terrain, const World *world, const BlockCoord *coords, float scale) {
+    terrain->world = world;
+    terrain->coords = coords;
+    terrain->scale = scale;
+    size_t count = (size_t)world->size_x * world->size_y * world->size_z;
+    ChunkMesh empty = {};
+    terrain->meshes.assign(count, empty);
+    terrain->center_x = 0;
+    terrain->center_z = 0;
+    terrain->changed.clear();
+    terrain->sort_camera = glm::vec3(0.0f);
+}
+
+static void free_mesh(ChunkMesh *mesh) {
+    if (mesh->vao != 0) {
+        glDeleteVertexArrays(1, &mesh->vao);
+        gpu_delete_buffers(1, &mesh->vbo);
+    }
+    if (mesh->translucent_vao != 0) {
+        glDeleteVertexArrays(1, &mesh->translucent_vao);
+        gpu_delete_buffers(1, &mesh->translucent_vbo);
+        gpu_delete_buffers(1, &mesh->translucent_ebo);
+    }
+    mesh->vao = 0;
+    mesh->vbo = 0;
+    mesh->vertex_count = 0;
+    mesh->built = false;
+    mesh->dirty = false;
+    mesh->translucent_vao = 0;
+    mesh->translucent_vbo = 0;
+    mesh->translucent_ebo = 0;
+    mesh->translucent = TranslucentMesh();
+    translucent_order_free(&mesh->order);
+    mesh->sorted = false;
+}
+
+void terrain_destroy(TerrainMeshes *terrain) {
+    for (ChunkMesh &mesh : terrain->meshes) {
+        free_mesh(&mesh);
+    }
+    terrain->meshes = TerrainVector<ChunkMesh>();
+    terrain->changed = TerrainVector<uint32_t>();
+    terrain->candidates = TerrainVector<uint64_t>();
+    terrain->vertices = MeshVertices();
+    terrain->translucent = TranslucentMesh();
+    terrain->sorting = TerrainVector<uint32_t>();
+}
+
+static uint32_t chunk_index(const World *world, int cx, int cy, int cz) {
+    return ((uint32_t)cx * world->size_y + cy) * world->size_z + cz;
+}
+
+void terrain_mark_block(TerrainMeshes *terrain, int x, int y, int z) {
+    if (!world_contains(terrain->world, x, y, z)) {
+        return;
+    }
+    // blocks on a border show in the faces and corner shading of the
+    // chunks next to it too, diagonal ones included
+    int cx = x / CHUNK_SIZE;
+    int cy = y / CHUNK_SIZE;
+    int cz = z / CHUNK_SIZE;
+    int lx = x % CHUNK_SIZE;
+    int ly = y % CHUNK_SIZE;
+    int lz = z % CHUNK_SIZE;
+    for (int dx = lx == 0 ? -1 : 0; dx <= (lx == CHUNK_SIZE - 1 ? 1 : 0); dx++) {
+        for (int dy = ly == 0 ? -1 : 0; dy <= (ly == CHUNK_SIZE - 1 ? 1 : 0); dy++) {
+            for (int dz = lz == 0 ? -1 : 0; dz <= (lz == CHUNK_SIZE - 1 ? 1 : 0); dz++) {
+                if (world_chunk(terrain->world, cx + dx, cy + dy, cz + dz)) {
+                    terrain->meshes[chunk_index(terrain->world, cx + dx, cy + dy, cz + dz)].dirty = true;
+                }
+            }
+        }
+    }
+}
+
+static bool in_range(const TerrainMeshes *terrain, int cx, int cz) {
+    return abs(cx - terrain->center_x) <= TERRAIN_MESH_RADIUS && abs(cz - terrain->center_z) <= TERRAIN_MESH_RADIUS;
+}
+
+// For the VAO and array buffer bound.
+static void set_vertex_attributes() {
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, CHUNK_VERTEX_SIZE * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, CHUNK_VERTEX_SIZE * sizeof(float), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, CHUNK_VERTEX_SIZE * sizeof(float), (void *)(5 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+}
+
+static void build_mesh(TerrainMeshes *terrain, GLStateCache *state, int cx, int cy, int cz) {
+    uint32_t index = chunk_index(terrain->world, cx, cy, cz);
+    ChunkMesh *mesh = &terrain->meshes[index];
+
+    terrain->vertices.clear();
+    terrain->translucent.vertices.clear();
+    terrain->translucent.centers.clear();
+    terrain->translucent.splits.clear();
+    ChunkNeighbours around;
+    world_chunk_neighbours(terrain->world, cx, cy, cz, &around);
+    mesh_chunk_neighbours(&around, terrain->coords, terrain->vertices, &terrain->translucent);
+    mesh->vertex_count = (GLsizei)(terrain->vertices.size() / CHUNK_VERTEX_SIZE);
+
+    if (mesh->vertex_count > 0) {
+        if (mesh->vao == 0) {
+            glGenVertexArrays(1, &mesh->vao);
+            glGenBuffers(1, &mesh->vbo);
+            state_bind_vao(state, mesh->vao);
+            glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+            set_vertex_attributes();
+        } else {
+            glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+        }
+        // edited chunks are likely to change again
+        gpu_buffer_data(
+            MEM_MESHES,
+            mesh->vbo,
+            GL_ARRAY_BUFFER,
+            terrain->vertices.size() * sizeof(float),
+            terrain->vertices.data(),
+            mesh->built ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW
+        );
+    }
+
+    size_t quads = terrain->translucent.splits.size();
+    if (quads > 0) {
+        if (mesh->translucent_vao == 0) {
+            glGenVertexArrays(1, &mesh->translucent_vao);
+            glGenBuffers(1, &mesh->translucent_vbo);
+            glGenBuffers(1, &mesh->translucent_ebo);
+            state_bind_vao(state, mesh->translucent_vao);
+            glBindBuffer(GL_ARRAY_BUFFER, mesh->translucent_vbo);
+            set_vertex_attributes();
+        } else {
+            state_bind_vao(state, mesh->translucent_vao);
+            glBindBuffer(GL_ARRAY_BUFFER, mesh->translucent_vbo);
+        }
+        gpu_buffer_data(
+            MEM_MESHES,
+            mesh->translucent_vbo,
+            GL_ARRAY_BUFFER,
+            terrain->translucent.vertices.size() * sizeof(float),
+            terrain->translucent.vertices.data(),
+            mesh->built ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW
+        );
+        // filled by terrain_sort, before anything is drawn from it
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->translucent_ebo);
+        gpu_buffer_data(MEM_MESHES, mesh->translucent_ebo, GL_ELEMENT_ARRAY_BUFFER, quads * 6 * sizeof(uint32_t), NULL, GL_DYNAMIC_DRAW);
+    }
+    // keep what sorting needs, the old arrays become the next scratch
+    std::swap(mesh->translucent.centers, terrain->translucent.centers);
+    std::swap(mesh->translucent.splits, terrain->translucent.splits);
+    mesh->sorted = false;
+
+    glm::mat4 transform = glm::scale(glm::mat4(1.0f), glm::vec3(terrain->scale));
+    mesh->transform = glm::translate(transform, glm::vec3(cx, cy, cz) * (float)CHUNK_SIZE);
+    if (!mesh->built) {
+        terrain->changed.push_back(index);
+    }
+    mesh->built = true;
+    mesh->dirty = false;
+}
+
+void terrain_update(TerrainMeshes *terrain, GLStateCache *state, glm::vec3 camera) {
+    TRACE_SCOPE("terrain_update");
+
+    const World *world = terrain->world;
+    // blocks are centered on their coordinates
+    terrain->center_x = (int)floorf((camera.x + 0.5f) / CHUNK_SIZE);
+    terrain->center_z = (int)floorf((camera.z + 0.5f) / CHUNK_SIZE);
+    terrain->changed.clear();
+
+    for (int cx = 0; cx < world->size_x; cx++) {
+        for (int cz = 0; cz < world->size_z; cz++) {
+            if (in_range(terrain, cx, cz)) {
+                continue;
+            }
+            for (int cy = 0; cy < world->size_y; cy++) {
+                uint32_t index = chunk_index(world, cx, cy, cz);
+                if (terrain->meshes[index].built) {
+                    free_mesh(&terrain->meshes[index]);
+                    terrain->changed.push_back(index);
+                }
+            }
+        }
+    }
+
+    // nearest first: squared distance in the high bits, chunk index in the low
+    terrain->candidates.clear();
+    // over the mesh budget only edited chunks are meshed again, the far
+    // field keeps drawing the ones that have no mesh yet
+    bool over_budget = mem_over_budget(MEM_MESHES);
+    int x1 = std::max(terrain->center_x - TERRAIN_MESH_RADIUS, 0);
+    int x2 = std::min(terrain->center_x + TERRAIN_MESH_RADIUS, world->size_x - 1);
+    int z1 = std::max(terrain->center_z - TERRAIN_MESH_RADIUS, 0);
+    int z2 = std::min(terrain->center_z + TERRAIN_MESH_RADIUS, world->size_z - 1);
+    for (int cx = x1; cx <= x2; cx++) {
+        for (int cy = 0; cy < world->size_y; cy++) {
+            for (int cz = z1; cz <= z2; cz++) {
+                uint32_t index = chunk_index(world, cx, cy, cz);
+                const ChunkMesh &mesh = terrain->meshes[index];
+                if ((mesh.built && !mesh.dirty) || (!mesh.built && over_budget)) {
+                    continue;
+                }
+                glm::vec3 center = (glm::vec3(cx, cy, cz) + 0.5f) * (float)CHUNK_SIZE - 0.5f;
+                glm::vec3 offset = center - camera;
+                float distance = glm::dot(offset, offset);
+                uint32_t bits;
+                memcpy(&bits, &distance, sizeof(bits));
+                terrain->candidates.push_back(((uint64_t)bits << 32) | index);
+            }
+        }
+    }
+    size_t builds = std::min(terrain->candidates.size(), (size_t)TERRAIN_BUILDS_PER_UPDATE);
+    std::partial_sort(terrain->candidates.begin(), terrain->candidates.begin() + (ptrdiff_t)builds, terrain->candidates.end());
+
+    for (size_t i = 0; i < builds; i++) {
+        TRACE_SCOPE("mesh_chunk");
+        uint32_t index = (uint32_t)terrain->candidates[i];
+        int cz = (int)(index % (uint32_t)world->size_z);
+        int cy = (int)(index / (uint32_t)world->size_z % (uint32_t)world->size_y);
+        int cx = (int)(index / (uint32_t)world->size_z / (uint32_t)world->size_y);
+        build_mesh(terrain, state, cx, cy, cz);
+    }
+}
+
+static void sort_job(void *ctx, uint32_t first, uint32_t last) {
+    TerrainMeshes *terrain = (TerrainMeshes *)ctx;
+    const World *world = terrain->world;
+    for (uint32_t i = first; i < last; i++) {
+        uint32_t index = terrain->sorting[i];
+        int cz = (int)(index % (uint32_t)world->size_z);
+        int cy = (int)(index / (uint32_t)world->size_z % (uint32_t)world->size_y);
+        int cx = (int)(index / (uint32_t)world->size_z / (uint32_t)world->size_y);
+        ChunkMesh *mesh = &terrain->meshes[index];
+        glm::vec3 origin = glm::vec3(cx, cy, cz) * (float)CHUNK_SIZE;
+        translucent_sort(&mesh->order, &mesh->translucent, terrain->sort_camera - origin);
+    }
+}
+
+void terrain_sort(TerrainMeshes *terrain, GLStateCache *state, JobPool *jobs, glm::vec3 camera) {
+    TRACE_SCOPE("terrain_sort");
+
+    // within a block the order of faces hardly changes, so moving inside
+    // one doesn't re-sort anything
+    glm::ivec3 block = glm::ivec3(glm::floor(camera + 0.5f));
+    terrain->sorting.clear();
+    for (uint32_t index = 0; index < (uint32_t)terrain->meshes.size(); index++) {
+        const ChunkMesh &mesh = terrain->meshes[index];
+        if (mesh.translucent.splits.empty() || (mesh.sorted && mesh.sorted_at == block)) {
+            continue;
+        }
+        terrain->sorting.push_back(index);
+    }
+    if (terrain->sorting.empty()) {
+        return;
+    }
+
+    terrain->sort_camera = camera;
+    jobs_parallel_for(jobs, (uint32_t)terrain->sorting.size(), 1, sort_job, terrain);
+
+    for (uint32_t index : terrain->sorting) {
+        ChunkMesh *mesh = &terrain->meshes[index];
+        GLsizeiptr size = (GLsizeiptr)(mesh->order.indices.size() * sizeof(uint32_t));
+        // the element buffer is VAO state, bind through the one it belongs to
+        state_bind_vao(state, mesh->translucent_vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->translucent_ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, size, mesh->order.indices.data());
+        mesh->sorted = true;
+        mesh->sorted_at = block;
+    }
+}
+
+void terrain_submit(
+    const TerrainMeshes *terrain,
+    RenderQueue *queue,
+    DrawItem item,
+    glm::vec3 camera,
+    float view_distance,
+    bool translucent
+) {
+    const World *world = terrain->world;
+    int x1 = std::max(terrain->center_x - TERRAIN_MESH_RADIUS, 0);
+    int x2 = std::min(terrain->center_x + TERRAIN_MESH_RADIUS, world->size_x - 1);
+    int z1 = std::max(terrain->center_z - TERRAIN_MESH_RADIUS, 0);
+    int z2 = std::min(terrain->center_z + TERRAIN_MESH_RADIUS, world->size_z - 1);
+    for (int cx = x1; cx <= x2; cx++) {
+        for (int cy = 0; cy < world->size_y; cy++) {
+            for (int cz = z1; cz <= z2; cz++) {
+                const ChunkMesh &mesh = terrain->meshes[chunk_index(world, cx, cy, cz)];
+                if (translucent ? !mesh.sorted || mesh.translucent.splits.empty() : mesh.vertex_count == 0) {
+                    continue;
+                }
+                glm::vec3 center = glm::vec3(mesh.transform * glm::vec4(glm::vec3(CHUNK_SIZE / 2.0f - 0.5f), 1.0f));
+                if (translucent) {
+                    item.vao = mesh.translucent_vao;
+                    item.count = (GLsizei)(mesh.translucent.splits.size() * 6);
+                    item.index_type = GL_UNSIGNED_INT;
+                } else {
+                    item.vao = mesh.vao;
+                    item.count = mesh.vertex_count;
+                }
+                item.first = 0;
+                item.model = &mesh.transform;
+                item.depth = glm::distance(camera, center) / view_distance;
+                render_queue_submit(queue, item);
+            }
+        }
+    }
+}
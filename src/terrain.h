@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "jobs.h"
+#include "render.h"
+#include "translucent.h"
+#include "world.h"
+
+// One mesh per chunk for the chunks around the camera. Chunks further out
+// than TERRAIN_MESH_RADIUS along x or z lose their mesh, the far field
+// draws them instead, see farfield.h.
+
+#define TERRAIN_MESH_RADIUS 4
+// meshes built per terrain_update, nearest first, so walking into new
+// chunks doesn't hitch
+#define TERRAIN_BUILDS_PER_UPDATE 16
+
+struct ChunkMesh {
+    GLuint vao;  // 0 until there is something to draw
+    GLuint vbo;
+    GLsizei vertex_count;
+    bool built;  // drawn by this mesh, possibly nothing
+    bool dirty;  // blocks changed since it was built
+    glm::mat4 transform;
+
+    // translucent faces, drawn through the element buffer in `order`
+    GLuint translucent_vao;  // 0 until there are translucent faces
+    GLuint translucent_vbo;
+    GLuint translucent_ebo;
+    TranslucentMesh translucent;  // centers and splits, the vertices are in the VBO
+    TranslucentOrder order;
+    bool sorted;           // the element buffer fits the current faces
+    glm::ivec3 sorted_at;  // camera block it was sorted for
+};
+
+template <class T>
+using TerrainVector = std::vector<T, TagAllocator<T, MEM_MESHES>>;
+
+struct TerrainMeshes {
+    const World *world;
+    const BlockCoord *coords;  // indexed by block type, kept alive by the caller
+    float scale;               // chunk space to world space
+    TerrainVector<ChunkMesh> meshes;  // like World::chunks
+    int center_x;  // chunk the camera is in
+    int center_z;
+
+    // chunks whose built flag changed in the last terrain_update
+    TerrainVector<uint32_t> changed;
+
+    // scratch
+    TerrainVector<uint64_t> candidates;
+    MeshVertices vertices;
+    TranslucentMesh translucent;
+    TerrainVector<uint32_t> sorting;  // chunks sorted by terrain_sort
+    glm::vec3 sort_camera;
+};
+
+void terrain_init(TerrainMeshes *terrain, const World *world, const BlockCoord *coords, float scale);
+void terrain_destroy(TerrainMeshes *terrain);
+
+// The block at (x, y, z) changed, its chunk gets meshed again, and so do
+// the chunks it borders.
+void terrain_mark_block(TerrainMeshes *terrain, int x, int y, int z);
+// Follows the camera (in chunk space): drops meshes that went out of range
+// and builds up to TERRAIN_BUILDS_PER_UPDATE missing or dirty ones. No
+// missing ones while MEM_MESHES is over its budget. New VAOs are bound
+// through `state`.
+void terrain_update(TerrainMeshes *terrain, GLStateCache *state, glm::vec3 camera);
+// Sorts the translucent faces of the meshes that were rebuilt or whose
+// order was made for another camera block, spread over `jobs`, and uploads
+// the new orders. Camera in chunk space, call after terrain_update.
+void terrain_sort(TerrainMeshes *terrain, GLStateCache *state, JobPool *jobs, glm::vec3 camera);
+// Submits a copy of `item` per mesh with its VAO, count and transform,
+// depth is the distance from `camera` (world space) over `view_distance`.
+// With `translucent` the translucent faces are submitted instead.
+void terrain_submit(
+    const TerrainMeshes *terrain,
+    RenderQueue *queue,
+    DrawItem item,
+    glm::vec3 camera,
+    float view_distance,
+    bool translucent = false
+);
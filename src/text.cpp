@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "text.h"
+#include "trace.h"
+
+#include FT_MODULE_H
+
+#define PAGE_CELLS_PER_ROW (GLYPH_PAGE_SIZE / GLYPH_CELL_SIZE)
+#define CELL_BYTES (GLYPH_CELL_SIZE * GLYPH_CELL_SIZE)
+
+static inline uint64_t glyph_key(int font, uint32_t codepoint) {
+    return ((uint64_t)(uint32_t)font << 32) | codepoint;
+}
+
+bool glyph_cache_init(GlyphCache *cache) {
+    if (FT_Init_FreeType(&cache->library)) {
+        fprintf(stderr, "ERROR::FREETYPE: Could not init FreeType Library\n");
+        return false;
+    }
+
+    // both SDF renderers, outlines and bitmap fonts
+    FT_Int spread = GLYPH_SDF_SPREAD;
+    FT_Property_Set(cache->library, "sdf", "spread", &spread);
+    FT_Property_Set(cache->library, "bsdf", "spread", &spread);
+
+    cache->pages = 0;
+    memset(cache->textures, 0, sizeof(cache->textures));
+    memset(cache->page_allocated, 0, sizeof(cache->page_allocated));
+    cache->lru_head = -1;
+    cache->lru_tail = -1;
+    cache->frame = 1;
+    cache->full_warned = false;
+
+    return true;
+}
+
+void glyph_cache_init_gl(GlyphCache *cache) {
+    glGenTextures(GLYPH_MAX_PAGES, cache->textures);
+}
+
+void glyph_cache_destroy(GlyphCache *cache) {
+    if (cache->textures[0]) {
+        gpu_delete_textures(GLYPH_MAX_PAGES, cache->textures);
+        memset(cache->textures, 0, sizeof(cache->textures));
+    }
+    for (FT_Face face : cache->fonts) {
+        FT_Done_Face(face);
+    }
+    cache->fonts.clear();
+    cache->glyphs.clear();
+    FT_Done_FreeType(cache->library);
+}
+
+int glyph_cache_add_font(GlyphCache *cache, const char *path) {
+    FT_Face face;
+    if (FT_New_Face(cache->library, path, 0, &face)) {
+        fprintf(stderr, "ERROR::FREETYPE: Failed to load font %s\n", path);
+        return -1;
+    }
+    FT_Set_Pixel_Sizes(face, 0, GLYPH_SDF_PIXELS);
+
+    cache->fonts.push_back(face);
+    return (int)cache->fonts.size() - 1;
+}
+
+void glyph_cache_begin_frame(GlyphCache *cache) {
+    cache->frame++;
+}
+
+static void lru_unlink(GlyphCache *cache, int cell) {
+    int prev = cache->lru_prev[cell];
+    int next = cache->lru_next[cell];
+    if (prev >= 0) {
+        cache->lru_next[prev] = next;
+    } else {
+        cache->lru_head = next;
+    }
+    if (next >= 0) {
+        cache->lru_prev[next] = prev;
+    } else {
+        cache->lru_tail = prev;
+    }
+}
+
+static void lru_push_front(GlyphCache *cache, int cell) {
+    cache->lru_prev[cell] = -1;
+    cache->lru_next[cell] = cache->lru_head;
+    if (cache->lru_head >= 0) {
+        cache->lru_prev[cache->lru_head] = cell;
+    } else {
+        cache->lru_tail = cell;
+    }
+    cache->lru_head = cell;
+}
+
+static int alloc_cell(GlyphCache *cache) {
+    if (cache->free_cells.empty()) {
+        if (cache->pages < GLYPH_MAX_PAGES) {
+            int first = cache->pages * GLYPH_PAGE_CELLS;
+            cache->pages++;
+            cache->cell_owner.resize(cache->pages * GLYPH_PAGE_CELLS);
+            cache->lru_prev.resize(cache->pages * GLYPH_PAGE_CELLS);
+            cache->lru_next.resize(cache->pages * GLYPH_PAGE_CELLS);
+            // lowest cell first
+            for (int cell = first + GLYPH_PAGE_CELLS - 1; cell >= first; cell--) {
+                cache->free_cells.push_back(cell);
+            }
+        } else {
+            // everything ahead of the tail was drawn at least as recently
+            int victim = cache->lru_tail;
+            auto it = cache->glyphs.find(cache->cell_owner[victim]);
+            if (it->second.used_frame == cache->frame) {
+                return -1;
+            }
+            cache->glyphs.erase(it);
+            lru_unlink(cache, victim);
+            cache->free_cells.push_back(victim);
+        }
+    }
+
+    int cell = cache->free_cells.back();
+    cache->free_cells.pop_back();
+    return cell;
+}
+
+// `pixels` rows are `pitch` bytes apart, NULL reserves the cell only
+static const Glyph *store_glyph(
+    GlyphCache *cache,
+    uint64_t key,
+    GlyphMetrics metrics,
+    const uint8_t *pixels,
+    int pitch
+) {
+    Glyph glyph = {};
+    glyph.cell = -1;
+    glyph.used_frame = cache->frame;
+
+    if (metrics.size.x > 0 && metrics.size.y > 0) {
+        int cell = alloc_cell(cache);
+        if (cell < 0) {
+            if (!cache->full_warned) {
+                fprintf(stderr, "WARNING: Glyph cache is full of glyphs drawn this frame, skipping new ones\n");
+                cache->full_warned = true;
+            }
+            return NULL;
+        }
+        cache->cell_owner[cell] = key;
+        lru_push_front(cache, cell);
+
+        if (metrics.size.x > GLYPH_CELL_SIZE) {
+            metrics.size.x = GLYPH_CELL_SIZE;
+        }
+        if (metrics.size.y > GLYPH_CELL_SIZE) {
+            metrics.size.y = GLYPH_CELL_SIZE;
+        }
+
+        int index = cell % GLYPH_PAGE_CELLS;
+        float cx = (float)(index % PAGE_CELLS_PER_ROW * GLYPH_CELL_SIZE);
+        float cy = (float)(index / PAGE_CELLS_PER_ROW * GLYPH_CELL_SIZE);
+        glyph.cell = cell;
+        glyph.uv = glm::vec4(
+            cx / GLYPH_PAGE_SIZE,
+            cy / GLYPH_PAGE_SIZE,
+            (cx + metrics.size.x) / GLYPH_PAGE_SIZE,
+            (cy + metrics.size.y) / GLYPH_PAGE_SIZE
+        );
+
+        if (pixels) {
+            // whole cells are uploaded, so nothing of an evicted glyph
+            // is left to bleed in through filtering
+            size_t offset = cache->pending_pixels.size();
+            cache->pending_pixels.resize(offset + CELL_BYTES);
+            uint8_t *dst = cache->pending_pixels.data() + offset;
+            memset(dst, 0, CELL_BYTES);
+            for (int row = 0; row < metrics.size.y; row++) {
+                memcpy(dst + row * GLYPH_CELL_SIZE, pixels + (ptrdiff_t)row * pitch, metrics.size.x);
+            }
+            cache->pending_cells.push_back(cell);
+        }
+    }
+    glyph.metrics = metrics;
+
+    Glyph &stored = cache->glyphs[key];
+    stored = glyph;
+    return &stored;
+}
+
+static const Glyph *rasterize_glyph(GlyphCache *cache, int font, uint32_t codepoint) {
+    TRACE_SCOPE("rasterize_glyph");
+
+    FT_Face face = cache->fonts[font];
+    uint64_t key = glyph_key(font, codepoint);
+
+    if (FT_Load_Char(face, codepoint, FT_LOAD_DEFAULT)) {
+        fprintf(stderr, "ERROR::FREETYPE: Failed to load glyph U+%04X\n", codepoint);
+        // remember it as blank so it isn't loaded again every frame
+        return store_glyph(cache, key, GlyphMetrics {}, NULL, 0);
+    }
+
+    FT_GlyphSlot slot = face->glyph;
+    GlyphMetrics metrics = {};
+    metrics.advance = (float)slot->advance.x / 64.0f;
+
+    // whitespace has no outline to render
+    if (
+        (slot->format == FT_GLYPH_FORMAT_OUTLINE && slot->outline.n_points == 0)
+        || FT_Render_Glyph(slot, FT_RENDER_MODE_SDF)
+    ) {
+        return store_glyph(cache, key, metrics, NULL, 0);
+    }
+
+    metrics.size = glm::ivec2(slot->bitmap.width, slot->bitmap.rows);
+    metrics.bearing = glm::ivec2(slot->bitmap_left, slot->bitmap_top);
+
+    const uint8_t *pixels = slot->bitmap.buffer;
+    int pitch = slot->bitmap.pitch;
+    if (pitch < 0) {
+        // bottom-up bitmap, start at the top row
+        pixels += (ptrdiff_t)(-pitch) * (slot->bitmap.rows - 1);
+    }
+    return store_glyph(cache, key, metrics, pixels, pitch);
+}
+
+const Glyph *glyph_cache_get(GlyphCache *cache, int font, uint32_t codepoint) {
+    auto it = cache->glyphs.find(glyph_key(font, codepoint));
+    if (it != cache->glyphs.end()) {
+        Glyph &glyph = it->second;
+        if (glyph.used_frame != cache->frame) {
+            glyph.used_frame = cache->frame;
+            if (glyph.cell >= 0) {
+                lru_unlink(cache, glyph.cell);
+                lru_push_front(cache, glyph.cell);
+            }
+        }
+        return &glyph;
+    }
+
+    if (font < 0 || font >= (int)cache->fonts.size()) {
+        return NULL;
+    }
+    return rasterize_glyph(cache, font, codepoint);
+}
+
+const Glyph *glyph_cache_insert(GlyphCache *cache, int font, uint32_t codepoint, const GlyphMetrics &metrics, const uint8_t *sdf) {
+    uint64_t key = glyph_key(font, codepoint);
+
+    auto it = cache->glyphs.find(key);
+    if (it != cache->glyphs.end() && it->second.cell >= 0) {
+        lru_unlink(cache, it->second.cell);
+        cache->free_cells.push_back(it->second.cell);
+    }
+    return store_glyph(cache, key, metrics, sdf, metrics.size.x);
+}
+
+GLuint glyph_cache_texture(const GlyphCache *cache, int cell) {
+    return cache->textures[cell / GLYPH_PAGE_CELLS];
+}
+
+void glyph_cache_upload(GlyphCache *cache, GLStateCache *state) {
+    if (cache->pending_cells.empty()) {
+        return;
+    }
+    TRACE_SCOPE("glyph_cache_upload");
+
+    for (size_t i = 0; i < cache->pending_cells.size(); i++) {
+        int cell = cache->pending_cells[i];
+        int page = cell / GLYPH_PAGE_CELLS;
+        int index = cell % GLYPH_PAGE_CELLS;
+        GLuint texture = cache->textures[page];
+
+        state_bind_texture(state, GL_TEXTURE_2D, texture);
+        if (!cache->page_allocated[page]) {
+            // cells are always written whole before they are drawn
+            gpu_tex_image_2d(MEM_TEXT, texture, GL_TEXTURE_2D, 0, GL_R8, GLYPH_PAGE_SIZE, GLYPH_PAGE_SIZE, GL_RED, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            cache->page_allocated[page] = true;
+        }
+
+        glTexSubImage2D(
+            GL_TEXTURE_2D,
+            0,
+            index % PAGE_CELLS_PER_ROW * GLYPH_CELL_SIZE,
+            index / PAGE_CELLS_PER_ROW * GLYPH_CELL_SIZE,
+            GLYPH_CELL_SIZE,
+            GLYPH_CELL_SIZE,
+            GL_RED,
+            GL_UNSIGNED_BYTE,
+            cache->pending_pixels.data() + i * CELL_BYTES
+        );
+    }
+
+    cache->pending_cells.clear();
+    cache->pending_pixels.clear();
+}
+
+uint32_t utf8_next(const char **p, const char *end) {
+    const uint8_t *s = (const uint8_t *)*p;
+    uint32_t c = s[0];
+
+    int extra;
+    uint32_t min;
+    if (c < 0x80) {
+        *p += 1;
+        return c;
+    } else if ((c & 0xE0) == 0xC0) {
+        extra = 1;
+        min = 0x80;
+        c &= 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        extra = 2;
+        min = 0x800;
+        c &= 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        extra = 3;
+        min = 0x10000;
+        c &= 0x07;
+    } else {
+        // stray continuation byte or invalid lead byte
+        *p += 1;
+        return 0xFFFD;
+    }
+
+    for (int i = 1; i <= extra; i++) {
+        if ((const char *)s + i >= end || (s[i] & 0xC0) != 0x80) {
+            *p += i;
+            return 0xFFFD;
+        }
+        c = (c << 6) | (s[i] & 0x3F);
+    }
+    *p += extra + 1;
+
+    // overlong encodings, surrogates and values past Unicode
+    if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+        return 0xFFFD;
+    }
+    return c;
+}
+
+static void submit_run(RenderQueue *queue, TextBatch *batch, GLuint texture, GLint first, GLsizei count) {
+    if (count == 0) {
+        return;
+    }
+    DrawItem item = {
+        .pass = PASS_HUD,
+        .program = batch->program,
+        .texture_target = GL_TEXTURE_2D,
+        .texture = texture,
+        .vao = batch->vao,
+        .mode = GL_TRIANGLES,
+        .first = first,
+        .count = count,
+        .model = NULL,
+        .model_location = -1,
+        .depth = 0.0f,
+    };
+    render_queue_submit(queue, item);
+}
+
+void render_text(
+    RenderQueue *queue,
+    TextBatch *batch,
+    const char *text,
+    float x,
+    float y,
+    float size,
+    glm::vec3 color,
+    int font
+) {
+    float scale = size / GLYPH_SDF_PIXELS;
+
+    GLuint run_texture = 0;
+    GLint run_first = 0;
+    GLsizei run_count = 0;
+
+    const char *p = text;
+    const char *end = p + strlen(text);
+    while (p < end) {
+        const Glyph *glyph = glyph_cache_get(batch->glyphs, font, utf8_next(&p, end));
+        if (glyph == NULL) {
+            continue;
+        }
+        const GlyphMetrics &m = glyph->metrics;
+
+        float xpos = x + m.bearing.x * scale;
+        float ypos = y - (m.size.y - m.bearing.y) * scale;
+
+        float w = m.size.x * scale;
+        float h = m.size.y * scale;
+
+        x += m.advance * scale;
+
+        // nothing to draw for whitespace
+        if (glyph->cell < 0) {
+            continue;
+        }
+
+        const glm::vec4 &uv = glyph->uv;
+        float vertices[6][TEXT_VERTEX_SIZE] = {
+            { xpos,     ypos + h,   uv.x, uv.y, color.x, color.y, color.z },
+            { xpos,     ypos,       uv.x, uv.w, color.x, color.y, color.z },
+            { xpos + w, ypos,       uv.z, uv.w, color.x, color.y, color.z },
+
+            { xpos,     ypos + h,   uv.x, uv.y, color.x, color.y, color.z },
+            { xpos + w, ypos,       uv.z, uv.w, color.x, color.y, color.z },
+            { xpos + w, ypos + h,   uv.z, uv.y, color.x, color.y, color.z }
+        };
+        GLint first = (GLint)(batch->vertices.size() / TEXT_VERTEX_SIZE);
+        batch->vertices.insert(batch->vertices.end(), &vertices[0][0], &vertices[0][0] + 6 * TEXT_VERTEX_SIZE);
+
+        // one draw for every run of glyphs on the same page
+        GLuint texture = glyph_cache_texture(batch->glyphs, glyph->cell);
+        if (run_count > 0 && texture != run_texture) {
+            submit_run(queue, batch, run_texture, run_first, run_count);
+            run_count = 0;
+        }
+        if (run_count == 0) {
+            run_texture = texture;
+            run_first = first;
+        }
+        run_count += 6;
+    }
+    submit_run(queue, batch, run_texture, run_first, run_count);
+}
+
+void text_batch_upload(TextBatch *batch, GLStateCache *state) {
+    TRACE_SCOPE("text_batch_upload");
+
+    glyph_cache_upload(batch->glyphs, state);
+
+    size_t size = batch->vertices.size() * sizeof(float);
+
+    glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+    if (size > batch->capacity) {
+        gpu_buffer_data(MEM_TEXT, batch->vbo, GL_ARRAY_BUFFER, size, batch->vertices.data(), GL_DYNAMIC_DRAW);
+        batch->capacity = size;
+    } else {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, batch->vertices.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "render.h"
+
+// Glyphs are rasterized once as signed distance fields at this em size and
+// scaled to any text size by the font shader.
+#define GLYPH_SDF_PIXELS 40
+// distance range around the outline in texels, 128 is the edge
+#define GLYPH_SDF_SPREAD 8
+
+// Atlas pages are split into fixed cells, one glyph each. A cell fits the
+// em box plus the spread on both sides, larger glyphs get clipped.
+#define GLYPH_PAGE_SIZE 1024
+#define GLYPH_CELL_SIZE 64
+#define GLYPH_PAGE_CELLS ((GLYPH_PAGE_SIZE / GLYPH_CELL_SIZE) * (GLYPH_PAGE_SIZE / GLYPH_CELL_SIZE))
+#define GLYPH_MAX_PAGES 8
+
+// Size and placement of a glyph bitmap at GLYPH_SDF_PIXELS, spread included.
+struct GlyphMetrics {
+    glm::ivec2 size;     // bitmap size in pixels
+    glm::ivec2 bearing;  // pen position to the left/top of the bitmap
+    float advance;       // pen advance in pixels
+};
+
+struct Glyph {
+    GlyphMetrics metrics;
+    int cell;            // global cell index, -1 for glyphs without pixels
+    glm::vec4 uv;        // x1, y1 (top), x2, y2 in the page
+    uint64_t used_frame;
+};
+
+template <class K, class V>
+using TextMap = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, TagAllocator<std::pair<const K, V>, MEM_TEXT>>;
+
+template <class T>
+using TextVector = std::vector<T, TagAllocator<T, MEM_TEXT>>;
+
+// On-demand glyph cache keyed by (codepoint, font). Cells are recycled in
+// least recently used order once GLYPH_MAX_PAGES are full, a glyph drawn in
+// the current frame is never evicted.
+struct GlyphCache {
+    FT_Library library;
+    TextVector<FT_Face> fonts;
+
+    TextMap<uint64_t, Glyph> glyphs;
+
+    int pages;
+    GLuint textures[GLYPH_MAX_PAGES];
+    bool page_allocated[GLYPH_MAX_PAGES];  // storage is made on the first upload
+    TextVector<uint64_t> cell_owner;   // glyph key per cell
+    TextVector<int> free_cells;
+    // LRU list over cells in use, head is the most recently drawn
+    TextVector<int> lru_prev;
+    TextVector<int> lru_next;
+    int lru_head;
+    int lru_tail;
+
+    // rasterized cells waiting for glyph_cache_upload
+    TextVector<int> pending_cells;
+    TextVector<uint8_t> pending_pixels;
+
+    uint64_t frame;
+    bool full_warned;
+};
+
+// CPU side only, glyphs can be laid out without a GL context.
+bool glyph_cache_init(GlyphCache *cache);
+// Names the page textures, needs the GL context.
+void glyph_cache_init_gl(GlyphCache *cache);
+void glyph_cache_destroy(GlyphCache *cache);
+// Returns the font index, -1 if it can't be loaded.
+int glyph_cache_add_font(GlyphCache *cache, const char *path);
+// Starts a frame, glyphs drawn before the next call stay resident.
+void glyph_cache_begin_frame(GlyphCache *cache);
+// Looks a glyph up and rasterizes it on a miss. NULL if the cache is full
+// of glyphs drawn this frame or the font doesn't exist.
+const Glyph *glyph_cache_get(GlyphCache *cache, int font, uint32_t codepoint);
+// Adds a glyph rasterized elsewhere, `sdf` is size.x * size.y bytes or NULL
+// to only reserve the cell.
+const Glyph *glyph_cache_insert(GlyphCache *cache, int font, uint32_t codepoint, const GlyphMetrics &metrics, const uint8_t *sdf);
+// Creates pages and copies rasterized glyphs into them. Binds textures
+// through `state`.
+void glyph_cache_upload(GlyphCache *cache, GLStateCache *state);
+// Atlas page texture of a cell.
+GLuint glyph_cache_texture(const GlyphCache *cache, int cell);
+
+// Decodes one UTF-8 sequence and advances `p`, U+FFFD for malformed input.
+uint32_t utf8_next(const char **p, const char *end);
+
+// floats per text vertex: position (2), texture coords (2), color (3)
+#define TEXT_VERTEX_SIZE 7
+
+// All HUD text of a frame, uploaded with one buffer update.
+struct TextBatch {
+    GLuint program;
+    GLuint vao;
+    GLuint vbo;
+    size_t capacity; // bytes allocated for vbo
+    GlyphCache *glyphs;
+    TextVector<float> vertices;
+};
+
+// Lays UTF-8 `text` out into the batch at `size` pixels per em and submits
+// one HUD item per run of glyphs on the same atlas page.
+void render_text(
+    RenderQueue *queue,
+    TextBatch *batch,
+    const char *text,
+    float x,
+    float y,
+    float size,
+    glm::vec3 color,
+    int font = 0
+);
+// Uploads new glyphs and all vertices laid out this frame, call before
+// executing the queue.
+void text_batch_upload(TextBatch *batch, GLStateCache *state);
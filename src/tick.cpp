@@ -0,0 +1,297 @@
+#include <algorithm>
+
+#include "tick.h"
+#include "trace.h"
+
+enum TickKind : uint8_t {
+    TICK_NONE = 0,
+    TICK_SCHEDULED = 1 << 0,
+    TICK_RANDOM = 1 << 1,
+};
+
+// which ticks every block type reacts to, indexed by Block
+static const uint8_t BLOCK_TICKS[BLOCK_COUNT] = {
+    TICK_NONE,       // air
+    TICK_NONE,       // furnace
+    TICK_SCHEDULED,  // sand
+    TICK_NONE,       // dirt
+    TICK_RANDOM,     // grass
+    TICK_NONE,       // water
+    TICK_NONE,       // glass
+};
+
+static uint32_t scheduled_delay(uint8_t block) {
+    switch (block) {
+    case BLOCK_SAND:
+        return TICK_SAND_DELAY;
+    default:
+        return 1;
+    }
+}
+
+// splitmix64, also good as a hash of its starting state
+static inline uint64_t tick_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// min heap order for std::push_heap / pop_heap
+static bool tick_later(const ScheduledTick &a, const ScheduledTick &b) {
+    if (a.tick != b.tick) {
+        return a.tick > b.tick;
+    }
+    return a.order > b.order;
+}
+
+static bool position_less(const BlockChange &a, const BlockChange &b) {
+    if (a.x != b.x) {
+        return a.x < b.x;
+    }
+    if (a.y != b.y) {
+        return a.y < b.y;
+    }
+    return a.z < b.z;
+}
+
+static bool position_equal(const BlockChange &a, const BlockChange &b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static int region_index(const TickEngine *engine, int x, int y, int z) {
+    int rx = x / CHUNK_SIZE / TICK_REGION_CHUNKS;
+    int ry = y / CHUNK_SIZE / TICK_REGION_CHUNKS;
+    int rz = z / CHUNK_SIZE / TICK_REGION_CHUNKS;
+    return (rx * engine->regions_y + ry) * engine->regions_z + rz;
+}
+
+bool tick_init(TickEngine *engine, World *world, uint32_t seed) {
+    engine->world = world;
+    engine->regions_x = (world->size_x + TICK_REGION_CHUNKS - 1) / TICK_REGION_CHUNKS;
+    engine->regions_y = (world->size_y + TICK_REGION_CHUNKS - 1) / TICK_REGION_CHUNKS;
+    engine->regions_z = (world->size_z + TICK_REGION_CHUNKS - 1) / TICK_REGION_CHUNKS;
+    engine->regions.clear();
+    engine->regions.resize((size_t)engine->regions_x * engine->regions_y * engine->regions_z);
+    for (int rx = 0; rx < engine->regions_x; rx++) {
+        for (int ry = 0; ry < engine->regions_y; ry++) {
+            for (int rz = 0; rz < engine->regions_z; rz++) {
+                TickRegion &region = engine->regions[(rx * engine->regions_y + ry) * engine->regions_z + rz];
+                region.cx = rx * TICK_REGION_CHUNKS;
+                region.cy = ry * TICK_REGION_CHUNKS;
+                region.cz = rz * TICK_REGION_CHUNKS;
+            }
+        }
+    }
+
+    engine->tick = 0;
+    engine->next_order = 0;
+    engine->seed = seed;
+    engine->applied.clear();
+    engine->stats = {};
+
+    return true;
+}
+
+void tick_destroy(TickEngine *engine) {
+    engine->regions = TickVector<TickRegion>();
+    engine->applied = TickVector<BlockChange>();
+    engine->neighbours = TickVector<BlockChange>();
+}
+
+void tick_schedule(TickEngine *engine, int x, int y, int z, uint32_t delay) {
+    if (!world_contains(engine->world, x, y, z)) {
+        return;
+    }
+    ScheduledTick scheduled = {
+        .tick = engine->tick + delay,
+        .order = engine->next_order++,
+        .x = x,
+        .y = y,
+        .z = z,
+        .block = world_get_block(engine->world, x, y, z),
+    };
+    TickVector<ScheduledTick> &queue = engine->regions[region_index(engine, x, y, z)].queue;
+    queue.push_back(scheduled);
+    std::push_heap(queue.begin(), queue.end(), tick_later);
+}
+
+// Schedules every block in `neighbours` that reacts to scheduled ticks,
+// each position once, in position order.
+static void schedule_neighbours(TickEngine *engine) {
+    TickVector<BlockChange> &neighbours = engine->neighbours;
+    std::sort(neighbours.begin(), neighbours.end(), position_less);
+    auto end = std::unique(neighbours.begin(), neighbours.end(), position_equal);
+
+    for (auto it = neighbours.begin(); it != end; ++it) {
+        uint8_t block = world_get_block(engine->world, it->x, it->y, it->z);
+        if (BLOCK_TICKS[block] & TICK_SCHEDULED) {
+            tick_schedule(engine, it->x, it->y, it->z, scheduled_delay(block));
+        }
+    }
+    neighbours.clear();
+}
+
+// Notes the block at (x, y, z) and its neighbours for scheduling. Only
+// blocks reacting to scheduled ticks right now are kept, one that turns
+// into such a block later in the merge notes itself.
+static void add_neighbours(TickEngine *engine, int x, int y, int z) {
+    static const int OFFSETS[7][3] = {
+        { 0, 0, 0 },
+        { 1, 0, 0 }, { -1, 0, 0 },
+        { 0, 1, 0 }, { 0, -1, 0 },
+        { 0, 0, 1 }, { 0, 0, -1 },
+    };
+    for (const int *o : OFFSETS) {
+        uint8_t block = world_get_block(engine->world, x + o[0], y + o[1], z + o[2]);
+        if (BLOCK_TICKS[block] & TICK_SCHEDULED) {
+            engine->neighbours.push_back({ x + o[0], y + o[1], z + o[2], block });
+        }
+    }
+}
+
+void tick_set_block(TickEngine *engine, int x, int y, int z, uint8_t block) {
+    world_set_block(engine->world, x, y, z, block);
+    add_neighbours(engine, x, y, z);
+    schedule_neighbours(engine);
+}
+
+// --- block behaviour, reads the world and only records changes ---
+
+static void sand_tick(const World *world, const ScheduledTick &t, TickVector<BlockChange> &changes) {
+    if (t.y > 0 && world_get_block(world, t.x, t.y - 1, t.z) == BLOCK_AIR) {
+        changes.push_back({ t.x, t.y, t.z, BLOCK_AIR });
+        changes.push_back({ t.x, t.y - 1, t.z, BLOCK_SAND });
+    }
+}
+
+static void grass_tick(const World *world, int x, int y, int z, uint64_t *rng, TickVector<BlockChange> &changes) {
+    if (world_get_block(world, x, y + 1, z) != BLOCK_AIR) {
+        changes.push_back({ x, y, z, BLOCK_DIRT });
+        return;
+    }
+    // spreads to uncovered dirt up to one block around, three below and one above
+    uint64_t r = tick_random(rng);
+    int tx = x + (int)(r % 3) - 1;
+    int ty = y + (int)((r >> 8) % 5) - 3;
+    int tz = z + (int)((r >> 16) % 3) - 1;
+    if (world_get_block(world, tx, ty, tz) == BLOCK_DIRT && world_get_block(world, tx, ty + 1, tz) == BLOCK_AIR) {
+        changes.push_back({ tx, ty, tz, BLOCK_GRASS });
+    }
+}
+
+static bool random_tickable(const Chunk *chunk) {
+    for (int b = 0; b < BLOCK_COUNT; b++) {
+        if ((BLOCK_TICKS[b] & TICK_RANDOM) && chunk->counts[b] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void tick_region(TickEngine *engine, uint32_t index) {
+    TickRegion &region = engine->regions[index];
+    const World *world = engine->world;
+    uint64_t now = engine->tick;
+
+    region.changes.clear();
+    region.scheduled_ticks = 0;
+    region.random_ticks = 0;
+    region.skipped_chunks = 0;
+
+    TickVector<ScheduledTick> &queue = region.queue;
+    while (!queue.empty() && queue.front().tick <= now) {
+        ScheduledTick t = queue.front();
+        std::pop_heap(queue.begin(), queue.end(), tick_later);
+        queue.pop_back();
+
+        uint8_t block = world_get_block(world, t.x, t.y, t.z);
+        if (block != t.block) {
+            continue;
+        }
+        region.scheduled_ticks++;
+        if (block == BLOCK_SAND) {
+            sand_tick(world, t, region.changes);
+        }
+    }
+
+    // seeded per region and tick, so it doesn't matter which thread gets here first
+    uint64_t rng = ((uint64_t)engine->seed << 32) ^ ((uint64_t)index * 0x9e3779b97f4a7c15ull) ^ now;
+    tick_random(&rng);
+
+    for (int cx = region.cx; cx < region.cx + TICK_REGION_CHUNKS; cx++) {
+        for (int cy = region.cy; cy < region.cy + TICK_REGION_CHUNKS; cy++) {
+            for (int cz = region.cz; cz < region.cz + TICK_REGION_CHUNKS; cz++) {
+                const Chunk *chunk = world_chunk(world, cx, cy, cz);
+                if (chunk == NULL) {
+                    continue;
+                }
+                if (!random_tickable(chunk)) {
+                    region.skipped_chunks++;
+                    continue;
+                }
+                for (int i = 0; i < TICK_RANDOM_PER_CHUNK; i++) {
+                    uint64_t r = tick_random(&rng);
+                    int lx = (int)(r % CHUNK_SIZE);
+                    int ly = (int)((r >> 16) % CHUNK_SIZE);
+                    int lz = (int)((r >> 32) % CHUNK_SIZE);
+                    region.random_ticks++;
+
+                    uint8_t block = chunk->blocks[lx][ly][lz];
+                    if (!(BLOCK_TICKS[block] & TICK_RANDOM)) {
+                        continue;
+                    }
+                    int x = cx * CHUNK_SIZE + lx;
+                    int y = cy * CHUNK_SIZE + ly;
+                    int z = cz * CHUNK_SIZE + lz;
+                    if (block == BLOCK_GRASS) {
+                        grass_tick(world, x, y, z, &rng, region.changes);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void tick_regions(void *ctx, uint32_t first, uint32_t last) {
+    TRACE_SCOPE("tick_regions");
+
+    TickEngine *engine = (TickEngine *)ctx;
+    for (uint32_t i = first; i < last; i++) {
+        tick_region(engine, i);
+    }
+}
+
+void tick_step(TickEngine *engine, JobPool *jobs) {
+    TRACE_SCOPE("tick_step");
+
+    // regions read a frozen world, nothing is written until all are done
+    jobs_parallel_for(jobs, (uint32_t)engine->regions.size(), 1, tick_regions, engine);
+
+    TRACE_SCOPE("tick_merge");
+
+    // region order, so changes crossing a border land the same way every run;
+    // the last change to a block wins
+    engine->applied.clear();
+    TickStats stats = {};
+    for (TickRegion &region : engine->regions) {
+        for (const BlockChange &change : region.changes) {
+            if (world_get_block(engine->world, change.x, change.y, change.z) == change.block) {
+                continue;
+            }
+            world_set_block(engine->world, change.x, change.y, change.z, change.block);
+            engine->applied.push_back(change);
+            add_neighbours(engine, change.x, change.y, change.z);
+        }
+        stats.scheduled_ticks += region.scheduled_ticks;
+        stats.random_ticks += region.random_ticks;
+        stats.skipped_chunks += region.skipped_chunks;
+    }
+    schedule_neighbours(engine);
+
+    for (const TickRegion &region : engine->regions) {
+        stats.pending += (uint32_t)region.queue.size();
+    }
+    engine->stats = stats;
+    engine->tick++;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "jobs.h"
+#include "memory.h"
+#include "world.h"
+
+// game ticks per second
+#define TICK_RATE 20
+// regions are cubes of this many chunks per side, each one runs on a
+// single thread
+#define TICK_REGION_CHUNKS 4
+// random ticks per chunk per game tick
+#define TICK_RANDOM_PER_CHUNK 3
+// game ticks a sand block waits before falling one block
+#define TICK_SAND_DELAY 2
+
+template <class T>
+using TickVector = std::vector<T, TagAllocator<T, MEM_WORLD>>;
+
+struct ScheduledTick {
+    uint64_t tick;
+    uint64_t order;  // ties on tick run in scheduling order
+    int32_t x;
+    int32_t y;
+    int32_t z;
+    uint8_t block;   // skipped if the block changed in the meantime
+};
+
+struct BlockChange {
+    int32_t x;
+    int32_t y;
+    int32_t z;
+    uint8_t block;
+};
+
+// Regions only read the world while they tick. What they want to change is
+// collected here and merged after all regions are done, in region order.
+struct TickRegion {
+    int cx;  // first chunk
+    int cy;
+    int cz;
+    TickVector<ScheduledTick> queue;  // min heap on (tick, order)
+    TickVector<BlockChange> changes;
+    uint32_t scheduled_ticks;
+    uint32_t random_ticks;
+    uint32_t skipped_chunks;
+};
+
+struct TickStats {
+    uint32_t scheduled_ticks;
+    uint32_t random_ticks;
+    uint32_t skipped_chunks;  // chunks without random tickable blocks
+    uint32_t pending;         // scheduled ticks left in the queues
+};
+
+struct TickEngine {
+    World *world;
+    int regions_x;
+    int regions_y;
+    int regions_z;
+    TickVector<TickRegion> regions;
+    uint64_t tick;
+    uint64_t next_order;
+    uint32_t seed;
+
+    // blocks changed by the last tick_step, in the order they were applied
+    TickVector<BlockChange> applied;
+    TickVector<BlockChange> neighbours;  // scratch for the merge
+    TickStats stats;
+};
+
+bool tick_init(TickEngine *engine, World *world, uint32_t seed);
+void tick_destroy(TickEngine *engine);
+
+// Runs the scheduled tick of the block at (x, y, z) `delay` ticks from now.
+void tick_schedule(TickEngine *engine, int x, int y, int z, uint32_t delay);
+// Places a block outside of a tick and schedules it and its neighbours as
+// if a tick had changed it.
+void tick_set_block(TickEngine *engine, int x, int y, int z, uint8_t block);
+
+// Advances one game tick: every region runs its due scheduled ticks and
+// random ticks, spread over `jobs` (NULL runs them on the calling thread),
+// then the changes are applied. The result only depends on the world and
+// the seed, not on the thread count.
+void tick_step(TickEngine *engine, JobPool *jobs);
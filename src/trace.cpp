@@ -0,0 +1,279 @@
+#include <stdio.h>
+
+#include "trace.h"
+
+#ifdef SHAHTER_TRACE
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// events kept per thread, must be a power of two
+#define TRACE_BUFFER_EVENTS (1 << 16)
+#define TRACE_BUFFER_MASK (TRACE_BUFFER_EVENTS - 1)
+
+// Fields are atomics so a dump can read them while the owning thread keeps
+// writing. Relaxed stores compile to plain moves.
+struct TraceEvent {
+    std::atomic<const char *> name;
+    std::atomic<uint64_t> start;
+    std::atomic<uint64_t> end;
+};
+
+// Single writer ring, `head` counts every event ever written.
+struct TraceBuffer {
+    std::atomic<uint64_t> head;
+    std::atomic<const char *> thread_name;
+    uint32_t tid;
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+// Buffers are never freed, a thread may exit while its events get dumped.
+static std::mutex buffers_mutex;
+static std::vector<TraceBuffer *> buffers;
+
+static thread_local TraceBuffer *local_buffer = NULL;
+
+// tick/nanosecond pair taken at the first event, the dump takes another one
+// and converts ticks with the rate in between
+static uint64_t calibration_ticks;
+static uint64_t calibration_ns;
+
+static uint64_t steady_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+static TraceBuffer *register_thread() {
+    TraceBuffer *b = new TraceBuffer();
+    b->head.store(0, std::memory_order_relaxed);
+    b->thread_name.store(NULL, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    if (buffers.empty()) {
+        calibration_ticks = trace_now();
+        calibration_ns = steady_ns();
+    }
+    b->tid = (uint32_t)buffers.size() + 1;
+    buffers.push_back(b);
+    local_buffer = b;
+
+    return b;
+}
+
+void trace_record(const char *name, uint64_t start, uint64_t end) {
+    TraceBuffer *b = local_buffer;
+    if (b == NULL) {
+        b = register_thread();
+    }
+
+    uint64_t h = b->head.load(std::memory_order_relaxed);
+    TraceEvent &e = b->events[h & TRACE_BUFFER_MASK];
+    e.name.store(name, std::memory_order_relaxed);
+    e.start.store(start, std::memory_order_relaxed);
+    e.end.store(end, std::memory_order_relaxed);
+    b->head.store(h + 1, std::memory_order_release);
+}
+
+void trace_set_thread_name(const char *name) {
+    TraceBuffer *b = local_buffer;
+    if (b == NULL) {
+        b = register_thread();
+    }
+    b->thread_name.store(name, std::memory_order_relaxed);
+}
+
+struct DumpEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Copies the events of one buffer the writer hasn't overwritten meanwhile.
+static void collect(TraceBuffer *b, uint64_t cutoff, std::vector<DumpEvent> &out) {
+    uint64_t head = b->head.load(std::memory_order_acquire);
+    uint64_t first = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+
+    size_t base = out.size();
+    out.reserve(base + (size_t)(head - first));
+    for (uint64_t i = first; i < head; i++) {
+        TraceEvent &e = b->events[i & TRACE_BUFFER_MASK];
+        DumpEvent d = {
+            e.name.load(std::memory_order_relaxed),
+            e.start.load(std::memory_order_relaxed),
+            e.end.load(std::memory_order_relaxed),
+        };
+        out.push_back(d);
+    }
+
+    // the writer may be filling event head_now before its head bump shows,
+    // so anything sharing a slot with it or older may be torn
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t head_now = b->head.load(std::memory_order_relaxed);
+    uint64_t valid = head_now + 1 > TRACE_BUFFER_EVENTS ? head_now + 1 - TRACE_BUFFER_EVENTS : 0;
+    size_t skip = valid > first ? (size_t)(valid - first) : 0;
+    if (skip > head - first) {
+        skip = (size_t)(head - first);
+    }
+
+    size_t write = base;
+    for (size_t i = base + skip; i < out.size(); i++) {
+        if (out[i].end >= cutoff) {
+            out[write++] = out[i];
+        }
+    }
+    out.resize(write);
+}
+
+static void write_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', f);
+            fputc(*s, f);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(f, "\\u%04x", *s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// Events of every thread copied out of the rings, what a dump writes.
+struct TraceSnapshot {
+    std::vector<uint32_t> tids;
+    std::vector<const char *> thread_names;
+    std::vector<std::vector<DumpEvent>> events;
+    uint64_t base;
+    double ns_per_tick;
+};
+
+// a background dump is being written, dumps don't overlap
+static std::atomic<bool> writing(false);
+
+static void take_snapshot(double seconds, TraceSnapshot *s) {
+    uint64_t now = trace_now();
+    uint64_t now_ns = steady_ns();
+
+    std::vector<TraceBuffer *> snapshot;
+    s->ns_per_tick = 1.0;
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        snapshot = buffers;
+        if (!buffers.empty() && now > calibration_ticks && now_ns > calibration_ns) {
+            s->ns_per_tick = (double)(now_ns - calibration_ns) / (double)(now - calibration_ticks);
+        }
+    }
+
+    uint64_t window = (uint64_t)(seconds * 1e9 / s->ns_per_tick);
+    uint64_t cutoff = now > window ? now - window : 0;
+
+    s->tids.resize(snapshot.size());
+    s->thread_names.resize(snapshot.size());
+    s->events.resize(snapshot.size());
+    s->base = now;
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        s->tids[i] = snapshot[i]->tid;
+        s->thread_names[i] = snapshot[i]->thread_name.load(std::memory_order_relaxed);
+        collect(snapshot[i], cutoff, s->events[i]);
+        for (const DumpEvent &e : s->events[i]) {
+            if (e.start < s->base) {
+                s->base = e.start;
+            }
+        }
+    }
+}
+
+static bool write_snapshot(const char *path, const TraceSnapshot *s) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: Failed to open trace file %s\n", path);
+        return false;
+    }
+
+    size_t count = 0;
+    bool first = true;
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < s->events.size(); i++) {
+        if (s->thread_names[i]) {
+            fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", s->tids[i]);
+            write_json_string(f, s->thread_names[i]);
+            fprintf(f, "}}");
+            first = false;
+        }
+
+        for (const DumpEvent &e : s->events[i]) {
+            // trace-event timestamps are microseconds
+            fprintf(f, "%s{\"ph\":\"X\",\"name\":", first ? "" : ",\n");
+            write_json_string(f, e.name);
+            fprintf(
+                f,
+                ",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                s->tids[i],
+                (double)(e.start - s->base) * s->ns_per_tick / 1000.0,
+                (double)(e.end - e.start) * s->ns_per_tick / 1000.0
+            );
+            first = false;
+        }
+        count += s->events[i].size();
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    printf("Wrote %zu trace events to %s\n", count, path);
+
+    return true;
+}
+
+void trace_wait() {
+    while (writing.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool trace_dump(const char *path, double seconds) {
+    trace_wait();
+    TraceSnapshot snapshot;
+    take_snapshot(seconds, &snapshot);
+    return write_snapshot(path, &snapshot);
+}
+
+bool trace_dump_async(const char *path, double seconds) {
+    if (writing.exchange(true, std::memory_order_acquire)) {
+        fprintf(stderr, "ERROR: Failed to dump the trace, the last dump is still being written\n");
+        return false;
+    }
+
+    TraceSnapshot *snapshot = new TraceSnapshot();
+    take_snapshot(seconds, snapshot);
+    std::string file = path;
+    std::thread([snapshot, file]() {
+        write_snapshot(file.c_str(), snapshot);
+        delete snapshot;
+        writing.store(false, std::memory_order_release);
+    }).detach();
+
+    return true;
+}
+
+#else
+
+bool trace_dump(const char *path, double seconds) {
+    (void)path;
+    (void)seconds;
+    fprintf(stderr, "Tracing is compiled out, rebuild with SHAHTER_TRACE\n");
+    return false;
+}
+
+bool trace_dump_async(const char *path, double seconds) {
+    return trace_dump(path, seconds);
+}
+
+void trace_wait() {
+}
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Scoped trace zones, recorded into a per-thread ring buffer and dumped as
+// Chrome/Perfetto trace-event JSON. Without SHAHTER_TRACE the macros compile
+// to nothing.
+
+#ifdef SHAHTER_TRACE
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// `name` must be a string literal, events only keep the pointer.
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) trace_set_thread_name(name)
+
+// Zones are timed in raw ticks, the dump converts them to nanoseconds.
+// On x86 that is the (invariant) TSC, a fraction of a clock_gettime call.
+static inline uint64_t trace_now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+#endif
+}
+
+void trace_record(const char *name, uint64_t start, uint64_t end);
+void trace_set_thread_name(const char *name);
+
+struct TraceScope {
+    const char *name;
+    uint64_t start;
+
+    TraceScope(const char *name) : name(name), start(trace_now()) {}
+    ~TraceScope() {
+        trace_record(name, start, trace_now());
+    }
+};
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+
+#endif
+
+// Writes the zones that ended in the last `seconds` of every thread to `path`.
+// Returns false if the file can't be written or tracing is compiled out.
+bool trace_dump(const char *path, double seconds);
+// The same without stalling the caller: the zones are copied here, the
+// file is written on a detached thread. False while the last one is still
+// being written.
+bool trace_dump_async(const char *path, double seconds);
+// Waits for a trace_dump_async in flight, call it before exiting.
+void trace_wait();
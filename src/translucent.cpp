@@ -0,0 +1,86 @@
+#include <string.h>
+
+#include <utility>
+
+#include "translucent.h"
+#include "trace.h"
+
+// Entries compare by the top 24 bits of their key only, closer than that
+// is far below a visible difference.
+#define SORT_SHIFT 40
+
+// Descending, stable, a byte at a time from the lowest that counts. Bytes
+// all keys share are skipped.
+static void radix_sort(TranslucentOrder *order) {
+    size_t count = order->entries.size();
+    order->swap.resize(count);
+
+    for (int shift = SORT_SHIFT; shift < 64; shift += 8) {
+        uint32_t offsets[256] = {};
+        const uint64_t *entries = order->entries.data();
+        for (size_t i = 0; i < count; i++) {
+            offsets[(uint8_t)(~entries[i] >> shift)]++;
+        }
+        if (offsets[(uint8_t)(~entries[0] >> shift)] == count) {
+            continue;
+        }
+        uint32_t sum = 0;
+        for (int b = 0; b < 256; b++) {
+            uint32_t n = offsets[b];
+            offsets[b] = sum;
+            sum += n;
+        }
+        uint64_t *out = order->swap.data();
+        for (size_t i = 0; i < count; i++) {
+            out[offsets[(uint8_t)(~entries[i] >> shift)]++] = entries[i];
+        }
+        std::swap(order->entries, order->swap);
+    }
+}
+
+void translucent_sort(TranslucentOrder *order, const TranslucentMesh *mesh, glm::vec3 camera) {
+    TRACE_SCOPE("translucent_sort");
+
+    uint32_t count = (uint32_t)mesh->splits.size();
+    if (order->entries.size() != count) {
+        order->entries.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            order->entries[i] = i;
+        }
+    }
+    if (count == 0) {
+        order->indices.clear();
+        return;
+    }
+
+    // squared distances aren't negative, so their bits compare like them
+    const float *centers = mesh->centers.data();
+    uint64_t *entries = order->entries.data();
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t quad = (uint32_t)entries[i];
+        const float *c = &centers[quad * 3];
+        glm::vec3 offset = glm::vec3(c[0], c[1], c[2]) - camera;
+        float distance = glm::dot(offset, offset);
+        uint32_t key;
+        memcpy(&key, &distance, sizeof(key));
+        entries[i] = ((uint64_t)key << 32) | quad;
+    }
+
+    radix_sort(order);
+
+    order->indices.resize((size_t)count * 6);
+    uint32_t *indices = order->indices.data();
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t quad = (uint32_t)order->entries[i];
+        const uint32_t *split = QUAD_SPLIT[mesh->splits[quad]];
+        for (int k = 0; k < 6; k++) {
+            indices[i * 6 + k] = quad * 4 + split[k];
+        }
+    }
+}
+
+void translucent_order_free(TranslucentOrder *order) {
+    order->entries = TranslucentVector<uint64_t>();
+    order->indices = TranslucentVector<uint32_t>();
+    order->swap = TranslucentVector<uint64_t>();
+}
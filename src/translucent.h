@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "memory.h"
+
+// Back to front order of one chunk's translucent quads, kept between sorts.
+//
+// Sorting is a stable radix sort that starts from the last order, so
+// quads at about the same distance keep their places instead of flickering
+// between frames. The keys are squared distances cut to 24 bits.
+
+template <class T>
+using TranslucentVector = std::vector<T, TagAllocator<T, MEM_MESHES>>;
+
+struct TranslucentOrder {
+    // back to front, squared distance bits << 32 | quad
+    TranslucentVector<uint64_t> entries;
+    TranslucentVector<uint32_t> indices;  // 6 per quad in that order, for the element buffer
+
+    // scratch
+    TranslucentVector<uint64_t> swap;
+};
+
+// Sorts the quads of `mesh` back to front as seen from `camera`, in the
+// chunk space of the mesh, and rebuilds `indices`. A quad count different
+// from the last sort starts over from the mesh order. Needs no GL context.
+void translucent_sort(TranslucentOrder *order, const TranslucentMesh *mesh, glm::vec3 camera);
+void translucent_order_free(TranslucentOrder *order);
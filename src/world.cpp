@@ -0,0 +1,112 @@
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "world.h"
+
+bool world_init(World *world, int size_x, int size_y, int size_z) {
+    world->size_x = size_x;
+    world->size_y = size_y;
+    world->size_z = size_z;
+
+    size_t count = (size_t)size_x * size_y * size_z;
+    world->chunks = (Chunk **)mem_malloc(MEM_WORLD, count * sizeof(Chunk *));
+    if (world->chunks == NULL) {
+        fprintf(stderr, "Failed to allocate a %dx%dx%d world\n", size_x, size_y, size_z);
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        world->chunks[i] = chunk_create();
+        if (world->chunks[i] == NULL) {
+            fprintf(stderr, "Failed to allocate chunk\n");
+            for (size_t j = 0; j < i; j++) {
+                chunk_destroy(world->chunks[j]);
+            }
+            mem_free(MEM_WORLD, world->chunks);
+            world->chunks = NULL;
+            return false;
+        }
+    }
+    return true;
+}
+
+void world_destroy(World *world) {
+    if (world->chunks == NULL) {
+        return;
+    }
+    size_t count = (size_t)world->size_x * world->size_y * world->size_z;
+    for (size_t i = 0; i < count; i++) {
+        chunk_destroy(world->chunks[i]);
+    }
+    mem_free(MEM_WORLD, world->chunks);
+    world->chunks = NULL;
+}
+
+Chunk *world_chunk(const World *world, int cx, int cy, int cz) {
+    if (
+        cx < 0 || cx >= world->size_x
+        || cy < 0 || cy >= world->size_y
+        || cz < 0 || cz >= world->size_z
+    ) {
+        return NULL;
+    }
+    return world->chunks[((size_t)cx * world->size_y + cy) * world->size_z + cz];
+}
+
+void world_chunk_neighbours(const World *world, int cx, int cy, int cz, ChunkNeighbours *around) {
+    for (int x = 0; x < 3; x++) {
+        for (int y = 0; y < 3; y++) {
+            for (int z = 0; z < 3; z++) {
+                around->chunks[x][y][z] = world_chunk(world, cx + x - 1, cy + y - 1, cz + z - 1);
+            }
+        }
+    }
+}
+
+bool world_contains(const World *world, int x, int y, int z) {
+    return x >= 0 && x < world->size_x * CHUNK_SIZE
+        && y >= 0 && y < world->size_y * CHUNK_SIZE
+        && z >= 0 && z < world->size_z * CHUNK_SIZE;
+}
+
+uint8_t world_get_block(const World *world, int x, int y, int z) {
+    if (!world_contains(world, x, y, z)) {
+        return BLOCK_AIR;
+    }
+    const Chunk *chunk = world_chunk(world, x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE);
+    return chunk->blocks[x % CHUNK_SIZE][y % CHUNK_SIZE][z % CHUNK_SIZE];
+}
+
+void world_set_block(World *world, int x, int y, int z, uint8_t block) {
+    if (!world_contains(world, x, y, z)) {
+        return;
+    }
+    Chunk *chunk = world_chunk(world, x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE);
+    chunk_set_block(chunk, x % CHUNK_SIZE, y % CHUNK_SIZE, z % CHUNK_SIZE, block);
+}
+
+void world_generate(World *world) {
+    int base = world->size_y * CHUNK_SIZE / 4;
+    for (int x = 0; x < world->size_x * CHUNK_SIZE; x++) {
+        for (int z = 0; z < world->size_z * CHUNK_SIZE; z++) {
+            int top = base + (int)(4.0f * sinf(x * 0.1f) + 4.0f * cosf(z * 0.13f));
+            top = std::clamp(top, 1, world->size_y * CHUNK_SIZE - 1);
+            for (int y = 0; y < top; y++) {
+                world_set_block(world, x, y, z, BLOCK_DIRT);
+            }
+            world_set_block(world, x, top, z, BLOCK_GRASS);
+        }
+    }
+}
+
+void world_flood(World *world, int level) {
+    level = std::min(level, world->size_y * CHUNK_SIZE - 1);
+    for (int x = 0; x < world->size_x * CHUNK_SIZE; x++) {
+        for (int z = 0; z < world->size_z * CHUNK_SIZE; z++) {
+            for (int y = level; y >= 0 && world_get_block(world, x, y, z) == BLOCK_AIR; y--) {
+                world_set_block(world, x, y, z, BLOCK_WATER);
+            }
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "chunk.h"
+
+// Fixed box of chunks starting at the origin, chunk (cx, cy, cz) holds the
+// blocks cx * CHUNK_SIZE .. cx * CHUNK_SIZE + CHUNK_SIZE - 1 along x, and so
+// on. Block coordinates are the chunk space ones of chunk (0, 0, 0).
+struct World {
+    int size_x;  // in chunks
+    int size_y;
+    int size_z;
+    Chunk **chunks;  // [x][y][z] like Chunk::blocks
+};
+
+bool world_init(World *world, int size_x, int size_y, int size_z);
+void world_destroy(World *world);
+
+// NULL outside the world.
+Chunk *world_chunk(const World *world, int cx, int cy, int cz);
+// Returns BLOCK_AIR outside the world.
+uint8_t world_get_block(const World *world, int x, int y, int z);
+// Ignored outside the world.
+void world_set_block(World *world, int x, int y, int z, uint8_t block);
+bool world_contains(const World *world, int x, int y, int z);
+// Chunk (cx, cy, cz) and the ones around it, for mesh_chunk_neighbours.
+void world_chunk_neighbours(const World *world, int cx, int cy, int cz, ChunkNeighbours *around);
+
+// Rolling grass over dirt, a quarter of the world high on average.
+void world_generate(World *world);
+// Pours water into every column from height `level` down to the first
+// block, so caves under the surface stay dry.
+void world_flood(World *world, int level);